@@ -1,3 +1,6 @@
+#include <signal.h>
+#include <stdio.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -5,14 +8,24 @@
 #define MAX_TOKENS 64
 #define MAX_COMMANDS 10
 #define MAX_JOBS 32
+#define MAX_LIST_ITEMS 32   // Pipelines joined by ; & && || on one line
+#define MAX_PROCSUBST 8     // <(cmd) / >(cmd) per pipeline
+#define MAX_OUTPUT_TARGETS 8 // > and >> targets on one command (multios)
+#define MAX_PARALLEL 64     // Copies of one |[N] stage
+#define MAX_JOB_PIDS (3 * MAX_COMMANDS + MAX_PROCSUBST)  // Commands, their fan-out helpers, pipestat relays or sampler, <(...) helpers
+#define TIMEOUT_STATUS 124  // Status of a job its deadline ended, as timeout(1) reports it
 
 // Redirection flags
 #define REDIRECT_IN   0x01  // 0001
 #define REDIRECT_OUT  0x02  // 0010
 #define REDIRECT_APP  0x04  // 0100
+#define REDIRECT_HEREDOC 0x08  // 1000: <<DELIM or <<< word feeds stdin
 
 #define VARS_EXCESS_CAPACITY 16 
 
+// Default size of each read() when capturing command substitution output
+#define CAPTURE_CHUNK_SIZE 65536
+
 // Supports display_variables function
 #define DISPLAY_LOCAL 1
 #define DISPLAY_EXPORTED 2
@@ -43,58 +56,283 @@ extern char **environ;  // Original environment variables
 extern struct VariableStore var_store;     
 
 // Pipeline-related structures
+struct OutputTarget {
+    char *file;     // Target word; expanded in place before the command runs
+    int append;     // 1 for >>, 0 for >
+};
+
 struct Redirection {
     char input_file[MAX_INPUT_SIZE];    
-    char output_file[MAX_INPUT_SIZE];   
-    char append_file[MAX_INPUT_SIZE];
+    struct OutputTarget outputs[MAX_OUTPUT_TARGETS];  // Every > and >> in order; all of them get the output
+    int output_count;
 };
 
+struct CommandList;
+
+// Kinds of grouped commands
+#define GROUP_NONE     0
+#define GROUP_SUBSHELL 1    // ( list ): runs in one forked child
+#define GROUP_BRACE    2    // { list; }: runs in the current shell
+
 struct Command{
     char *argv[MAX_TOKENS];
     struct Redirection redirects;
     int redirect_flags;
+    char *heredoc;          // Here-document body, or here-string word (raw)
+    int heredoc_type;       // HEREDOC_* below
+    int heredoc_fd;         // Prepared stdin for the child; -1 when unused
+    int fanout_fd;          // Prepared stdout feeding a fan-out helper; -1 when unused
+    struct CommandList *group;  // Body of ( list ) or { list; }; NULL for simple commands
+    int group_type;             // GROUP_* above
+    int parallel;               // Copies requested with |[N]; 0 for an ordinary stage
+    int parallel_ordered;       // |[N:ordered]: keep output in input order
 };
 
+// Kinds of here-document input
+#define HEREDOC_LITERAL 0   // <<'EOF': body used as-is
+#define HEREDOC_EXPAND  1   // <<EOF: $ and ` expanded in the body
+#define HEREDOC_STRING  2   // <<< word: word expanded, newline appended
+
 struct Pipeline {
     struct Command commands[MAX_COMMANDS];
     int pipe_count;
+    char *pipe_size;        // From a "pipesize SIZE" prefix; NULL falls back to $PIPE_SIZE
+    int pipestat;           // PIPESTAT_* from a "pipestat [-d]" prefix; $PIPESTAT sets it for every pipeline
+    char *coproc_name;      // From a "coproc NAME" prefix; NULL for an ordinary pipeline
+    char *affinity;         // From an "affinity SETTING" prefix; NULL falls back to $CPU_AFFINITY
+    char *timeout;          // From a "timeout DURATION" prefix; NULL falls back to $JOB_TIMEOUT
+    int timed;              // Set by a "time" prefix: report the job's resource usage
+};
+
+// How a pipeline in a command list connects to the next one
+enum ListOp {
+    LIST_SEQ,   // ;  run the next pipeline unconditionally
+    LIST_AND,   // && run the next pipeline only if this one succeeded
+    LIST_OR,    // || run the next pipeline only if this one failed
+    LIST_BG     // &  run this pipeline in the background, then continue
+};
+
+// A whole input line, parsed once
+struct CommandList {
+    struct Pipeline *pipelines[MAX_LIST_ITEMS];
+    enum ListOp ops[MAX_LIST_ITEMS];    // Operator following each pipeline
+    char *texts[MAX_LIST_ITEMS];        // Source text of each pipeline, for job display
+    int count;
+};
+
+// pipestat modes
+#define PIPESTAT_OFF      0
+#define PIPESTAT_SAMPLED  1   // A sampler reads each pipe's fill level and each stage's I/O counters
+#define PIPESTAT_DETAILED 2   // A relay in each pipe counts bytes and blocked time exactly
+
+// pipestat: one pipe between stages, as seen by its sampler or measured by its relay
+struct PipeStatLink {
+    unsigned long long bytes;           // Bytes into the pipe so far (sampled: the writer's wchar)
+    unsigned long long read_wait_ns;    // Pipe empty: the reader stage starved
+    unsigned long long write_wait_ns;   // Pipe full: the writer stage blocked
+    unsigned long long start_ns;        // CLOCK_MONOTONIC when the relay or sampler started
+    unsigned long long end_ns;          // When input ended (sampled: the writer exited); 0 while running
+    unsigned long long samples;         // Sampled: times the fill level was read
+    unsigned long long fill_sum;        // Sampled: sum of fill levels in percent of capacity
+    pid_t writer;                       // Sampled: stage writing the pipe; 0 if none
+    pid_t reader;                       // Sampled: stage reading the pipe as its stdin; 0 if none
+    ino_t inode;                        // Sampled: the pipe, to tell it from whatever else is on fd 0
+};
+
+// Shared (MAP_SHARED) between the shell and a pipeline's sampler or relays
+struct PipeStatTable {
+    int stage_count;
+    int mode;                           // PIPESTAT_SAMPLED or PIPESTAT_DETAILED
+    unsigned long long start_ns;
+    char names[MAX_COMMANDS][32];       // argv[0] of each stage
+    struct PipeStatLink links[MAX_COMMANDS - 1];
 };
 
 //Job related structures
-enum JobState {JOB_RUNNING, JOB_STOPPED, JOB_DONE };
+enum JobState {JOB_RUNNING, JOB_STOPPED, JOB_DONE, JOB_QUEUED };  // QUEUED: waiting for a JOB_SLOTS slot
 
 struct Job {
     int job_id;                    // Job number (1, 2, 3...)
-    pid_t pids[MAX_COMMANDS];      // All PIDs in this job (for pipelines)
-    int pid_status[MAX_COMMANDS];  // 1=running, 0=finished
+    pid_t pids[MAX_JOB_PIDS];      // All PIDs in this job (for pipelines)
+    int pid_status[MAX_JOB_PIDS];  // 1=running, 0=finished
+    int pid_exit[MAX_JOB_PIDS];    // Exit status of each finished PID ($? form)
     int pid_count;                 // Number of processes in this job
+    int helper_count;              // Trailing PIDs that are <(...)/>(...) helpers
     int is_background;             // Background or foreground
     char command_line[MAX_INPUT_SIZE]; // Original command for display
     enum JobState state;           // RUNNING, STOPPED, DONE
+    struct PipeStatTable *pipestat;  // Per-stage metrics when run under pipestat; NULL otherwise
+    int holds_slot;                // Took a JOB_SLOTS slot, given back when the job is done
+    int coproc_fds[2];             // Shell's ends of a coproc's pipes (read, write); -1 otherwise
+    int throttled;                 // Stopped by the pressure governor rather than the user
+    int throttle_count;            // Times the governor stopped it; reported when it finishes
+    unsigned long long throttle_start_ns;  // CLOCK_MONOTONIC when the current throttle began
+    unsigned long long throttled_ns;       // Total time spent throttled
+    int deprioritized;             // Reniced and given idle I/O by BG_PRIORITY; fg restores it
+    int deadline_fd;               // timerfd for the job's deadline, then its grace period; -1 if none
+    int timeout_stage;             // 0 before the deadline, 1 after SIGTERM, 2 after SIGKILL
+    int timed_out;                 // Ended by its deadline: shown as "Timed out", status 124
+    double time_limit;             // Seconds the job was given; cleared once the timeout is reported
+    struct JobLog *joblog;         // Captured stdout/stderr when JOB_CAPTURE was on; NULL otherwise
+    char pid_names[MAX_JOB_PIDS][24];        // Command of each PID, for time and jobs -l
+    struct rusage pid_usage[MAX_JOB_PIDS];   // What wait4() reported for each finished PID
+    unsigned long long pid_end_ns[MAX_JOB_PIDS];  // CLOCK_MONOTONIC when each PID was reaped; 0 before
+    unsigned long long start_ns;   // CLOCK_MONOTONIC when the job started
+    int timed;                     // Run under "time": report its usage once it finishes
 };
 
 struct JobTable {
     struct Job jobs[MAX_JOBS];     // Array of jobs
     int job_count;                 // Number of active jobs
     int next_job_id;               // Next ID to assign; starts at 1
+    int starting_slot;             // Queued job being started: createJob() fills it in; -1 otherwise
 };
 
 extern struct JobTable job_table;
 
+// The job table as exported to /dev/shm/mysh-PID for mysh-top (see jobshm.c)
+#define JOBSHM_PREFIX "mysh-"
+#define JOBSHM_MAGIC 0x6d797368u  // "mysh"
+#define JOBSHM_VERSION 1
+#define JOBSHM_COMMAND_SIZE 128
+
+struct JobShmEntry {
+    int job_id;
+    int pgid;                      // 0 if unknown
+    int state;                     // enum JobState
+    int throttled;                 // Stopped by the pressure governor
+    int is_background;
+    int pid_count;
+    unsigned long long start_ns;   // CLOCK_MONOTONIC when the job started
+    char command[JOBSHM_COMMAND_SIZE];
+};
+
+struct JobShmSegment {
+    unsigned int magic;            // JOBSHM_MAGIC once the segment is set up
+    unsigned int version;
+    unsigned int seq;              // Odd while the shell is rewriting the jobs below
+    int shell_pid;
+    unsigned long long shell_start_ns;
+    unsigned long long updated_ns;
+    int job_count;
+    struct JobShmEntry jobs[MAX_JOBS];
+};
+
+// Growable byte buffer; data is always NUL-terminated once allocated
+struct Buffer {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+// Arena of per-command-line allocations, released together after the line runs
+struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+struct ArenaOwned {
+    struct ArenaOwned *next;
+    void *ptr;
+};
+
+struct Arena {
+    struct ArenaBlock *blocks;
+    struct ArenaOwned *owned;   // malloc'd pointers adopted by the arena
+};
+
+// Execution state shared across modules
+extern struct Arena line_arena;  // Parse tree and expansions for the current line
+extern int last_exit_status;     // Exit status of the most recent pipeline ($?)
+extern pid_t last_background_pid; // Last command of the most recent background job ($!)
+extern int shell_should_exit;    // Set by the "exit" command
+extern int tail_exec_enabled;    // The final simple command may replace the shell instead of forking
+
 // FUNCTION PROTOTYPES
 // built-ins.c
 struct Command *initialze_Command(struct Command *cmd); 
 int process_built_in_command(struct Command *cmd);
+int is_builtin_command(const char *name);
+int run_builtin(struct Command *cmd);
+int is_substitution_safe_builtin(const char *name);
+int builtin_needs_process(const char *name);
+
+// affinity.c
+struct AffinityPlan;
+struct AffinityPlan *plan_affinity(struct Pipeline *pipeline);
+void apply_affinity(const struct AffinityPlan *plan, int stage);
+
+// deadline.c
+struct pollfd;
+double pipeline_time_limit(struct Pipeline *pipeline);
+void arm_job_deadline(struct Job *job, double seconds);
+void service_deadlines(void);
+int add_deadline_fds(struct pollfd *fds, int max);
+pid_t waitpid_with_deadlines(pid_t pid, int *wstatus, int options, struct rusage *usage);
+void deadline_release(struct Job *job);
+
+// exec.c
+int command_substitution(const char *text, struct Buffer *out);
+int execute_line(char *input);
+int execute_list(struct CommandList *list);
+int execute_pipeline(struct Pipeline *pipeline, int background, const char *command_line);
+int process_substitution(const char *text, int is_output, struct Buffer *out);
+pid_t spawn_command_text(const char *text, int out_fd);
+void run_command_in_child(struct Command *cmd);
+int start_queued_job(struct Job *job, int foreground);
+int wait_status_to_exit(int wstatus);
+
+// governor.c
+void update_governor(void);
+void governor_release(struct Job *job);
+void governor_report(struct Job *job);
+
+// joblog.c
+struct JobLog;
+struct JobLog *joblog_create(int *write_fd);
+void joblog_free(struct JobLog *log);
+int builtin_joblog(char **argv);
+
+// jobshm.c
+void jobshm_open(void);
+void jobshm_close(void);
+void jobshm_publish(void);
+void jobshm_sync(void);
+extern volatile sig_atomic_t jobshm_stale;
 
 // jobs.c
 int createJob(struct JobTable *table, char *input, int *is_background, pid_t *pids, int pid_count);
 int cleanup_single_job(struct Job *job);
 void cleanup_finished_jobs(struct JobTable *table);
 int find_finished_job(struct JobTable *table);
-int process_job_command(struct Command *cmd, struct JobTable *job_table);
+int has_pending_jobs(struct JobTable *table);
+struct Job *find_job_by_spec(struct JobTable *table, const char *spec);
+struct Job *find_any_job_by_id(struct JobTable *table, int job_id);
+int signal_job(struct Job *job, int sig);
+int process_job_command(struct Command *cmd, struct JobTable *job_table, int *status);
+int job_exit_status(struct Job *job);
+int queue_job(struct JobTable *table, const char *command_line);
+void start_queued_jobs(struct JobTable *table);
+int has_queued_jobs(struct JobTable *table);
+void wait_for_job_queue(struct JobTable *table);
+
+// jobserver.c
+int job_slot_limit(void);
+void update_job_slots(void);
+int acquire_job_slot(void);
+void release_job_slot(void);
+int job_slot_fd(void);
+
+// main.c
+char *read_input_line(const char *prompt);
 
 // parser.c
-void parse_input(char *input, struct Pipeline *pipeline, int *input_has_background_process); 
+int parse_input(char *input, struct CommandList *list); 
+char *expand_var(const char *input, struct VariableStore *var_store);
+int expand_word(const char *word, char **fields, int max_fields);
+long find_matching_paren(const char *s, size_t start);
 
 // vars.c - Variable management
 char **build_environ_array(const struct VariableStore *vs);
@@ -108,6 +346,105 @@ int init_variable_store(struct VariableStore *vs);
 int set_variable(struct VariableStore *vs, const char *name, const char *value, int is_exported);
 int unset_variable(struct VariableStore *vs, const char *name);
 
+// merge.c
+int builtin_merge(char **argv);
+
+// parallel.c
+void run_parallel_stage(struct Command *cmd);
+int builtin_parallel(char **argv);
+
+// pipestat.c
+struct PipeStatTable *pipestat_create(struct Pipeline *pipeline, int mode);
+pid_t pipestat_start_relay(struct PipeStatTable *table, int link, int in_fd, int out_fd);
+pid_t pipestat_start_sampler(struct PipeStatTable *table);
+void pipestat_report(FILE *out, const struct PipeStatTable *table);
+void pipestat_free(struct PipeStatTable *table);
+
+// priority.c
+int update_bg_priority(void);
+void lower_job_priority(struct Job *job);
+void restore_job_priority(struct Job *job);
+
+// rusage.c
+void job_usage_start(struct Job *job);
+void job_pid_reaped(struct Job *job, int index, int wstatus, const struct rusage *usage);
+void job_usage_report(FILE *out, struct Job *job);
+void job_time_report(struct Job *job);
+
+// shellstat.c - always-on counters and latency histograms
+enum ShellCounter {
+    STAT_FORKS,
+    STAT_EXECS,
+    STAT_EXEC_FAILURES,
+    STAT_PATH_PROBES,
+    STAT_VAR_LOOKUPS,
+    STAT_ENV_REBUILDS,
+    STAT_JOBS_CREATED,
+    STAT_JOBS_REAPED,
+    STAT_BYTES_ALLOCATED,
+    STAT_COUNTER_COUNT
+};
+enum ShellLatency {
+    LATENCY_PARSE,
+    LATENCY_SPAWN,
+    LATENCY_COMMAND,
+    LATENCY_COUNT
+};
+#define LATENCY_BUCKETS 32
+struct ShellStats {
+    unsigned long long counters[STAT_COUNTER_COUNT];
+    unsigned long long buckets[LATENCY_COUNT][LATENCY_BUCKETS];
+    unsigned long long latency_count[LATENCY_COUNT];
+    unsigned long long latency_sum_ns[LATENCY_COUNT];
+};
+extern struct ShellStats *shell_stats;
+#define STAT_ADD(counter, n) __atomic_fetch_add(&shell_stats->counters[(counter)], (n), __ATOMIC_RELAXED)
+#define STAT_INC(counter) STAT_ADD((counter), 1)
+void shellstat_init(void);
+void record_latency(int which, unsigned long long start_ns);
+int builtin_shellstat(char **argv);
+
 // signals.c
 void sigchld_handler(int sig);
 
+// trace.c - trace points cost one pointer test while tracing is off
+enum TraceEvent {
+    TRACE_COMMAND,
+    TRACE_PARSE,
+    TRACE_EXPAND,
+    TRACE_PATH_LOOKUP,
+    TRACE_ENVIRON,
+    TRACE_FORK,
+    TRACE_EXEC,
+    TRACE_WAIT,
+    TRACE_TERMINAL,
+    TRACE_EVENT_COUNT
+};
+extern struct TraceRing *trace_ring;
+#define TRACE_START() (trace_ring != NULL ? monotonic_ns() : 0)
+#define TRACE_END(event, start, detail) \
+    do { if (trace_ring != NULL) trace_record((event), (start), (detail)); } while (0)
+#define TRACE_MARK(event, detail) \
+    do { if (trace_ring != NULL) trace_mark((event), (detail)); } while (0)
+void trace_record(int event, unsigned long long start_ns, const char *detail);
+void trace_mark(int event, const char *detail);
+int builtin_trace(char **argv);
+
+// utils.c
+void buf_init(struct Buffer *b);
+int buf_reserve(struct Buffer *b, size_t extra);
+int buf_append(struct Buffer *b, const char *s, size_t n);
+int buf_putc(struct Buffer *b, char c);
+char *buf_detach(struct Buffer *b);
+void buf_free(struct Buffer *b);
+void *arena_alloc(struct Arena *a, size_t size);
+char *arena_strndup(struct Arena *a, const char *s, size_t n);
+char *arena_strdup(struct Arena *a, const char *s);
+void *arena_adopt(struct Arena *a, void *ptr);
+void arena_free(struct Arena *a);
+void close_other_fds(const int *keep, int keep_count);
+int parse_duration(const char *s, double *seconds);
+int parse_size(const char *s, long *bytes);
+void format_bytes(char *buf, size_t size, unsigned long long bytes);
+unsigned long long monotonic_ns(void);
+
@@ -0,0 +1,223 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/shell.h"
+
+// CPU placement for jobs. "affinity SETTING" in front of a pipeline wins over the
+// CPU_AFFINITY variable. SETTING is one of
+//   LIST              every stage of the job runs on the CPUs in LIST ("0-3,8")
+//   LIST:LIST:...     stage i runs on the i-th list; extra stages cycle through them again
+//   auto              each stage gets its own CPU, with adjacent stages on CPUs that share
+//                     a cache, so data passing through the pipes stays warm
+// The child applies its set with sched_setaffinity() right after fork, before it execs.
+
+struct AffinityPlan {
+    int stage_count;
+    cpu_set_t sets[MAX_COMMANDS];
+};
+
+// Allowed CPUs in placement order: by NUMA node, then L3, then L2, so CPUs next to each
+// other in the order share as much cache as possible
+static int topo_cpus[CPU_SETSIZE];
+static int topo_l3[CPU_SETSIZE];     // Lowest CPU sharing topo_cpus[i]'s L3; the cache domain
+static int topo_count = -1;          // -1 until the topology has been read
+static int next_auto_cpu;            // Where the next auto-placed job starts, so jobs spread out
+
+// Parse a kernel-style CPU list such as "0-3,8,10-11" into set
+// Returns 0 on success, -1 if the text is not a valid list
+static int parse_cpu_list(const char *s, cpu_set_t *set) {
+    CPU_ZERO(set);
+    if (*s == '\0') return -1;
+    while (*s != '\0') {
+        char *end;
+        long first = strtol(s, &end, 10);
+        long last = first;
+        if (end == s || first < 0) return -1;
+        if (*end == '-') {
+            s = end + 1;
+            last = strtol(s, &end, 10);
+            if (end == s || last < first) return -1;
+        }
+        if (last >= CPU_SETSIZE) return -1;
+        for (long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, set);
+        s = end;
+        if (*s == ',') s++;
+        else if (*s != '\0' && *s != '\n') return -1;
+        else break;
+    }
+    return 0;
+}
+
+// Lowest CPU that shares cpu's cache of the given level, or cpu itself if sysfs doesn't say
+static int cache_domain(int cpu, int level) {
+    char path[128];
+    char text[4096];
+    for (int index = 0; index < 16; index++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+        FILE *f = fopen(path, "r");
+        if (f == NULL) break;
+        int found = 0;
+        if (fscanf(f, "%d", &found) != 1) found = 0;
+        fclose(f);
+        if (found != level) continue;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+        f = fopen(path, "r");
+        if (f == NULL) break;
+        cpu_set_t shared;
+        int ok = fgets(text, sizeof(text), f) != NULL && parse_cpu_list(text, &shared) == 0;
+        fclose(f);
+        if (!ok) break;
+        for (int k = 0; k < CPU_SETSIZE; k++) {
+            if (CPU_ISSET(k, &shared)) return k;
+        }
+    }
+    return cpu;
+}
+
+// NUMA node of cpu from its nodeN entry in sysfs; 0 if there is none
+static int numa_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (dir == NULL) return 0;
+    int node = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+struct TopoKey {
+    int cpu, node, l3, l2;
+};
+
+static int compare_topo(const void *a, const void *b) {
+    const struct TopoKey *x = a, *y = b;
+    if (x->node != y->node) return x->node - y->node;
+    if (x->l3 != y->l3) return x->l3 - y->l3;
+    if (x->l2 != y->l2) return x->l2 - y->l2;
+    return x->cpu - y->cpu;
+}
+
+// Read the cache topology of the CPUs this shell may run on, once
+static void read_topology(void) {
+    if (topo_count >= 0) return;
+    topo_count = 0;
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        perror("affinity: sched_getaffinity failed");
+        return;
+    }
+    static struct TopoKey keys[CPU_SETSIZE];
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        keys[topo_count].cpu = cpu;
+        keys[topo_count].node = numa_node(cpu);
+        keys[topo_count].l3 = cache_domain(cpu, 3);
+        keys[topo_count].l2 = cache_domain(cpu, 2);
+        topo_count++;
+    }
+    qsort(keys, topo_count, sizeof(keys[0]), compare_topo);
+    for (int i = 0; i < topo_count; i++) {
+        topo_cpus[i] = keys[i].cpu;
+        topo_l3[i] = keys[i].l3;
+    }
+}
+
+// Every CPU in the same L3 domain as topo_cpus[pos]
+static void l3_domain_set(int pos, cpu_set_t *set) {
+    CPU_ZERO(set);
+    for (int i = 0; i < topo_count; i++) {
+        if (topo_l3[i] == topo_l3[pos]) CPU_SET(topo_cpus[i], set);
+    }
+}
+
+// auto: consecutive CPUs in topology order, starting a new L3 domain rather than
+// splitting the pipeline across two when it fits in one.
+// A lone command or a |[N] stage gets its CPU's whole L3 domain, since it may run
+// several threads or copies.
+static int plan_auto(struct Pipeline *pipeline, struct AffinityPlan *plan) {
+    read_topology();
+    if (topo_count == 0) return -1;
+
+    int stages = pipeline->pipe_count + 1;
+    int start = next_auto_cpu % topo_count;
+    int domain_end = start;
+    while (domain_end < topo_count && topo_l3[domain_end] == topo_l3[start]) domain_end++;
+    int domain_start = start;
+    while (domain_start > 0 && topo_l3[domain_start - 1] == topo_l3[start]) domain_start--;
+    if (start + stages > domain_end && stages <= domain_end - domain_start)
+        start = domain_end % topo_count;  // Move to the next domain instead of straddling
+    next_auto_cpu = start + stages;
+
+    for (int i = 0; i < stages; i++) {
+        int pos = (start + i) % topo_count;
+        if (stages == 1 || pipeline->commands[i].parallel > 1) {
+            l3_domain_set(pos, &plan->sets[i]);
+        } else {
+            CPU_ZERO(&plan->sets[i]);
+            CPU_SET(topo_cpus[pos], &plan->sets[i]);
+        }
+    }
+    return 0;
+}
+
+// Work out where each stage of a pipeline runs, before any of them forks
+// Returns the plan (allocated in line_arena), or NULL to leave placement to the kernel
+struct AffinityPlan *plan_affinity(struct Pipeline *pipeline) {
+    const char *setting = pipeline->affinity;
+    char *fields[3];
+    if (setting != NULL) {
+        if (expand_word(setting, fields, 3) != 1) {
+            fprintf(stderr, "affinity: %s: expected one setting\n", setting);
+            return NULL;
+        }
+        setting = fields[0];
+    } else {
+        setting = get_variable(&var_store, "CPU_AFFINITY");
+        if (setting == NULL || setting[0] == '\0') return NULL;
+    }
+    if (strcmp(setting, "off") == 0) return NULL;
+
+    struct AffinityPlan *plan = arena_alloc(&line_arena, sizeof(struct AffinityPlan));
+    if (plan == NULL) return NULL;
+    plan->stage_count = pipeline->pipe_count + 1;
+
+    if (strcmp(setting, "auto") == 0) return plan_auto(pipeline, plan) == 0 ? plan : NULL;
+
+    // One list per stage, separated by ':'
+    char *lists = arena_strdup(&line_arena, setting);
+    if (lists == NULL) return NULL;
+    cpu_set_t parsed[MAX_COMMANDS];
+    int list_count = 0;
+    for (char *list = strtok(lists, ":"); list != NULL; list = strtok(NULL, ":")) {
+        if (list_count == MAX_COMMANDS || parse_cpu_list(list, &parsed[list_count]) < 0) {
+            fprintf(stderr, "affinity: %s: expected auto or CPU lists such as 0-3 or 0:1:2\n", setting);
+            return NULL;
+        }
+        list_count++;
+    }
+    if (list_count == 0) {
+        fprintf(stderr, "affinity: %s: expected auto or CPU lists such as 0-3 or 0:1:2\n", setting);
+        return NULL;
+    }
+    for (int i = 0; i < plan->stage_count; i++) plan->sets[i] = parsed[i % list_count];
+    return plan;
+}
+
+// Pin the calling process (a freshly forked stage) to its CPUs
+void apply_affinity(const struct AffinityPlan *plan, int stage) {
+    if (plan == NULL || stage >= plan->stage_count) return;
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &plan->sets[stage]) < 0)
+        perror("affinity: sched_setaffinity failed");
+}
@@ -1,13 +1,47 @@
 
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <unistd.h>  // for chdir, getcwd
 #include "../include/shell.h"
 
 // Define the command arrays
 const char *built_in_commands[] = {"cd", "pwd", "help", "export", "set", "unset", "env", NULL};
 
+// Built-ins that only print and never change shell state.
+// $(...) made only of these runs inside the shell instead of a forked subshell.
+static const char *substitution_safe_builtins[] = {"pwd", "help", "env", "echo", "printf",
+                                                   "test", "[", "true", "false", NULL};
+
+// Built-ins that start and wait for children of their own. They always get a process,
+// so even in the foreground they form a job that Ctrl-C and Ctrl-Z can reach.
+static const char *process_builtins[] = {"merge", "parallel", NULL};
+
+// Returns 1 if name is a built-in that must not run inside the shell process
+int builtin_needs_process(const char *name) {
+    for (int i = 0; process_builtins[i] != NULL; i++) {
+        if (strcmp(name, process_builtins[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+// Returns 1 if name is a built-in that may run in-process for command substitution
+int is_substitution_safe_builtin(const char *name) {
+    for (int i = 0; substitution_safe_builtins[i] != NULL; i++) {
+        if (strcmp(name, substitution_safe_builtins[i]) == 0) return 1;
+    }
+    return 0;
+}
+
 // Checks and processes built-in commands 
 // Returns: 0 = success (command found and executed)
 //         -1 = error (command found but failed)  
@@ -146,6 +180,18 @@ int process_built_in_command(struct Command *cmd) {
                     printf("   cd <directory> - Change directory\n");
                     printf("   pwd - Print working directory\n");
                     printf("   exit - Exit the shell\n");
+                    printf("   echo, printf, test/[, true, false, sleep, kill, read - Run without starting a process\n");
+                    printf("   coproc NAME command - Run command in the background; write to $NAME_WRITE, read from $NAME_READ\n");
+                    printf("   timeout DURATION command - Stop command with SIGTERM (then SIGKILL) after DURATION; status 124\n");
+                    printf("   merge [-t] 'cmd' 'cmd'... - Run commands concurrently, interleaving whole lines\n");
+                    printf("   parallel [-j N] cmd [args] ::: arg... - Run cmd per argument (or stdin line), N at a time\n");
+                    printf("   time pipeline - Report real, user and sys time and each process's resource usage\n");
+                    printf("   jobs [-l], fg N, bg N - List jobs (-l: per-process usage) and move them between foreground and background\n");
+                    printf("   joblog [-f] [%%N] - Show (or follow) a background job's output captured with JOB_CAPTURE\n");
+                    printf("   wait [-n] [%%N | PID]... - Wait for background jobs; -n returns when the first finishes\n");
+                    printf("   trace on [RECORDS] | off | clear | dump FILE - Record where command time goes; dump as Chrome trace JSON\n");
+                    printf("   shellstat [-m | -r] - Show fork/exec/job counters and latency histograms (-m: Prometheus format)\n");
+                    printf("   exec [command] - Replace the shell with command, or redirect the shell (exec >file)\n");
                     printf("   [other] Runs system command like ls, mkdir, echo, etc.\n");
                     return 0;
                 }
@@ -154,3 +200,656 @@ int process_built_in_command(struct Command *cmd) {
     }
     return 1;  // Not a built-in command
 }
+
+// ---------------------------------------------------------------------------
+// Utility built-ins: commands scripts run constantly, done without fork+exec.
+// Each returns its exit status and writes through stdout, so it works the same
+// in the shell (redirected in place) or in a forked pipeline stage.
+// ---------------------------------------------------------------------------
+
+// Print s, interpreting backslash escapes as echo -e and printf %b do.
+// In a printf format, octal escapes are \nnn; elsewhere they are \0nnn.
+// Returns 1 if a \c asked for output to stop, 0 otherwise.
+static int print_escaped(const char *s, int format_octal) {
+    for (; *s; s++) {
+        if (*s != '\\' || s[1] == '\0') {
+            putchar(*s);
+            continue;
+        }
+        s++;
+        switch (*s) {
+            case 'a': putchar('\a'); break;
+            case 'b': putchar('\b'); break;
+            case 'c': return 1;
+            case 'e': putchar('\033'); break;
+            case 'f': putchar('\f'); break;
+            case 'n': putchar('\n'); break;
+            case 'r': putchar('\r'); break;
+            case 't': putchar('\t'); break;
+            case 'v': putchar('\v'); break;
+            case '\\': putchar('\\'); break;
+            case 'x': {
+                int value = 0, digits = 0;
+                while (digits < 2 && isxdigit((unsigned char)s[1])) {
+                    s++;
+                    value = value * 16 + (isdigit((unsigned char)*s) ? *s - '0' : tolower((unsigned char)*s) - 'a' + 10);
+                    digits++;
+                }
+                if (digits == 0) { putchar('\\'); putchar('x'); }
+                else putchar(value);
+                break;
+            }
+            case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': {
+                const char *digits = s;
+                if (!format_octal) {
+                    if (*s != '0') { putchar('\\'); putchar(*s); break; }
+                    digits = s + 1;  // \0nnn: the 0 only introduces the escape
+                }
+                int value = 0, n = 0;
+                while (n < 3 && digits[n] >= '0' && digits[n] <= '7') {
+                    value = value * 8 + (digits[n] - '0');
+                    n++;
+                }
+                if (n > 0) s = digits + n - 1;  // The loop's s++ steps past the last digit
+                putchar(value);
+                break;
+            }
+            default: putchar('\\'); putchar(*s); break;
+        }
+    }
+    return 0;
+}
+
+// echo [-neE] [arg ...]
+static int builtin_echo(char **argv) {
+    int newline = 1, escapes = 0;
+    int i = 1;
+
+    // Options only count while every character is one of n, e, E ("-nx" is printed)
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strspn(argv[i] + 1, "neE") != strlen(argv[i] + 1)) break;
+        for (const char *o = argv[i] + 1; *o; o++) {
+            if (*o == 'n') newline = 0;
+            else if (*o == 'e') escapes = 1;
+            else escapes = 0;
+        }
+    }
+
+    for (int first = i; argv[i] != NULL; i++) {
+        if (i > first) putchar(' ');
+        if (escapes) {
+            if (print_escaped(argv[i], 0)) return 0;  // \c: no more output, not even the newline
+        } else {
+            fputs(argv[i], stdout);
+        }
+    }
+    if (newline) putchar('\n');
+    return 0;
+}
+
+// Numeric printf argument: 'c or "c gives the character's code; 0x and 0 prefixes are honored
+static long long printf_number(const char *arg, int *status) {
+    if (arg[0] == '\'' || arg[0] == '"') return (unsigned char)arg[1];
+    if (arg[0] == '\0') return 0;
+
+    char *end;
+    errno = 0;
+    long long value = strtoll(arg, &end, 0);
+    if (*end != '\0' || errno != 0) {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *status = 1;
+    }
+    return value;
+}
+
+// Print the format once, taking arguments from *args as conversions need them
+// Returns 1 if output must stop (\c or an invalid directive), 0 otherwise
+static int printf_once(const char *format, char ***args, int *status) {
+    const char *p = format;
+    while (*p) {
+        if (*p != '%') {
+            size_t len = strcspn(p, "%");
+            char *literal = strndup(p, len);
+            if (literal == NULL) return 1;
+            int stop = print_escaped(literal, 1);
+            free(literal);
+            if (stop) return 1;
+            p += len;
+            continue;
+        }
+        if (p[1] == '%') {
+            putchar('%');
+            p += 2;
+            continue;
+        }
+
+        // Rebuild the directive as a C format: %[flags][width][.precision]
+        char spec[64];
+        size_t n = 0;
+        spec[n++] = *p++;
+        while (*p && strchr("-+ #0", *p) && n < 16) spec[n++] = *p++;
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*p != '.') break;
+                spec[n++] = *p++;
+            }
+            if (*p == '*') {
+                const char *arg = **args ? *(*args)++ : "0";
+                n += snprintf(spec + n, sizeof(spec) - n - 8, "%d", (int)printf_number(arg, status));
+                p++;
+            } else {
+                while (isdigit((unsigned char)*p) && n < 40) spec[n++] = *p++;
+            }
+        }
+
+        char conv = *p ? *p++ : '\0';
+        const char *arg = **args ? *(*args)++ : NULL;
+        switch (conv) {
+            case 's':
+                spec[n++] = 's'; spec[n] = '\0';
+                printf(spec, arg ? arg : "");
+                break;
+            case 'b':
+                if (arg && print_escaped(arg, 0)) return 1;
+                break;
+            case 'c':
+                if (arg && arg[0]) putchar(arg[0]);
+                break;
+            case 'd': case 'i':
+                spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = conv; spec[n] = '\0';
+                printf(spec, arg ? printf_number(arg, status) : 0LL);
+                break;
+            case 'o': case 'u': case 'x': case 'X':
+                spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = conv; spec[n] = '\0';
+                printf(spec, (unsigned long long)(arg ? printf_number(arg, status) : 0));
+                break;
+            case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+                spec[n++] = conv; spec[n] = '\0';
+                printf(spec, arg ? strtod(arg, NULL) : 0.0);
+                break;
+            default:
+                fprintf(stderr, "printf: %%%c: invalid directive\n", conv ? conv : ' ');
+                *status = 1;
+                return 1;
+        }
+    }
+    return 0;
+}
+
+// printf format [arguments]: the format is reused until the arguments run out
+static int builtin_printf(char **argv) {
+    if (argv[1] == NULL) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    char **args = argv + 2;
+    int status = 0;
+    do {
+        char **before = args;
+        if (printf_once(argv[1], &args, &status)) break;
+        if (args == before) break;  // Format takes no arguments; print it once
+    } while (*args != NULL);
+    return status;
+}
+
+// State for evaluating a test / [ expression by recursive descent
+struct TestExpr {
+    char **argv;
+    int argc;
+    int pos;
+    int error;
+};
+
+// Parse a test integer operand; sets error on anything but an optional sign and digits
+static long long test_integer(struct TestExpr *t, const char *s) {
+    char *end;
+    errno = 0;
+    long long value = strtoll(s, &end, 10);
+    while (isspace((unsigned char)*end)) end++;
+    if (*s == '\0' || *end != '\0' || errno != 0) {
+        fprintf(stderr, "test: %s: integer expression expected\n", s);
+        t->error = 1;
+    }
+    return value;
+}
+
+static int is_test_binary_op(const char *op) {
+    static const char *ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le",
+                                "-gt", "-ge", "-nt", "-ot", "-ef", NULL};
+    for (int i = 0; ops[i] != NULL; i++) {
+        if (strcmp(op, ops[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static int test_binary(struct TestExpr *t, const char *a, const char *op, const char *b) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(a, b) != 0;
+    if (strcmp(op, "<") == 0) return strcmp(a, b) < 0;
+    if (strcmp(op, ">") == 0) return strcmp(a, b) > 0;
+
+    if (op[1] == 'n' || op[1] == 'o' || (op[1] == 'e' && op[2] == 'f')) {
+        // -nt, -ot, -ef compare files
+        struct stat sa, sb;
+        int ha = stat(a, &sa) == 0, hb = stat(b, &sb) == 0;
+        if (strcmp(op, "-ef") == 0) return ha && hb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        if (strcmp(op, "-nt") == 0) return ha && (!hb || sa.st_mtim.tv_sec > sb.st_mtim.tv_sec ||
+            (sa.st_mtim.tv_sec == sb.st_mtim.tv_sec && sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec));
+        return hb && (!ha || sb.st_mtim.tv_sec > sa.st_mtim.tv_sec ||
+            (sb.st_mtim.tv_sec == sa.st_mtim.tv_sec && sb.st_mtim.tv_nsec > sa.st_mtim.tv_nsec));
+    }
+
+    long long x = test_integer(t, a), y = test_integer(t, b);
+    if (strcmp(op, "-eq") == 0) return x == y;
+    if (strcmp(op, "-ne") == 0) return x != y;
+    if (strcmp(op, "-lt") == 0) return x < y;
+    if (strcmp(op, "-le") == 0) return x <= y;
+    if (strcmp(op, "-gt") == 0) return x > y;
+    return x >= y;  // -ge
+}
+
+// Returns -1 if op is not a unary test operator, otherwise its truth value for arg
+static int test_unary(const char *op, const char *arg) {
+    if (op[0] != '-' || op[1] == '\0' || op[2] != '\0') return -1;
+
+    struct stat st;
+    switch (op[1]) {
+        case 'z': return arg[0] == '\0';
+        case 'n': return arg[0] != '\0';
+        case 't': return isatty(atoi(arg));
+        case 'e': return stat(arg, &st) == 0;
+        case 'f': return stat(arg, &st) == 0 && S_ISREG(st.st_mode);
+        case 'd': return stat(arg, &st) == 0 && S_ISDIR(st.st_mode);
+        case 'b': return stat(arg, &st) == 0 && S_ISBLK(st.st_mode);
+        case 'c': return stat(arg, &st) == 0 && S_ISCHR(st.st_mode);
+        case 'p': return stat(arg, &st) == 0 && S_ISFIFO(st.st_mode);
+        case 'S': return stat(arg, &st) == 0 && S_ISSOCK(st.st_mode);
+        case 's': return stat(arg, &st) == 0 && st.st_size > 0;
+        case 'L': case 'h': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+        case 'r': return access(arg, R_OK) == 0;
+        case 'w': return access(arg, W_OK) == 0;
+        case 'x': return access(arg, X_OK) == 0;
+        default: return -1;
+    }
+}
+
+static int test_or(struct TestExpr *t);
+
+// primary: ( expr ) | unary-op arg | arg binary-op arg | arg
+static int test_primary(struct TestExpr *t) {
+    if (t->pos >= t->argc) {
+        fprintf(stderr, "test: argument expected\n");
+        t->error = 1;
+        return 0;
+    }
+    char **a = t->argv + t->pos;
+    int left = t->argc - t->pos;
+
+    if (left >= 3 && is_test_binary_op(a[1])) {
+        t->pos += 3;
+        return test_binary(t, a[0], a[1], a[2]);
+    }
+    if (strcmp(a[0], "(") == 0 && left >= 2) {
+        t->pos++;
+        int value = test_or(t);
+        if (t->pos >= t->argc || strcmp(t->argv[t->pos], ")") != 0) {
+            fprintf(stderr, "test: missing ')'\n");
+            t->error = 1;
+            return 0;
+        }
+        t->pos++;
+        return value;
+    }
+    if (left >= 2) {
+        int value = test_unary(a[0], a[1]);
+        if (value >= 0) {
+            t->pos += 2;
+            return value;
+        }
+    }
+    t->pos++;
+    return a[0][0] != '\0';
+}
+
+static int test_not(struct TestExpr *t) {
+    if (t->pos < t->argc - 1 && strcmp(t->argv[t->pos], "!") == 0) {
+        t->pos++;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+static int test_and(struct TestExpr *t) {
+    int value = test_not(t);
+    while (t->pos < t->argc && strcmp(t->argv[t->pos], "-a") == 0) {
+        t->pos++;
+        value = test_not(t) && value;
+    }
+    return value;
+}
+
+static int test_or(struct TestExpr *t) {
+    int value = test_and(t);
+    while (t->pos < t->argc && strcmp(t->argv[t->pos], "-o") == 0) {
+        t->pos++;
+        value = test_and(t) || value;
+    }
+    return value;
+}
+
+// test expr / [ expr ]: 0 if true, 1 if false, 2 on a malformed expression
+static int builtin_test(char **argv) {
+    int argc = 0;
+    while (argv[argc] != NULL) argc++;
+
+    if (strcmp(argv[0], "[") == 0) {
+        if (strcmp(argv[argc - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+
+    struct TestExpr t = { .argv = argv + 1, .argc = argc - 1, .pos = 0, .error = 0 };
+    if (t.argc == 0) return 1;  // No expression is false
+
+    int value = test_or(&t);
+    if (!t.error && t.pos < t.argc) {
+        fprintf(stderr, "test: %s: unexpected argument\n", t.argv[t.pos]);
+        t.error = 1;
+    }
+    if (t.error) return 2;
+    return value ? 0 : 1;
+}
+
+static int builtin_true(char **argv) {
+    (void)argv;
+    return 0;
+}
+
+static int builtin_false(char **argv) {
+    (void)argv;
+    return 1;
+}
+
+static volatile sig_atomic_t sleep_interrupted;
+
+static void sleep_sigint_handler(int sig) {
+    (void)sig;
+    sleep_interrupted = 1;
+}
+
+// sleep DURATION...: arm a timerfd and wait for it with ppoll(), so SIGCHLD keeps
+// updating the job table while we wait and Ctrl-C ends the sleep (status 130)
+static int builtin_sleep(char **argv) {
+    if (argv[1] == NULL) {
+        fprintf(stderr, "sleep: missing operand\n");
+        return 1;
+    }
+    double seconds = 0;
+    for (int i = 1; argv[i] != NULL; i++) {
+        double part;
+        if (parse_duration(argv[i], &part) < 0) {
+            fprintf(stderr, "sleep: invalid time interval '%s'\n", argv[i]);
+            return 1;
+        }
+        seconds += part;
+    }
+    if (seconds <= 0) return 0;
+
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (tfd < 0) {
+        perror("sleep: timerfd_create failed");
+        return 1;
+    }
+    struct itimerspec its = { 0 };
+    its.it_value.tv_sec = (time_t)seconds;
+    its.it_value.tv_nsec = (long)((seconds - (double)its.it_value.tv_sec) * 1e9);
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) its.it_value.tv_nsec = 1;
+    if (timerfd_settime(tfd, 0, &its, NULL) < 0) {
+        perror("sleep: timerfd_settime failed");
+        close(tfd);
+        return 1;
+    }
+
+    // SIGINT is blocked outside ppoll() so an early Ctrl-C cannot slip past the check
+    struct sigaction sa, old_sigint;
+    sa.sa_handler = sleep_sigint_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigset_t block, old_mask, wait_mask;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigprocmask(SIG_BLOCK, &block, &old_mask);
+    sigaction(SIGINT, &sa, &old_sigint);
+    sleep_interrupted = 0;
+
+    wait_mask = old_mask;
+    sigdelset(&wait_mask, SIGINT);
+    sigdelset(&wait_mask, SIGCHLD);
+
+    struct pollfd pfd = { .fd = tfd, .events = POLLIN };
+    int status = 0;
+    while (1) {
+        int ready = ppoll(&pfd, 1, NULL, &wait_mask);
+        if (ready > 0) break;
+        if (ready < 0 && errno != EINTR) {
+            perror("sleep: ppoll failed");
+            status = 1;
+            break;
+        }
+        if (sleep_interrupted) {
+            status = 130;
+            break;
+        }
+    }
+
+    sigaction(SIGINT, &old_sigint, NULL);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    close(tfd);
+    return status;
+}
+
+// read [-r] [-u FD] [NAME...]
+// Reads one line a byte at a time, so whatever follows it stays in the pipe for the next read
+// (a coproc's replies, for example). Words go to the NAMEs in order, the last NAME takes the
+// rest of the line; with no NAME the line goes to REPLY. Without -r a backslash quotes the
+// next character and a backslash-newline continues the line.
+// Returns 1 at end of input with nothing read
+static int builtin_read(char **argv) {
+    int raw = 0;
+    int fd = STDIN_FILENO;
+    int i = 1;
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            raw = 1;
+        } else if (strcmp(argv[i], "-u") == 0) {
+            char *end;
+            long n = argv[i + 1] != NULL ? strtol(argv[i + 1], &end, 10) : -1;
+            if (n < 0 || *end != '\0' || fcntl((int)n, F_GETFD) < 0) {
+                fprintf(stderr, "read: %s: invalid file descriptor\n", argv[i + 1] ? argv[i + 1] : "");
+                return 2;
+            }
+            fd = (int)n;
+            i++;
+        } else {
+            fprintf(stderr, "read: usage: read [-r] [-u fd] [name ...]\n");
+            return 2;
+        }
+    }
+
+    struct Buffer line;
+    buf_init(&line);
+    int got_any = 0;
+    int escaped = 0;
+    char c;
+    while (1) {
+        ssize_t n = read(fd, &c, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got_any = 1;
+        if (escaped) {
+            escaped = 0;
+            if (c != '\n') buf_putc(&line, c);
+            continue;
+        }
+        if (c == '\n') break;
+        if (c == '\\' && !raw) {
+            escaped = 1;
+            continue;
+        }
+        buf_putc(&line, c);
+    }
+    if (!got_any) {
+        buf_free(&line);
+        return 1;
+    }
+
+    char *text = line.data != NULL ? line.data : "";
+    if (argv[i] == NULL) {
+        set_variable(&var_store, "REPLY", text, 0);  // The whole line, blanks and all
+    }
+    for (; argv[i] != NULL; i++) {
+        while (*text == ' ' || *text == '\t') text++;
+        size_t len = strcspn(text, " \t");
+        if (argv[i + 1] == NULL) {
+            // The last name gets the rest of the line, less trailing blanks
+            len = strlen(text);
+            while (len > 0 && (text[len - 1] == ' ' || text[len - 1] == '\t')) len--;
+        }
+        char saved = text[len];
+        text[len] = '\0';
+        set_variable(&var_store, argv[i], text, 0);
+        text[len] = saved;
+        text += len;
+    }
+    buf_free(&line);
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    int number;
+} signal_names[] = {
+    {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"ILL", SIGILL}, {"ABRT", SIGABRT},
+    {"KILL", SIGKILL}, {"USR1", SIGUSR1}, {"SEGV", SIGSEGV}, {"USR2", SIGUSR2}, {"PIPE", SIGPIPE},
+    {"ALRM", SIGALRM}, {"TERM", SIGTERM}, {"CHLD", SIGCHLD}, {"CONT", SIGCONT}, {"STOP", SIGSTOP},
+    {"TSTP", SIGTSTP}, {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU}, {"WINCH", SIGWINCH}, {NULL, 0}
+};
+
+// Accepts "9", "KILL" or "SIGKILL"; returns -1 for an unknown signal
+static int parse_signal(const char *s) {
+    if (isdigit((unsigned char)s[0])) {
+        char *end;
+        long number = strtol(s, &end, 10);
+        return (*end == '\0' && number >= 0 && number < NSIG) ? (int)number : -1;
+    }
+    if (strncmp(s, "SIG", 3) == 0) s += 3;
+    for (int i = 0; signal_names[i].name != NULL; i++) {
+        if (strcmp(s, signal_names[i].name) == 0) return signal_names[i].number;
+    }
+    return -1;
+}
+
+// kill [-s SIG | -SIG] pid|%job ...   or   kill -l
+static int builtin_kill(char **argv) {
+    int sig = SIGTERM;
+    int i = 1;
+
+    if (argv[1] != NULL && strcmp(argv[1], "-l") == 0) {
+        for (int k = 0; signal_names[k].name != NULL; k++)
+            printf("%2d) SIG%s\n", signal_names[k].number, signal_names[k].name);
+        return 0;
+    }
+    if (argv[1] != NULL && strcmp(argv[1], "-s") == 0) {
+        if (argv[2] == NULL) {
+            fprintf(stderr, "kill: -s: option requires an argument\n");
+            return 2;
+        }
+        sig = parse_signal(argv[2]);
+        i = 3;
+        if (sig < 0) {
+            fprintf(stderr, "kill: %s: invalid signal specification\n", argv[2]);
+            return 1;
+        }
+    } else if (argv[1] != NULL && argv[1][0] == '-' && argv[1][1] != '\0') {
+        sig = parse_signal(argv[1] + 1);
+        i = 2;
+        if (sig < 0) {
+            fprintf(stderr, "kill: %s: invalid signal specification\n", argv[1] + 1);
+            return 1;
+        }
+    }
+    if (argv[i] == NULL) {
+        fprintf(stderr, "kill: usage: kill [-s sigspec | -sigspec] pid | %%job ...\n");
+        return 2;
+    }
+
+    int status = 0;
+    for (; argv[i] != NULL; i++) {
+        if (argv[i][0] == '%') {
+            struct Job *job = find_job_by_spec(&job_table, argv[i]);
+            if (job == NULL) {
+                fprintf(stderr, "kill: %s: no such job\n", argv[i]);
+                status = 1;
+            } else if (signal_job(job, sig) < 0) {
+                fprintf(stderr, "kill: %s: %s\n", argv[i], strerror(errno));
+                status = 1;
+            }
+            continue;
+        }
+
+        char *end;
+        long pid = strtol(argv[i], &end, 10);
+        if (end == argv[i] || *end != '\0') {
+            fprintf(stderr, "kill: %s: arguments must be process or job IDs\n", argv[i]);
+            status = 1;
+        } else if (kill((pid_t)pid, sig) < 0) {
+            fprintf(stderr, "kill: (%ld) - %s\n", pid, strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static const struct {
+    const char *name;
+    int (*run)(char **argv);
+} utility_builtins[] = {
+    {"echo", builtin_echo},
+    {"printf", builtin_printf},
+    {"test", builtin_test},
+    {"[", builtin_test},
+    {"true", builtin_true},
+    {"false", builtin_false},
+    {"sleep", builtin_sleep},
+    {"kill", builtin_kill},
+    {"read", builtin_read},
+    {"merge", builtin_merge},
+    {"parallel", builtin_parallel},
+    {"joblog", builtin_joblog},
+    {"trace", builtin_trace},
+    {"shellstat", builtin_shellstat},
+    {NULL, NULL}
+};
+
+// Returns 1 if name runs inside the shell rather than as a program
+int is_builtin_command(const char *name) {
+    if (name == NULL) return 0;
+    for (int i = 0; built_in_commands[i] != NULL; i++) {
+        if (strcmp(name, built_in_commands[i]) == 0) return 1;
+    }
+    for (int i = 0; utility_builtins[i].name != NULL; i++) {
+        if (strcmp(name, utility_builtins[i].name) == 0) return 1;
+    }
+    return 0;
+}
+
+// Run a built-in with stdin/stdout already set up by the caller
+// Returns its exit status
+int run_builtin(struct Command *cmd) {
+    for (int i = 0; utility_builtins[i].name != NULL; i++) {
+        if (strcmp(cmd->argv[0], utility_builtins[i].name) == 0) return utility_builtins[i].run(cmd->argv);
+    }
+    return process_built_in_command(cmd) == 0 ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../include/shell.h"
+
+// Job deadlines. "timeout DURATION" in front of a pipeline, or JOB_TIMEOUT=DURATION for
+// every job, arms a timerfd when the job starts. When it fires the shell sends SIGTERM to
+// the job (its process group when it has one) and re-arms the timer for TIMEOUT_GRACE
+// (default 5s); if the job is still there then, it gets SIGKILL. The job finishes as
+// "Timed out" with status 124, like timeout(1), but without an extra process in between.
+//
+// The timers are serviced wherever the shell waits: for a foreground job, in fg, in wait,
+// at an interactive prompt, and whenever finished jobs are cleaned up. "timeout -s ..."
+// with options is left to timeout(1). Under a "timeout" prefix a built-in or { list; } runs
+// in a child, where it can be killed, so one that changes the shell (cd, set) has no effect;
+// JOB_TIMEOUT applies only to commands that get a process anyway.
+
+#define DEFAULT_GRACE_SECONDS 5.0
+
+static int chld_fd = -1;      // signalfd for SIGCHLD, for sleeping in poll() instead of wait4()
+
+static void set_timer(int fd, double seconds) {
+    struct itimerspec when;
+    memset(&when, 0, sizeof(when));
+    when.it_value.tv_sec = (time_t)seconds;
+    when.it_value.tv_nsec = (long)((seconds - (double)when.it_value.tv_sec) * 1e9);
+    if (when.it_value.tv_sec == 0 && when.it_value.tv_nsec == 0) when.it_value.tv_nsec = 1;  // 0 would disarm
+    timerfd_settime(fd, 0, &when, NULL);
+}
+
+// A DURATION variable in seconds: fallback when it is unset, empty or invalid, 0 for "off"
+static double duration_variable(const char *name, double fallback) {
+    const char *setting = get_variable(&var_store, name);
+    if (setting == NULL || setting[0] == '\0') return fallback;
+    if (strcmp(setting, "off") == 0) return 0;
+    double seconds;
+    if (parse_duration(setting, &seconds) < 0) {
+        fprintf(stderr, "%s: %s: expected a duration such as 30, 1.5s, 10m or off\n", name, setting);
+        return fallback;
+    }
+    return seconds;
+}
+
+// The time limit for a pipeline: its "timeout DURATION" prefix, else JOB_TIMEOUT
+// Returns the limit in seconds, 0 for none, or -1 if the prefix is not a valid duration
+double pipeline_time_limit(struct Pipeline *pipeline) {
+    if (pipeline->timeout == NULL) return duration_variable("JOB_TIMEOUT", 0);
+
+    char *fields[3];
+    double seconds;
+    if (expand_word(pipeline->timeout, fields, 3) != 1 || parse_duration(fields[0], &seconds) < 0) {
+        fprintf(stderr, "timeout: %s: expected a duration such as 30, 1.5s or 10m\n", pipeline->timeout);
+        return -1;
+    }
+    return seconds;
+}
+
+// Start a job's deadline clock; a failure only costs the deadline
+void arm_job_deadline(struct Job *job, double seconds) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        perror("timeout: timerfd_create failed");
+        return;
+    }
+    set_timer(fd, seconds);
+    job->deadline_fd = fd;
+    job->timeout_stage = 0;
+    job->time_limit = seconds;
+}
+
+// The timer went off: SIGTERM first, SIGKILL once the grace period is over too
+static void deadline_expired(struct Job *job) {
+    if (job->timeout_stage == 0) {
+        job->timed_out = 1;
+        job->timeout_stage = 1;
+        signal_job(job, SIGTERM);
+        // A stopped job could not act on SIGTERM; wake it so it can
+        governor_release(job);
+        signal_job(job, SIGCONT);
+        double grace = duration_variable("TIMEOUT_GRACE", DEFAULT_GRACE_SECONDS);
+        if (grace > 0) {
+            set_timer(job->deadline_fd, grace);
+            return;
+        }
+    }
+    job->timeout_stage = 2;
+    signal_job(job, SIGKILL);
+    close(job->deadline_fd);
+    job->deadline_fd = -1;
+}
+
+// Act on every deadline that has passed; never blocks
+void service_deadlines(void) {
+    for (int i = 0; i < job_table.job_count; i++) {
+        struct Job *job = &job_table.jobs[i];
+        uint64_t expirations;
+        if (job->deadline_fd < 0 || job->state == JOB_DONE) continue;
+        if (read(job->deadline_fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+            deadline_expired(job);
+    }
+}
+
+// Add a pollfd for each armed deadline, up to max
+// Returns how many were added
+int add_deadline_fds(struct pollfd *fds, int max) {
+    int n = 0;
+    for (int i = 0; i < job_table.job_count && n < max; i++) {
+        struct Job *job = &job_table.jobs[i];
+        if (job->deadline_fd >= 0 && job->state != JOB_DONE)
+            fds[n++] = (struct pollfd){ .fd = job->deadline_fd, .events = POLLIN };
+    }
+    return n;
+}
+
+// wait4() that keeps deadlines running: while any is armed it sleeps in poll() on a
+// signalfd for SIGCHLD and the deadline timers rather than in wait4() itself.
+// SIGCHLD must be blocked by the caller.
+pid_t waitpid_with_deadlines(pid_t pid, int *wstatus, int options, struct rusage *usage) {
+    struct pollfd fds[MAX_JOBS + 1];
+    while (1) {
+        int nfds = add_deadline_fds(fds + 1, MAX_JOBS);
+        if (nfds == 0) return wait4(pid, wstatus, options, usage);
+
+        if (chld_fd < 0) {
+            sigset_t chld;
+            sigemptyset(&chld);
+            sigaddset(&chld, SIGCHLD);
+            chld_fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+            if (chld_fd < 0) {
+                perror("timeout: signalfd failed");
+                return wait4(pid, wstatus, options, usage);
+            }
+        }
+        pid_t result = wait4(pid, wstatus, options | WNOHANG, usage);
+        if (result != 0) return result;
+
+        fds[0] = (struct pollfd){ .fd = chld_fd, .events = POLLIN };
+        if (poll(fds, nfds + 1, -1) < 0 && errno != EINTR) return wait4(pid, wstatus, options, usage);
+        struct signalfd_siginfo info;
+        while (read(chld_fd, &info, sizeof(info)) > 0) continue;
+        service_deadlines();
+    }
+}
+
+// A finished job gives its timer back and says if its deadline ended it, once
+void deadline_release(struct Job *job) {
+    if (job->deadline_fd >= 0) {
+        close(job->deadline_fd);
+        job->deadline_fd = -1;
+    }
+    if (job->timed_out && job->time_limit > 0) {
+        printf("[%d]+  Timed out after %gs    %s\n", job->job_id, job->time_limit, job->command_line);
+        fflush(stdout);
+        job->time_limit = 0;
+    }
+}
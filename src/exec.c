@@ -0,0 +1,1375 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <errno.h>
+#include "../include/shell.h"
+
+struct Arena line_arena;
+int last_exit_status = 0;
+pid_t last_background_pid = 0;
+int shell_should_exit = 0;
+int tail_exec_enabled = 0;
+
+// Set in forked children that keep running shell code ( (...), $(...), <(...) ).
+// They stay in their parent's process group and never touch the terminal.
+static int in_subshell = 0;
+
+// Called in a freshly forked child that will run a list and then exit.
+// The parent's jobs are not its children, and its last command can exec in place.
+static void enter_subshell(void) {
+    in_subshell = 1;
+    job_table.job_count = 0;
+    job_table.starting_slot = -1;
+    tail_exec_enabled = 1;
+}
+
+// Convert a waitpid() status into a shell exit status (128+N for signal N)
+int wait_status_to_exit(int wstatus) {
+    if (WIFEXITED(wstatus)) return WEXITSTATUS(wstatus);
+    if (WIFSIGNALED(wstatus)) return 128 + WTERMSIG(wstatus);
+    if (WIFSTOPPED(wstatus)) return 128 + WSTOPSIG(wstatus);
+    return 0;
+}
+
+// Restore default signal handling in a freshly forked child
+static void reset_child_signals(void) {
+    struct sigaction sa_default;
+    sa_default.sa_handler = SIG_DFL;
+    sigemptyset(&sa_default.sa_mask);
+    sa_default.sa_flags = 0;
+    sigaction(SIGINT, &sa_default, NULL);
+    sigaction(SIGTSTP, &sa_default, NULL);
+}
+
+// Expand a redirection target in place; it must expand to exactly one word
+static int expand_redirect_target(char *target) {
+    char *fields[3];
+    if (expand_word(target, fields, 3) != 1) {
+        fprintf(stderr, "%s: ambiguous redirect\n", target);
+        return -1;
+    }
+    strncpy(target, fields[0], MAX_INPUT_SIZE - 1);
+    target[MAX_INPUT_SIZE - 1] = '\0';
+    return 0;
+}
+
+// Write all of body to fd; returns 0 on success, -1 on error
+static int write_all(int fd, const char *body, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, body, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        body += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Turn a command's here-document into a readable descriptor before forking.
+// Bodies that fit in the pipe buffer are written into a pipe up front, so the
+// write can never block. Larger bodies go into a sealed memfd, which has no
+// capacity limit and never touches the filesystem.
+// Returns 0 on success, -1 on error
+static int prepare_heredoc(struct Command *cmd) {
+    char *body = cmd->heredoc;
+    char *expanded = NULL;
+
+    if (cmd->heredoc_type == HEREDOC_STRING) {
+        // Here-strings are one word: join any fields back together and end with a newline
+        char *fields[MAX_TOKENS];
+        struct Buffer joined;
+        int n = expand_word(cmd->heredoc, fields, MAX_TOKENS);
+        if (n < 0) return -1;
+        buf_init(&joined);
+        for (int i = 0; i < n; i++) {
+            if (i > 0) buf_putc(&joined, ' ');
+            buf_append(&joined, fields[i], strlen(fields[i]));
+        }
+        buf_putc(&joined, '\n');
+        body = expanded = buf_detach(&joined);
+    } else if (cmd->heredoc_type == HEREDOC_EXPAND) {
+        body = expanded = expand_var(cmd->heredoc, &var_store);
+        if (body == NULL) return -1;
+    }
+    size_t len = strlen(body);
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("here-document pipe failed");
+        free(expanded);
+        return -1;
+    }
+    int capacity = fcntl(fds[1], F_GETPIPE_SZ);
+    if (capacity > 0 && len <= (size_t)capacity) {
+        write_all(fds[1], body, len);
+        close(fds[1]);
+        cmd->heredoc_fd = fds[0];
+        free(expanded);
+        return 0;
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    int memfd = memfd_create("mysh-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0 || write_all(memfd, body, len) < 0) {
+        perror("here-document memfd failed");
+        if (memfd >= 0) close(memfd);
+        free(expanded);
+        return -1;
+    }
+    fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    lseek(memfd, 0, SEEK_SET);
+    cmd->heredoc_fd = memfd;
+    free(expanded);
+    return 0;
+}
+
+// Close the shell's copy of a command's here-document descriptor
+static void close_heredoc(struct Command *cmd) {
+    if (cmd->heredoc_fd >= 0) close(cmd->heredoc_fd);
+    cmd->heredoc_fd = -1;
+}
+
+// Replace a command's raw words with their expansions
+// Runs just before the command executes so $? and $(...) see earlier results
+// Returns 0 on success, -1 on expansion error
+static int expand_command(struct Command *cmd) {
+    char *expanded[MAX_TOKENS];
+    int argc = 0;
+
+    for (int i = 0; cmd->argv[i] != NULL; i++) {
+        int n = expand_word(cmd->argv[i], expanded + argc, MAX_TOKENS - argc);
+        if (n < 0) return -1;
+        argc += n;
+    }
+    for (int i = 0; i <= argc; i++) cmd->argv[i] = (i < argc) ? expanded[i] : NULL;
+
+    if ((cmd->redirect_flags & REDIRECT_IN) && expand_redirect_target(cmd->redirects.input_file) < 0) return -1;
+    for (int k = 0; k < cmd->redirects.output_count; k++) {
+        char *fields[3];
+        char *target = cmd->redirects.outputs[k].file;
+        if (expand_word(target, fields, 3) != 1) {
+            fprintf(stderr, "%s: ambiguous redirect\n", target);
+            return -1;
+        }
+        cmd->redirects.outputs[k].file = fields[0];
+    }
+    if ((cmd->redirect_flags & REDIRECT_HEREDOC) && prepare_heredoc(cmd) < 0) return -1;
+    return 0;
+}
+
+// Apply a command's file redirections to the current process (child side)
+// Returns 0 on success, -1 if a file could not be opened
+static int apply_redirections(struct Command *cmd) {
+    if (cmd->redirect_flags & REDIRECT_IN) {
+        int fd = open(cmd->redirects.input_file, O_RDONLY);
+        if (fd == -1) { perror("Input redirection failed"); return -1; }
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+    }
+    if (cmd->redirect_flags & REDIRECT_HEREDOC) {
+        dup2(cmd->heredoc_fd, STDIN_FILENO);
+        close(cmd->heredoc_fd);
+        cmd->heredoc_fd = -1;
+    }
+    if (cmd->fanout_fd >= 0) {
+        // Several targets: a fan-out helper already holds them all
+        dup2(cmd->fanout_fd, STDOUT_FILENO);
+        close(cmd->fanout_fd);
+        cmd->fanout_fd = -1;
+    } else if (cmd->redirects.output_count > 0) {
+        struct OutputTarget *out = &cmd->redirects.outputs[0];
+        int fd = open(out->file, O_WRONLY | O_CREAT | (out->append ? O_APPEND : O_TRUNC), 0644);
+        if (fd == -1) { perror(out->append ? "Append redirection failed" : "Output redirection failed"); return -1; }
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+    }
+    return 0;
+}
+
+// Fan-out (zsh-style multios): "cmd > a >> b | c" sends cmd's output to a, b and c.
+// cmd writes into a pipe read by a helper process, which duplicates each batch of
+// the pipe buffer with tee(2) and moves it to every sink with splice(2), so the data
+// is never copied through user space. Sinks splice cannot write to (O_APPEND files,
+// some devices) fall back to read/write for those bytes only.
+
+// Returns 1 if a command's output must go through a fan-out helper
+static int needs_fanout(struct Command *cmd, int piped) {
+    return cmd->redirects.output_count > 1 || (cmd->redirects.output_count == 1 && piped);
+}
+
+// Move exactly len bytes from pipe in_fd to out_fd
+// Returns 0 on success, -1 if out_fd failed (the bytes are then discarded)
+static int fanout_move(int in_fd, int out_fd, size_t len) {
+    char buf[CAPTURE_CHUNK_SIZE];
+    int failed = 0;
+    while (len > 0) {
+        ssize_t n = -1;
+        if (!failed) n = splice(in_fd, NULL, out_fd, NULL, len, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            // No splice to this sink (or it failed): read the bytes and write them if we still can
+            n = read(in_fd, buf, len < sizeof(buf) ? len : sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return -1;
+            if (!failed && write_all(out_fd, buf, n) < 0) failed = 1;
+        }
+        len -= n;
+    }
+    return failed ? -1 : 0;
+}
+
+// Read and drop exactly len bytes from pipe in_fd
+// Returns 0 on success, -1 if the pipe ran dry first
+static int fanout_discard(int in_fd, size_t len) {
+    char buf[CAPTURE_CHUNK_SIZE];
+    while (len > 0) {
+        ssize_t n = read(in_fd, buf, len < sizeof(buf) ? len : sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+// Body of the fan-out helper: copy everything from in_fd to each sink until EOF
+static void run_fanout(int in_fd, int *sinks, int sink_count) {
+    int keep[MAX_OUTPUT_TARGETS + 2];
+    keep[0] = in_fd;
+    for (int k = 0; k < sink_count; k++) keep[k + 1] = sinks[k];
+    close_other_fds(keep, sink_count + 1);
+    signal(SIGPIPE, SIG_IGN);  // A closed sink is dropped; the others keep receiving
+
+    // tee() needs a pipe on both ends, so file sinks get the data through a scratch pipe
+    // at least as large as the input pipe, which always takes a full tee() batch
+    int scratch[2];
+    if (pipe(scratch) < 0) _exit(1);
+    int capacity = fcntl(in_fd, F_GETPIPE_SZ);
+    if (capacity > 0) fcntl(scratch[1], F_SETPIPE_SZ, capacity);
+
+    int alive = sink_count;
+    while (alive > 0) {
+        int last = sink_count - 1;
+        while (sinks[last] < 0) last--;
+
+        // Every sink but the last gets a duplicate of the next batch
+        ssize_t batch = 0;
+        for (int k = 0; k < last; k++) {
+            if (sinks[k] < 0) continue;
+            ssize_t n = tee(in_fd, scratch[1], batch ? (size_t)batch : (size_t)INT_MAX, 0);
+            if (n < 0 && errno == EINTR) { k--; continue; }
+            if (n <= 0) _exit(0);  // End of input
+            if (batch == 0) batch = n;
+            if (fanout_move(scratch[0], sinks[k], n) < 0) {
+                close(sinks[k]);
+                sinks[k] = -1;
+                alive--;
+            }
+        }
+
+        // The last sink consumes the batch from the input pipe
+        if (batch == 0) {
+            ssize_t n = splice(in_fd, NULL, sinks[last], NULL, INT_MAX, SPLICE_F_MOVE);
+            if (n == 0) _exit(0);
+            if (n > 0) continue;
+            if (errno == EINTR) continue;
+            // Find out how much is waiting, then move it the slow way
+            n = tee(in_fd, scratch[1], INT_MAX, 0);
+            if (n <= 0) _exit(0);
+            fanout_discard(scratch[0], n);  // Drop the duplicate again
+            batch = n;
+        }
+        if (fanout_move(in_fd, sinks[last], batch) < 0) {
+            close(sinks[last]);
+            sinks[last] = -1;
+            alive--;
+        }
+    }
+
+    // Every sink is gone: closing the input lets the writer see SIGPIPE like with tee(1)
+    _exit(0);
+}
+
+// Open all of a command's output targets and start its fan-out helper.
+// extra_sink, if not -1, is the pipe to the next pipeline stage and receives the output too.
+// On success cmd->fanout_fd is the descriptor the command must use as stdout.
+// Returns 0 on success, -1 on error
+static int start_fanout(struct Command *cmd, int extra_sink, pid_t *helper) {
+    int sinks[MAX_OUTPUT_TARGETS + 1];
+    int sink_count = 0;
+    for (int k = 0; k < cmd->redirects.output_count; k++) {
+        struct OutputTarget *out = &cmd->redirects.outputs[k];
+        int fd = open(out->file, O_WRONLY | O_CREAT | O_CLOEXEC | (out->append ? O_APPEND : O_TRUNC), 0644);
+        if (fd == -1) {
+            perror(out->append ? "Append redirection failed" : "Output redirection failed");
+            for (int j = 0; j < sink_count; j++) close(sinks[j]);
+            return -1;
+        }
+        sinks[sink_count++] = fd;
+    }
+    int file_sinks = sink_count;
+    if (extra_sink >= 0) sinks[sink_count++] = extra_sink;
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("pipe failed");
+        for (int j = 0; j < file_sinks; j++) close(sinks[j]);
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid > 0) STAT_INC(STAT_FORKS);
+    if (pid < 0) {
+        perror("fork failed");
+        close(fds[0]);
+        close(fds[1]);
+        for (int j = 0; j < file_sinks; j++) close(sinks[j]);
+        return -1;
+    }
+    if (pid == 0) {
+        // Keeps the shell's SIGINT/SIGTSTP handling so Ctrl-C cannot lose buffered output
+        run_fanout(fds[0], sinks, sink_count);
+    }
+
+    close(fds[0]);
+    for (int j = 0; j < file_sinks; j++) close(sinks[j]);
+    cmd->fanout_fd = fds[1];
+    *helper = pid;
+    return 0;
+}
+
+// Close the shell's copy of a command's fan-out descriptor
+static void close_fanout(struct Command *cmd) {
+    if (cmd->fanout_fd >= 0) close(cmd->fanout_fd);
+    cmd->fanout_fd = -1;
+}
+
+// Run { list; } or a built-in in the shell itself: redirect the shell's own
+// descriptors, run it, then put the saved descriptors back. No process is created.
+static int run_in_shell(struct Command *cmd) {
+    int targets[2] = { -1, -1 };
+    int saved[2] = { -1, -1 };
+    int status;
+
+    if (cmd->redirect_flags & (REDIRECT_IN | REDIRECT_HEREDOC)) targets[0] = STDIN_FILENO;
+    if (cmd->redirect_flags & (REDIRECT_OUT | REDIRECT_APP)) targets[1] = STDOUT_FILENO;
+
+    fflush(stdout);
+    for (int k = 0; k < 2; k++) {
+        if (targets[k] >= 0) saved[k] = fcntl(targets[k], F_DUPFD_CLOEXEC, 10);
+    }
+
+    pid_t fanout_pid = -1;
+    if (needs_fanout(cmd, 0) && start_fanout(cmd, -1, &fanout_pid) < 0) status = 1;
+    else if (apply_redirections(cmd) < 0) status = 1;
+    else if (cmd->group != NULL) status = execute_list(cmd->group);
+    else {
+        // A built-in such as sleep may take a while; the governor and output capture keep
+        // working meanwhile
+        sigset_t async_mask;
+        sigemptyset(&async_mask);
+        sigaddset(&async_mask, SIGALRM);
+        sigaddset(&async_mask, SIGIO);
+        sigprocmask(SIG_UNBLOCK, &async_mask, NULL);
+        status = run_builtin(cmd);
+        sigprocmask(SIG_BLOCK, &async_mask, NULL);
+    }
+    close_fanout(cmd);
+
+    fflush(stdout);
+    for (int k = 0; k < 2; k++) {
+        if (saved[k] >= 0) {
+            dup2(saved[k], targets[k]);
+            close(saved[k]);
+        }
+    }
+    // Restoring stdout closed the helper's input; let it finish writing
+    if (fanout_pid > 0) waitpid(fanout_pid, NULL, 0);
+    return status;
+}
+
+// Pipe capacity (F_SETPIPE_SZ) for a pipeline's pipes. "pipesize SIZE" in front of a
+// pipeline wins over the PIPE_SIZE variable. SIZE is a byte count (256K, 1M, ...), "max"
+// for /proc/sys/fs/pipe-max-size, or "auto" to start at the default and grow pipes that
+// keep filling up while the shell waits for the job. Sizes are capped at pipe-max-size.
+
+#define PIPE_SAMPLE_NS 10000000L   // How often "auto" samples pipe fill levels (10ms)
+#define PIPE_GROW_SAMPLES 4        // Net full samples before a pipe's capacity doubles
+
+// Inter-stage pipes of a foreground pipeline being sized adaptively
+struct PipeMonitor {
+    int count;
+    ino_t inode[MAX_COMMANDS];      // Identifies the pipe behind the reader's stdin
+    pid_t reader[MAX_COMMANDS];     // Stage reading from pipe i; 0 if it was not forked
+    int pressure[MAX_COMMANDS];     // Incremented when a sample finds the pipe full; -1 once at the cap
+    long max_size;
+};
+
+// /proc/sys/fs/pipe-max-size, read once
+static long pipe_max_size(void) {
+    static long max_size = 0;
+    if (max_size == 0) {
+        FILE *f = fopen("/proc/sys/fs/pipe-max-size", "r");
+        if (f == NULL || fscanf(f, "%ld", &max_size) != 1) max_size = 1 << 20;
+        if (f != NULL) fclose(f);
+    }
+    return max_size;
+}
+
+// Returns the capacity to give a pipeline's pipes: 0 for the kernel default,
+// -1 for adaptive sizing, or a byte count no larger than pipe-max-size
+static long pipeline_pipe_size(struct Pipeline *pipeline) {
+    const char *setting = pipeline->pipe_size;
+    char *fields[3];
+    if (setting != NULL) {
+        if (expand_word(setting, fields, 3) != 1) {
+            fprintf(stderr, "pipesize: %s: expected one size\n", setting);
+            return 0;
+        }
+        setting = fields[0];
+    } else {
+        setting = get_variable(&var_store, "PIPE_SIZE");
+        if (setting == NULL || setting[0] == '\0') return 0;
+    }
+
+    if (strcmp(setting, "auto") == 0) return -1;
+    if (strcmp(setting, "max") == 0) return pipe_max_size();
+    long size;
+    if (parse_size(setting, &size) < 0) {
+        fprintf(stderr, "pipesize: %s: invalid size\n", setting);
+        return 0;
+    }
+    return size < pipe_max_size() ? size : pipe_max_size();
+}
+
+// PIPESTAT_* for a pipeline: from its "pipestat [-d]" prefix, or from a PIPESTAT variable
+// that is set and not "0"/"off" ("detailed" asks for relays)
+static int pipeline_pipestat_mode(struct Pipeline *pipeline) {
+    if (pipeline->pipestat != PIPESTAT_OFF) return pipeline->pipestat;
+    const char *setting = get_variable(&var_store, "PIPESTAT");
+    if (setting == NULL || setting[0] == '\0' || strcmp(setting, "0") == 0 || strcmp(setting, "off") == 0)
+        return PIPESTAT_OFF;
+    return strcmp(setting, "detailed") == 0 ? PIPESTAT_DETAILED : PIPESTAT_SAMPLED;
+}
+
+// Set up pipestat for a pipeline; returns the table, or NULL if pipestat is off.
+// Sampled: remember each pipe so the sampler can recognize it on its reader's stdin; the
+// sampler starts once the readers are forked (see pipestat_start_sampler).
+// Detailed: put a relay in the middle of every pipe. The writer keeps pipes[i][1], the
+// relay moves data to a second pipe, and the reader gets that pipe's read end instead.
+// Relay pids are stored in relay_pids.
+static struct PipeStatTable *start_pipestat(struct Pipeline *pipeline, int pipes[][2], long pipe_size,
+                                            pid_t *relay_pids, int *relay_count) {
+    *relay_count = 0;
+    int mode = pipeline_pipestat_mode(pipeline);
+    if (mode == PIPESTAT_OFF) return NULL;
+    struct PipeStatTable *table = pipestat_create(pipeline, mode);
+    if (table == NULL) return NULL;
+
+    if (mode == PIPESTAT_SAMPLED) {
+        for (int i = 0; i < pipeline->pipe_count; i++) {
+            struct stat st;
+            table->links[i].inode = (fstat(pipes[i][0], &st) == 0) ? st.st_ino : 0;
+        }
+        return table;
+    }
+
+    for (int i = 0; i < pipeline->pipe_count; i++) {
+        int relayed[2];
+        if (pipe(relayed) < 0) {
+            perror("pipestat: pipe failed");
+            break;  // Remaining pipes stay direct and report no traffic
+        }
+        if (pipe_size > 0) fcntl(relayed[1], F_SETPIPE_SZ, pipe_size);
+        pid_t pid = pipestat_start_relay(table, i, pipes[i][0], relayed[1]);
+        close(relayed[1]);
+        if (pid < 0) {
+            close(relayed[0]);
+            break;
+        }
+        close(pipes[i][0]);
+        pipes[i][0] = relayed[0];
+        relay_pids[(*relay_count)++] = pid;
+    }
+    return table;
+}
+
+// Look at each monitored pipe through its reader's /proc/PID/fd/0 (the shell holds no
+// copy, so a reader that exits still delivers SIGPIPE to the writer right away).
+// A pipe found full means its writer is blocked; one that stays full gets doubled.
+static void sample_pipes(struct PipeMonitor *mon) {
+    char path[64];
+    for (int i = 0; i < mon->count; i++) {
+        if (mon->reader[i] <= 0 || mon->pressure[i] < 0) continue;
+        snprintf(path, sizeof(path), "/proc/%ld/fd/0", (long)mon->reader[i]);
+        int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            mon->reader[i] = 0;  // Reader has exited
+            continue;
+        }
+        struct stat st;
+        int queued = 0;
+        int capacity = fcntl(fd, F_GETPIPE_SZ);
+        if (fstat(fd, &st) == 0 && st.st_ino == mon->inode[i] && capacity > 0 &&
+            ioctl(fd, FIONREAD, &queued) == 0) {
+            if (queued >= capacity - PIPE_BUF) mon->pressure[i]++;
+            else if (mon->pressure[i] > 0) mon->pressure[i]--;
+
+            if (mon->pressure[i] >= PIPE_GROW_SAMPLES) {
+                long grown = (long)capacity * 2;
+                fcntl(fd, F_SETPIPE_SZ, grown < mon->max_size ? grown : mon->max_size);
+                mon->pressure[i] = (grown < mon->max_size) ? 0 : -1;  // -1: at the cap, stop sampling
+            }
+        }
+        // Otherwise stdin is not (or not yet, right after fork) the pipe; try again next sample
+        close(fd);
+    }
+}
+
+// Record a pipeline's pipes for adaptive sizing
+static void monitor_pipes(struct PipeMonitor *mon, int pipes[][2], int pipe_count) {
+    mon->count = pipe_count;
+    mon->max_size = pipe_max_size();
+    for (int i = 0; i < pipe_count; i++) {
+        struct stat st;
+        mon->inode[i] = (fstat(pipes[i][0], &st) == 0) ? st.st_ino : 0;
+        mon->reader[i] = 0;
+        mon->pressure[i] = 0;
+    }
+}
+
+// Wait for every process of a foreground job; SIGCHLD must be blocked by the caller
+// Returns the exit status of the last command in the pipeline
+// With a PipeMonitor the wait polls every PIPE_SAMPLE_NS so pipes can be resized meanwhile
+static int wait_for_job(struct Job *job, struct PipeMonitor *mon) {
+    int status = 0;
+    int last_command = job->pid_count - job->helper_count - 1;
+
+    for (int i = 0; i < job->pid_count; i++) {
+        if (job->pid_status[i] == 0) continue;
+
+        int wstatus;
+        struct rusage usage;
+        pid_t result;
+        if (mon != NULL) {
+            // SIGCHLD is blocked, so sigtimedwait() wakes as soon as any child changes state
+            sigset_t chld;
+            sigemptyset(&chld);
+            sigaddset(&chld, SIGCHLD);
+            struct timespec tick = { 0, PIPE_SAMPLE_NS };
+            while ((result = wait4(job->pids[i], &wstatus, WUNTRACED | WNOHANG, &usage)) == 0) {
+                sample_pipes(mon);
+                service_deadlines();
+                sigtimedwait(&chld, NULL, &tick);
+            }
+        } else {
+            result = waitpid_with_deadlines(job->pids[i], &wstatus, WUNTRACED, &usage);
+        }
+        while (result < 0 && errno == EINTR) result = wait4(job->pids[i], &wstatus, WUNTRACED, &usage);
+
+        if (result < 0) {
+            job->pid_status[i] = 0;
+            continue;
+        }
+        if (WIFSTOPPED(wstatus)) {
+            // Ctrl-Z: leave the job in the table so fg/bg can resume it
+            job->state = JOB_STOPPED;
+            job->is_background = 1;
+            printf("\n[%d]+  Stopped                 %s\n", job->job_id, job->command_line);
+            fflush(stdout);
+            return wait_status_to_exit(wstatus);
+        }
+        job_pid_reaped(job, i, wstatus, &usage);
+        if (i == last_command) status = job->pid_exit[i];
+    }
+
+    job->state = JOB_DONE;
+    return job->timed_out ? TIMEOUT_STATUS : status;
+}
+
+// Hand the terminal to pgid; blocks SIGTTOU so the shell can reclaim it from the background
+static void give_terminal_to(pid_t pgid) {
+    sigset_t tto_mask, old_tto_mask;
+    sigemptyset(&tto_mask);
+    sigaddset(&tto_mask, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &tto_mask, &old_tto_mask);
+
+    unsigned long long start = TRACE_START();
+    tcsetpgrp(STDIN_FILENO, pgid);
+    TRACE_END(TRACE_TERMINAL, start, NULL);
+
+    sigprocmask(SIG_SETMASK, &old_tto_mask, NULL);
+}
+
+// Process substitutions created while expanding one pipeline.
+// Each command's descriptors are inherited only by that command's child.
+struct ProcSubst {
+    int fds[MAX_PROCSUBST];       // Shell's end of each helper pipe (close-on-exec)
+    int fd_count;
+    pid_t pids[MAX_PROCSUBST];    // Helper processes, reaped with the pipeline's job
+    int pid_count;
+};
+
+// Pending substitutions for the pipeline currently being expanded
+static struct ProcSubst *procsubst_pending = NULL;
+
+// Close the shell's copies of substitution descriptors [first, last)
+static void close_procsubst_fds(struct ProcSubst *ps, int first, int last) {
+    for (int k = first; k < last; k++) {
+        if (ps->fds[k] >= 0) close(ps->fds[k]);
+        ps->fds[k] = -1;
+    }
+}
+
+// Drop a pipeline's substitutions after an error: close descriptors and reap helpers
+static void abandon_procsubst(struct ProcSubst *ps) {
+    close_procsubst_fds(ps, 0, ps->fd_count);
+    for (int k = 0; k < ps->pid_count; k++) waitpid(ps->pids[k], NULL, 0);
+}
+
+// Run a simple command in a forked child: a built-in runs and exits, anything else
+// is exec'd. Never returns. Children leave with _exit(): exit() would flush stdio input
+// streams, and flushing the script's FILE seeks the shared descriptor back, so the shell
+// would read the rest of the script again.
+void run_command_in_child(struct Command *cmd) {
+    // A built-in runs in the child without exec
+    if (is_builtin_command(cmd->argv[0])) {
+        int builtin_status = run_builtin(cmd);
+        fflush(stdout);
+        _exit(builtin_status);
+    }
+
+    // "exec cmd" inside a pipeline or in the background just runs cmd
+    char **argv = cmd->argv;
+    if (strcmp(argv[0], "exec") == 0) argv++;
+    if (argv[0] == NULL) _exit(0);
+
+    // Build environment array for child process
+    char **child_env = build_environ_array(&var_store);
+    if (child_env == NULL) {
+        fprintf(stderr, "Failed to build environment for child process\n");
+        _exit(1);
+    }
+
+    // Identify path to executable
+    char *full_path = find_executable_in_path(argv[0], &var_store);
+    if (full_path == NULL) {
+        STAT_INC(STAT_EXEC_FAILURES);
+        fprintf(stderr, "%s: command not found\n", argv[0]);
+        _exit(127);
+    }
+    TRACE_MARK(TRACE_EXEC, full_path);
+    STAT_INC(STAT_EXECS);
+    jobshm_close();  // Only does anything when this is the shell itself, exec'ing in place
+    execve(full_path, argv, child_env);
+    STAT_INC(STAT_EXEC_FAILURES);
+
+    fprintf(stderr, "%s: command not found\n", argv[0]);
+    _exit(127);  // Standard exit code for "command not found"
+}
+
+// Hand a coproc's pipe ends to the job and publish them as $NAME_READ, $NAME_WRITE and $NAME_PID
+static void register_coproc(struct Job *job, const char *name, int read_fd, int write_fd) {
+    job->coproc_fds[0] = read_fd;
+    job->coproc_fds[1] = write_fd;
+
+    char var[MAX_INPUT_SIZE];
+    char value[32];
+    snprintf(var, sizeof(var), "%s_READ", name);
+    snprintf(value, sizeof(value), "%d", read_fd);
+    set_variable(&var_store, var, value, 0);
+    snprintf(var, sizeof(var), "%s_WRITE", name);
+    snprintf(value, sizeof(value), "%d", write_fd);
+    set_variable(&var_store, var, value, 0);
+    snprintf(var, sizeof(var), "%s_PID", name);
+    snprintf(value, sizeof(value), "%ld", (long)last_background_pid);
+    set_variable(&var_store, var, value, 0);
+}
+
+// Run one parsed pipeline: built-ins in the shell, everything else in forked children
+// Returns the pipeline's exit status, which is also stored in last_exit_status
+static int run_pipeline(struct Pipeline *pipeline, int background, const char *command_line) {
+    int pipes[MAX_COMMANDS - 1][2];
+    pid_t child_pids[MAX_JOB_PIDS];  // Store child PIDs
+    const char *child_names[MAX_JOB_PIDS];  // What each child runs, for resource reports
+    int child_count = 0;
+    pid_t fanout_pids[MAX_COMMANDS];  // Helpers for commands with several output targets
+    int fanout_count = 0;
+    int status = 0;
+    int coproc_in[2] = { -1, -1 };   // Shell writes [1], the first stage reads [0]
+    int coproc_out[2] = { -1, -1 };  // The last stage writes [1], the shell reads [0]
+    if (pipeline->coproc_name != NULL) background = 1;
+    int use_pgid = !in_subshell && (pipeline->pipe_count > 0 || background);
+
+    // Only the pipeline itself may be in tail position, never commands run during its expansion
+    int tail_position = tail_exec_enabled && pipeline->pipe_count == 0 && !background;
+    tail_exec_enabled = 0;
+
+    // Block SIGCHLD until the job is registered so the handler cannot reap a child we still need to wait for,
+    // and the governor's SIGALRM and output capture's SIGIO so they never see a half-built job
+    sigset_t mask, oldmask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGALRM);
+    sigaddset(&mask, SIGIO);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+    // Expansion may start <(...) helpers; remember which descriptors belong to which command
+    struct ProcSubst substs = { .fd_count = 0, .pid_count = 0 };
+    struct ProcSubst *saved_pending = procsubst_pending;
+    int subst_start[MAX_COMMANDS + 1];
+    procsubst_pending = &substs;
+    for (int i = 0; i <= pipeline->pipe_count; i++) {
+        subst_start[i] = substs.fd_count;
+        if (expand_command(&pipeline->commands[i]) < 0) {
+            for (int j = 0; j <= i; j++) close_heredoc(&pipeline->commands[j]);
+            procsubst_pending = saved_pending;
+            abandon_procsubst(&substs);
+            sigprocmask(SIG_SETMASK, &oldmask, NULL);
+            return last_exit_status = 1;
+        }
+    }
+    subst_start[pipeline->pipe_count + 1] = substs.fd_count;
+    procsubst_pending = saved_pending;
+
+    // A job with a deadline needs the shell around to enforce it, so it is never exec'd in place
+    double time_limit = pipeline_time_limit(pipeline);
+    if (time_limit < 0) {
+        for (int j = 0; j <= pipeline->pipe_count; j++) close_heredoc(&pipeline->commands[j]);
+        abandon_procsubst(&substs);
+        sigprocmask(SIG_SETMASK, &oldmask, NULL);
+        return last_exit_status = 1;
+    }
+    if (time_limit > 0) tail_position = 0;
+    // An explicit "timeout" prefix puts even a built-in in a child it can kill; JOB_TIMEOUT
+    // leaves built-ins that run in the shell alone
+    int kill_in_child = time_limit > 0 && pipeline->timeout != NULL;
+    // "time" measures a built-in or { list; } in a child too, where wait4() can account for it
+    if (pipeline->timed) {
+        kill_in_child = 1;
+        tail_position = 0;
+    }
+    // Its own process group lets the deadline reach everything the job started
+    if (time_limit > 0 && !in_subshell) use_pgid = 1;
+
+    // Create pipes if needed (for pipe_count > 0, we need pipe_count pipes)
+    for (int i = 0; i < pipeline->pipe_count; i++) {
+        if (pipe(pipes[i]) < 0) {
+            perror("pipe failed");
+            for (int j = 0; j < i; j++) { close(pipes[j][0]); close(pipes[j][1]); }
+            for (int j = 0; j <= pipeline->pipe_count; j++) close_heredoc(&pipeline->commands[j]);
+            abandon_procsubst(&substs);
+            sigprocmask(SIG_SETMASK, &oldmask, NULL);
+            return last_exit_status = 1;
+        }
+    }
+    if (pipeline->coproc_name != NULL && (pipe2(coproc_in, O_CLOEXEC) < 0 || pipe2(coproc_out, O_CLOEXEC) < 0)) {
+        perror("coproc: pipe failed");
+        for (int k = 0; k < 2; k++) {
+            if (coproc_in[k] >= 0) close(coproc_in[k]);
+            if (coproc_out[k] >= 0) close(coproc_out[k]);
+        }
+        for (int j = 0; j < pipeline->pipe_count; j++) { close(pipes[j][0]); close(pipes[j][1]); }
+        for (int j = 0; j <= pipeline->pipe_count; j++) close_heredoc(&pipeline->commands[j]);
+        abandon_procsubst(&substs);
+        sigprocmask(SIG_SETMASK, &oldmask, NULL);
+        return last_exit_status = 1;
+    }
+
+    // Size the pipes; "auto" starts at the default and is adjusted while we wait
+    long pipe_size = pipeline->pipe_count > 0 ? pipeline_pipe_size(pipeline) : 0;
+    struct PipeMonitor monitor;
+    if (pipe_size > 0) {
+        for (int i = 0; i < pipeline->pipe_count; i++) fcntl(pipes[i][1], F_SETPIPE_SZ, pipe_size);
+    }
+
+    // pipestat relays go in before the stages fork, so each reader inherits the relayed pipe
+    pid_t relay_pids[MAX_COMMANDS];  // Relays, or the sampler once the stages are forked
+    int relay_count = 0;
+    struct PipeStatTable *pipestat = pipeline->pipe_count > 0 ?
+        start_pipestat(pipeline, pipes, pipe_size, relay_pids, &relay_count) : NULL;
+
+    if (pipe_size < 0) {
+        monitor_pipes(&monitor, pipes, pipeline->pipe_count);
+    }
+
+    struct AffinityPlan *placement = plan_affinity(pipeline);
+
+    // JOB_CAPTURE: a background job writes stdout and stderr into a pipe the shell drains
+    int capture_fd = -1;
+    struct JobLog *joblog = (background && pipeline->coproc_name == NULL && !in_subshell) ?
+        joblog_create(&capture_fd) : NULL;
+
+    unsigned long long spawn_start = 0;  // When the first stage was forked, for shellstat
+
+    //iterate through commands in the pipeline (pipe_count + 1 total commands)
+    for (int i = 0; i <= pipeline->pipe_count; i++) {
+        struct Command *cmd = &pipeline->commands[i];
+
+        // A lone foreground { list; } needs no fork
+        if (cmd->group_type == GROUP_BRACE && pipeline->pipe_count == 0 && !background && !kill_in_child) {
+            tail_exec_enabled = tail_position;
+            status = run_in_shell(cmd);
+            continue;
+        }
+
+        if (cmd->argv[0] == NULL && cmd->group == NULL) continue;
+        if (cmd->group == NULL && strcmp(cmd->argv[0], "exit") == 0) {
+            shell_should_exit = 1; //set flag for main loop
+            status = (cmd->argv[1] != NULL) ? atoi(cmd->argv[1]) : last_exit_status;
+            break;
+        }
+
+        // exec: with a command it replaces the shell; with only redirections it redirects the shell
+        int replace_shell = 0;
+        if (cmd->group == NULL && strcmp(cmd->argv[0], "exec") == 0 && pipeline->pipe_count == 0 && !background) {
+            if (cmd->argv[1] == NULL) {
+                // The shell's stdout stays with the fan-out helper until the shell exits
+                pid_t helper;
+                fflush(stdout);
+                if (needs_fanout(cmd, 0) && start_fanout(cmd, -1, &helper) < 0) status = 1;
+                else status = (apply_redirections(cmd) < 0) ? 1 : 0;
+                continue;
+            }
+            char *path = find_executable_in_path(cmd->argv[1], &var_store);
+            if (path == NULL) {
+                fprintf(stderr, "exec: %s: not found\n", cmd->argv[1]);
+                status = 127;
+                continue;
+            }
+            free(path);
+            replace_shell = 1;
+        }
+
+        // The last command of a -c string, script or subshell runs in place of the shell
+        // when nothing else could still need it (no helpers, no unfinished jobs)
+        if (tail_position && cmd->group == NULL && substs.pid_count == 0 && !needs_fanout(cmd, 0) &&
+            !has_pending_jobs(&job_table))
+            replace_shell = 1;
+
+        // Built-ins run in the shell; in a pipeline, the background or under a deadline they get a
+        // child like any command
+        if (cmd->group == NULL && is_builtin_command(cmd->argv[0]) && !builtin_needs_process(cmd->argv[0]) &&
+            pipeline->pipe_count == 0 && !background && !kill_in_child) {
+            status = run_in_shell(cmd);
+            continue;
+        }
+
+        // check and handle job commands
+        if (process_job_command(cmd, &job_table, &status) == 1) {
+            continue;
+        }
+
+        // Output going to several places passes through a fan-out helper
+        int piped = i < pipeline->pipe_count;
+        if (needs_fanout(cmd, piped)) {
+            if (start_fanout(cmd, piped ? pipes[i][1] : -1, &fanout_pids[fanout_count]) < 0) {
+                status = 1;
+                continue;
+            }
+            fanout_count++;
+        }
+
+        // it's a regular command or a group that needs its own process. fork
+        fflush(stdout);  // Don't let a child that keeps running shell code repeat buffered output
+        unsigned long long fork_start = monotonic_ns();
+        pid_t pid = replace_shell ? 0 : fork();  // Replacing the shell takes the child's path in place
+        if (pid > 0) {
+            STAT_INC(STAT_FORKS);
+            if (spawn_start == 0) spawn_start = fork_start;
+            TRACE_END(TRACE_FORK, fork_start, cmd->group != NULL ? "(group)" : cmd->argv[0]);
+        }
+        if (pid < 0) {
+            perror("fork failed");
+            close_fanout(cmd);
+            status = 1;
+            continue;
+        }
+
+        //Child process
+        if (pid == 0) {
+            apply_affinity(placement, i);
+            reset_child_signals();
+            sigprocmask(SIG_SETMASK, &oldmask, NULL);
+
+            // Keep this command's /dev/fd/N descriptors across exec; the rest stay close-on-exec
+            for (int k = subst_start[i]; k < subst_start[i + 1]; k++)
+                fcntl(substs.fds[k], F_SETFD, 0);
+
+            // Handle pipes; redirections are applied after, so they take precedence
+            if (pipeline->pipe_count > 0) {
+                if (i > 0)
+                    dup2(pipes[i - 1][0], STDIN_FILENO); // Read end of previous pipe
+                if (i < pipeline->pipe_count)
+                    dup2(pipes[i][1], STDOUT_FILENO); // Write end of current pipe
+
+                // Close all pipe descriptors in child
+                for (int j = 0; j < pipeline->pipe_count; j++) {
+                    close(pipes[j][0]);
+                    close(pipes[j][1]);
+                }
+            }
+
+            // coproc: the first stage reads what the shell writes and the last one answers it
+            if (coproc_in[0] >= 0) {
+                if (i == 0) dup2(coproc_in[0], STDIN_FILENO);
+                if (i == pipeline->pipe_count) dup2(coproc_out[1], STDOUT_FILENO);
+                for (int k = 0; k < 2; k++) {
+                    close(coproc_in[k]);
+                    close(coproc_out[k]);
+                }
+            }
+
+            // Captured output: the last stage's stdout and every stage's stderr; redirections still win
+            if (capture_fd >= 0) {
+                if (i == pipeline->pipe_count) dup2(capture_fd, STDOUT_FILENO);
+                dup2(capture_fd, STDERR_FILENO);
+                close(capture_fd);
+            }
+
+            if (apply_redirections(cmd) < 0) _exit(1);
+
+            if (use_pgid)
+                setpgid(0, child_count == 0 ? 0 : child_pids[0]);  // First child leads the process group
+
+            // |[N]: this process coordinates N copies and only the copies go on from here
+            if (cmd->parallel > 1) run_parallel_stage(cmd);
+
+            // ( list ), or a { list; } inside a pipeline: one process runs the whole group
+            if (cmd->group != NULL) {
+                enter_subshell();
+                int group_status = execute_list(cmd->group);
+                fflush(stdout);
+                _exit(group_status);
+            }
+
+            run_command_in_child(cmd);
+        }
+
+        // Parent Process
+        // Set pgid for job control only when needed (both sides to avoid a race with exec)
+        if (use_pgid)
+            setpgid(pid, child_count == 0 ? pid : child_pids[0]);
+
+        // The child owns its substitution and here-document descriptors now
+        close_procsubst_fds(&substs, subst_start[i], subst_start[i + 1]);
+        close_heredoc(cmd);
+        close_fanout(cmd);
+
+        if (pipe_size < 0 && i > 0) monitor.reader[i - 1] = pid;
+        if (pipestat != NULL && pipestat->mode == PIPESTAT_SAMPLED) {
+            if (i > 0) pipestat->links[i - 1].reader = pid;
+            if (i < pipeline->pipe_count) pipestat->links[i].writer = pid;
+        }
+
+        //store child PIDs
+        child_names[child_count] = cmd->group != NULL ? "(group)" : cmd->argv[0];
+        child_pids[child_count++] = pid;
+    }
+
+    if (spawn_start != 0) record_latency(LATENCY_SPAWN, spawn_start);
+
+    if (pipestat != NULL && pipestat->mode == PIPESTAT_SAMPLED && child_count > 0) {
+        pid_t sampler = pipestat_start_sampler(pipestat);
+        if (sampler > 0) relay_pids[relay_count++] = sampler;
+    }
+
+    // Close all pipes in parent process
+    for (int i = 0; i < pipeline->pipe_count; i++) {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+    for (int i = 0; i <= pipeline->pipe_count; i++) close_heredoc(&pipeline->commands[i]);
+    close_procsubst_fds(&substs, 0, substs.fd_count);
+
+    if (coproc_in[0] >= 0) {
+        close(coproc_in[0]);
+        close(coproc_out[1]);
+    }
+    if (capture_fd >= 0) close(capture_fd);
+
+    // Fan-out, pipestat and substitution helpers join the job after the pipeline's own processes
+    int command_count = child_count;
+    for (int k = 0; k < fanout_count; k++) {
+        child_names[child_count] = "(fan-out)";
+        child_pids[child_count++] = fanout_pids[k];
+    }
+    for (int k = 0; k < relay_count; k++) {
+        child_names[child_count] = "(pipestat)";
+        child_pids[child_count++] = relay_pids[k];
+    }
+    for (int k = 0; k < substs.pid_count; k++) {
+        child_names[child_count] = "(subst)";
+        child_pids[child_count++] = substs.pids[k];
+    }
+
+    if (child_count > 0) {
+        int slot = createJob(&job_table, (char *)command_line, &background, child_pids, child_count);
+        if (slot == -1) {
+            if (coproc_in[0] >= 0) {
+                close(coproc_in[1]);
+                close(coproc_out[0]);
+            }
+            for (int i = 0; i < child_count; i++) {
+                int wstatus;
+                waitpid(child_pids[i], &wstatus, 0);
+                if (i == command_count - 1) status = wait_status_to_exit(wstatus);
+            }
+        } else {
+            struct Job *job = &job_table.jobs[slot];
+            job->helper_count = fanout_count + relay_count + substs.pid_count;
+            job->pipestat = pipestat;
+            pipestat = NULL;
+            if (time_limit > 0) arm_job_deadline(job, time_limit);
+            job->joblog = joblog;
+            for (int k = 0; k < child_count; k++)
+                snprintf(job->pid_names[k], sizeof(job->pid_names[k]), "%s", child_names[k]);
+            job->timed = pipeline->timed;
+            jobshm_publish();
+            joblog = NULL;
+
+            if (job->is_background) {
+                // Background job (simple or pipeline) - print info, don't wait
+                printf("[%d] %ld\n", job->job_id, (long)job->pids[0]);
+                fflush(stdout);
+                if (command_count > 0) last_background_pid = job->pids[command_count - 1];
+                if (coproc_in[0] >= 0) register_coproc(job, pipeline->coproc_name, coproc_out[0], coproc_in[1]);
+                lower_job_priority(job);
+                status = 0;
+            } else {
+                if (use_pgid && command_count > 0) give_terminal_to(job->pids[0]);
+                // The governor and output capture keep serving the background jobs while this one runs
+                sigset_t async_mask;
+                sigemptyset(&async_mask);
+                sigaddset(&async_mask, SIGALRM);
+                sigaddset(&async_mask, SIGIO);
+                sigprocmask(SIG_UNBLOCK, &async_mask, NULL);
+                unsigned long long wait_start = TRACE_START();
+                int job_status = wait_for_job(job, pipe_size < 0 ? &monitor : NULL);
+                TRACE_END(TRACE_WAIT, wait_start, job->command_line);
+                jobshm_publish();
+                sigprocmask(SIG_BLOCK, &async_mask, NULL);
+                if (command_count > 0) status = job_status;
+                if (use_pgid && command_count > 0) give_terminal_to(getpgrp());
+                if (job->pipestat != NULL && job->state == JOB_DONE) pipestat_report(stderr, job->pipestat);
+                job_time_report(job);
+            }
+        }
+    }
+    pipestat_free(pipestat);  // Not handed to a job
+    joblog_free(joblog);
+
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+    return last_exit_status = status;
+}
+
+// Read everything from fd into out, growing the buffer as data arrives
+static void read_all(int fd, struct Buffer *out) {
+    while (1) {
+        if (buf_reserve(out, CAPTURE_CHUNK_SIZE) < 0) return;
+        ssize_t n = read(fd, out->data + out->len, out->cap - out->len - 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        out->len += n;
+    }
+    if (out->data) out->data[out->len] = '\0';
+}
+
+// A substitution can run inside the shell if every command is a side-effect free built-in
+static int list_is_substitution_safe(struct CommandList *list) {
+    for (int k = 0; k < list->count; k++) {
+        struct Pipeline *pipeline = list->pipelines[k];
+        if (list->ops[k] == LIST_BG) return 0;
+        for (int i = 0; i <= pipeline->pipe_count; i++) {
+            const char *name = pipeline->commands[i].argv[0];
+            if (name == NULL || !is_substitution_safe_builtin(name)) return 0;
+        }
+    }
+    return 1;
+}
+
+// Parse the body of a $(...) or <(...) into a command list in the line arena
+// Returns NULL on syntax error
+static struct CommandList *parse_substitution(const char *text) {
+    struct CommandList *list = arena_alloc(&line_arena, sizeof(struct CommandList));
+    char *input = arena_strdup(&line_arena, text);
+    if (list == NULL || input == NULL) return NULL;
+
+    if (parse_input(input, list) < 0) {
+        last_exit_status = 2;
+        return NULL;
+    }
+    return list;
+}
+
+// Run text as a command and append its standard output to out, minus trailing newlines
+// Built-in-only commands run in-process; anything else runs in a forked
+// subshell whose output is streamed through a pipe into the buffer
+// Returns 0 on success, -1 on error; the command's status goes to last_exit_status
+int command_substitution(const char *text, struct Buffer *out) {
+    struct CommandList *list = parse_substitution(text);
+    if (list == NULL) return -1;
+
+    size_t start = out->len;
+    fflush(stdout);
+
+    if (list_is_substitution_safe(list)) {
+        // No fork: point stdout at an in-memory file while the built-ins run.
+        // A memfd rather than a pipe, so large output cannot block the shell on itself.
+        int memfd = memfd_create("mysh-cmdsubst", MFD_CLOEXEC);
+        int saved_stdout = dup(STDOUT_FILENO);
+        if (memfd < 0 || saved_stdout < 0) {
+            perror("command substitution failed");
+            if (memfd >= 0) close(memfd);
+            if (saved_stdout >= 0) close(saved_stdout);
+            return -1;
+        }
+        dup2(memfd, STDOUT_FILENO);
+        execute_list(list);
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+
+        lseek(memfd, 0, SEEK_SET);
+        read_all(memfd, out);
+        close(memfd);
+    } else {
+        int fds[2];
+        if (pipe(fds) < 0) {
+            perror("pipe failed");
+            return -1;
+        }
+
+        sigset_t mask, oldmask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+        pid_t pid = fork();
+
+        if (pid > 0) STAT_INC(STAT_FORKS);
+        if (pid < 0) {
+            perror("fork failed");
+            close(fds[0]);
+            close(fds[1]);
+            sigprocmask(SIG_SETMASK, &oldmask, NULL);
+            return -1;
+        }
+
+        if (pid == 0) {
+            reset_child_signals();
+            enter_subshell();
+            close(fds[0]);
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[1]);
+            int status = execute_list(list);
+            fflush(stdout);
+            _exit(status);
+        }
+
+        close(fds[1]);
+        read_all(fds[0], out);
+        close(fds[0]);
+
+        // If the child can't be waited for (already reaped), count the substitution as a success
+        int wstatus = 0;
+        while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR) {}
+        last_exit_status = wait_status_to_exit(wstatus);
+        sigprocmask(SIG_SETMASK, &oldmask, NULL);
+    }
+
+    // Trim trailing newlines from the captured output only
+    while (out->len > start && out->data[out->len - 1] == '\n') out->len--;
+    if (out->data) out->data[out->len] = '\0';
+    return 0;
+}
+
+// Start text as a helper connected by a pipe and append "/dev/fd/N" to out,
+// where N is the shell's end: the read end for <(...), the write end for >(...).
+// The descriptor is close-on-exec and handed only to the command whose word
+// produced it; the helper is reaped as part of that command's job.
+// Returns 0 on success, -1 on error
+int process_substitution(const char *text, int is_output, struct Buffer *out) {
+    struct ProcSubst *ps = procsubst_pending;
+    if (ps == NULL || ps->fd_count >= MAX_PROCSUBST) {
+        fprintf(stderr, "Error: Too many process substitutions\n");
+        return -1;
+    }
+
+    struct CommandList *list = parse_substitution(text);
+    if (list == NULL) return -1;
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("pipe failed");
+        return -1;
+    }
+    fflush(stdout);
+
+    pid_t pid = fork();
+
+    if (pid > 0) STAT_INC(STAT_FORKS);
+    if (pid < 0) {
+        perror("fork failed");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        reset_child_signals();
+        enter_subshell();
+        // Don't hold other substitutions' pipes open, or their readers never see EOF
+        close_procsubst_fds(ps, 0, ps->fd_count);
+        dup2(is_output ? fds[0] : fds[1], is_output ? STDIN_FILENO : STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        int status = execute_list(list);
+        fflush(stdout);
+        _exit(status);
+    }
+
+    int keep = is_output ? fds[1] : fds[0];
+    close(is_output ? fds[0] : fds[1]);
+    ps->fds[ps->fd_count++] = keep;
+    ps->pids[ps->pid_count++] = pid;
+
+    char path[32];
+    int len = snprintf(path, sizeof(path), "/dev/fd/%d", keep);
+    return buf_append(out, path, len);
+}
+
+// Run text as a command in a forked subshell whose stdout is out_fd
+// Used by built-ins that manage their own children (merge)
+// Returns the child's pid, or -1 on error
+pid_t spawn_command_text(const char *text, int out_fd) {
+    struct CommandList *list = parse_substitution(text);
+    if (list == NULL) return -1;
+    fflush(stdout);
+
+    pid_t pid = fork();
+
+    if (pid > 0) STAT_INC(STAT_FORKS);
+    if (pid < 0) {
+        perror("fork failed");
+        return -1;
+    }
+    if (pid == 0) {
+        reset_child_signals();
+        enter_subshell();
+        dup2(out_fd, STDOUT_FILENO);
+        if (out_fd != STDOUT_FILENO) close(out_fd);
+        int status = execute_list(list);
+        fflush(stdout);
+        _exit(status);
+    }
+    return pid;
+}
+
+// A here-document body was read with the line, so its pipeline can't be re-parsed later
+static int pipeline_has_heredoc(struct Pipeline *pipeline) {
+    for (int i = 0; i <= pipeline->pipe_count; i++) {
+        if (pipeline->commands[i].heredoc != NULL) return 1;
+    }
+    return 0;
+}
+
+// Run a pipeline, holding background pipelines back while JOB_SLOTS jobs are running:
+// those are queued in the job table (as their source text) and started in order later.
+// Returns the pipeline's exit status, which is also stored in last_exit_status
+int execute_pipeline(struct Pipeline *pipeline, int background, const char *command_line) {
+    if (!in_subshell) {
+        update_job_slots();
+        update_governor();
+        update_bg_priority();
+    }
+    // A coproc's descriptors are wanted right away, so it never waits in the queue
+    if (!background || in_subshell || job_table.starting_slot >= 0 || pipeline_has_heredoc(pipeline) ||
+        pipeline->coproc_name != NULL)
+        return run_pipeline(pipeline, background, command_line);
+
+    // Nothing overtakes jobs that are already waiting
+    int slot = has_queued_jobs(&job_table) ? 0 : acquire_job_slot();
+    if (slot == 0) {
+        if (queue_job(&job_table, command_line) < 0) return last_exit_status = 1;
+        start_queued_jobs(&job_table);
+        return last_exit_status = 0;
+    }
+
+    int job_id = job_table.next_job_id;
+    int status = run_pipeline(pipeline, background, command_line);
+    if (slot == 1) {
+        struct Job *job = NULL;
+        for (int i = 0; i < job_table.job_count; i++) {
+            if (job_table.jobs[i].job_id == job_id) job = &job_table.jobs[i];
+        }
+        if (job != NULL) job->holds_slot = 1;
+        else release_job_slot();  // Nothing was started
+    }
+    return status;
+}
+
+// Start a queued job now: in the background from start_queued_jobs(), or in the
+// foreground for fg. It keeps its job ID and table slot.
+// Returns the pipeline's status; the job is marked done if it could not start
+int start_queued_job(struct Job *job, int foreground) {
+    char *text = arena_strdup(&line_arena, job->command_line);
+    struct CommandList *list = text ? parse_substitution(text) : NULL;
+    if (list == NULL || list->count < 1) {
+        job->state = JOB_DONE;
+        return last_exit_status = 2;
+    }
+
+    job_table.starting_slot = job - job_table.jobs;
+    int status = run_pipeline(list->pipelines[0], !foreground, text);
+    if (job_table.starting_slot >= 0) {
+        job_table.starting_slot = -1;  // No process was started
+        job->state = JOB_DONE;
+    }
+    return status;
+}
+
+// Run a parsed command list, short-circuiting && and || on exit status
+// Returns the status of the last pipeline that ran
+int execute_list(struct CommandList *list) {
+    int tail = tail_exec_enabled;
+    for (int i = 0; i < list->count && !shell_should_exit; i++) {
+        if (i > 0) {
+            // A skipped pipeline leaves $? alone, so "a && b || c" runs c when a fails
+            if (list->ops[i - 1] == LIST_AND && last_exit_status != 0) continue;
+            if (list->ops[i - 1] == LIST_OR && last_exit_status == 0) continue;
+        }
+        // Only the final pipeline can be in tail position
+        tail_exec_enabled = tail && i == list->count - 1;
+        jobshm_sync();
+        execute_pipeline(list->pipelines[i], list->ops[i] == LIST_BG, list->texts[i]);
+    }
+    tail_exec_enabled = tail;
+    return last_exit_status;
+}
+
+// Parse and execute one line of input
+// Returns the exit status of the line
+int execute_line(char *input) {
+    struct CommandList *list = arena_alloc(&line_arena, sizeof(struct CommandList));
+    if (list == NULL) return last_exit_status = 1;
+
+    // Only whole input lines count as parses for shellstat; substitutions are parsed again
+    // when they run and would skew the histogram
+    unsigned long long parse_start = monotonic_ns();
+    int parsed = parse_input(input, list);
+    record_latency(LATENCY_PARSE, parse_start);
+    if (parsed < 0) return last_exit_status = 2;
+    return execute_list(list);
+}
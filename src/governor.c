@@ -0,0 +1,235 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/shell.h"
+
+// Pressure governor. GOVERNOR="cpu=50,memory=20,load=1.5,interval=1s" (or "on" for those
+// defaults) samples /proc/pressure/cpu and /proc/pressure/memory (the "some" avg10
+// percentages) every interval, falling back to the 1-minute load average per CPU where
+// PSI is missing. While any reading is at or above its threshold the governor stops the
+// newest running background job with SIGSTOP, one job per settle period; once every
+// reading is below half its threshold it resumes the oldest throttled job with SIGCONT.
+// Throttled jobs are ordinary JOB_STOPPED jobs flagged as throttled, so fg and bg still
+// work on them. GOVERNOR=off (or unset) resumes everything it stopped.
+//
+// Sampling runs in the SIGALRM handler, so it keeps working while the shell waits for a
+// foreground job. The handler only reads /proc, sends signals and updates the job table,
+// like the SIGCHLD handler does; code that builds or rewrites jobs blocks SIGALRM.
+
+#define GOVERNOR_SETTLE_TICKS 5    // PSI avg10 needs a few seconds to reflect a change
+
+static double cpu_limit = 50, memory_limit = 20, load_limit = 1.5;
+static struct timeval tick_interval = { 1, 0 };
+static long cpu_count = 1;
+static int governor_enabled;
+static int ticks_since_action = GOVERNOR_SETTLE_TICKS;
+static char *current_setting;      // The GOVERNOR value the settings above came from
+
+// Parse "12.34" without strtod(), which is not async-signal-safe
+static double parse_decimal(const char *s) {
+    double value = 0, scale = 1;
+    int seen_point = 0;
+    for (; (*s >= '0' && *s <= '9') || (*s == '.' && !seen_point); s++) {
+        if (*s == '.') {
+            seen_point = 1;
+            continue;
+        }
+        if (seen_point) scale /= 10;
+        value = value * 10 + (*s - '0');
+    }
+    return value * scale;
+}
+
+// First number after key= in a small /proc file; -1 if the file or key is missing
+static double read_proc_value(const char *path, const char *key) {
+    char buf[512];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+    if (key == NULL) return parse_decimal(buf);
+    const char *at = strstr(buf, key);
+    return at != NULL ? parse_decimal(at + strlen(key)) : -1;
+}
+
+// 1 when some reading is at or above its threshold, 0 when all are below half of theirs,
+// -1 in between
+static int pressure_level(void) {
+    double readings[3], limits[3] = { cpu_limit, memory_limit, load_limit };
+    readings[0] = read_proc_value("/proc/pressure/cpu", "some avg10=");
+    readings[1] = read_proc_value("/proc/pressure/memory", "some avg10=");
+    readings[2] = -1;
+    if (readings[0] < 0) {
+        double load = read_proc_value("/proc/loadavg", NULL);
+        if (load >= 0) readings[2] = load / cpu_count;
+    }
+
+    int calm = 1;
+    for (int k = 0; k < 3; k++) {
+        if (readings[k] < 0 || limits[k] < 0) continue;
+        if (readings[k] >= limits[k]) return 1;
+        if (readings[k] >= limits[k] / 2) calm = 0;
+    }
+    return calm ? 0 : -1;
+}
+
+static void throttle(struct Job *job) {
+    job->throttled = 1;  // Before the stop, so nothing sees it as stopped by the user
+    job->throttle_start_ns = monotonic_ns();
+    job->throttle_count++;
+    signal_job(job, SIGSTOP);
+    job->state = JOB_STOPPED;
+    jobshm_stale = 1;
+}
+
+static void unthrottle(struct Job *job) {
+    job->throttled_ns += monotonic_ns() - job->throttle_start_ns;
+    job->throttled = 0;
+    if (job->state == JOB_STOPPED) signal_job(job, SIGCONT);
+}
+
+static void governor_tick(int sig) {
+    (void)sig;
+    if (!governor_enabled || ++ticks_since_action < GOVERNOR_SETTLE_TICKS) return;
+
+    int level = pressure_level();
+    struct Job *pick = NULL;
+    for (int i = 0; i < job_table.job_count; i++) {
+        struct Job *job = &job_table.jobs[i];
+        if (!job->is_background || job->pid_count == 0) continue;
+        if (level == 1 && job->state == JOB_RUNNING && !job->throttled &&
+            (pick == NULL || job->job_id > pick->job_id))
+            pick = job;
+        if (level == 0 && job->throttled && job->state == JOB_STOPPED &&
+            (pick == NULL || job->job_id < pick->job_id))
+            pick = job;
+    }
+    if (pick == NULL) return;
+    if (level == 1) throttle(pick);
+    else unthrottle(pick);
+    ticks_since_action = 0;
+}
+
+static void block_governor(sigset_t *oldmask) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, oldmask);
+}
+
+// Stop treating a job as throttled (fg, bg, or the governor being turned off) and add
+// the time it spent stopped to its total
+void governor_release(struct Job *job) {
+    sigset_t oldmask;
+    block_governor(&oldmask);
+    if (job->throttled) {
+        job->throttled_ns += monotonic_ns() - job->throttle_start_ns;
+        job->throttled = 0;
+    }
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+// Print how long a finished job spent throttled, once
+void governor_report(struct Job *job) {
+    if (job->throttle_count == 0) return;
+    printf("[%d]   throttled %d time%s, %.1fs in total: %s\n", job->job_id, job->throttle_count,
+           job->throttle_count == 1 ? "" : "s", job->throttled_ns / 1e9, job->command_line);
+    fflush(stdout);
+    job->throttle_count = 0;
+}
+
+// Parse GOVERNOR into the thresholds
+// Returns 1 if enabled, 0 if off, -1 if the setting is invalid
+static int parse_setting(const char *setting) {
+    cpu_limit = 50;
+    memory_limit = 20;
+    load_limit = 1.5;
+    tick_interval.tv_sec = 1;
+    tick_interval.tv_usec = 0;
+    if (strcmp(setting, "off") == 0 || strcmp(setting, "0") == 0) return 0;
+    if (strcmp(setting, "on") == 0) return 1;
+
+    char *copy = strdup(setting);
+    if (copy == NULL) return -1;
+    int valid = 1;
+    for (char *item = strtok(copy, ","); item != NULL && valid; item = strtok(NULL, ",")) {
+        char *value = strchr(item, '=');
+        if (value == NULL) {
+            valid = 0;
+            break;
+        }
+        *value++ = '\0';
+        double number;
+        char *end;
+        if (strcmp(item, "interval") == 0) {
+            valid = parse_duration(value, &number) == 0 && number > 0;
+            if (valid) {
+                tick_interval.tv_sec = (time_t)number;
+                tick_interval.tv_usec = (suseconds_t)((number - (double)tick_interval.tv_sec) * 1e6);
+                if (tick_interval.tv_sec == 0 && tick_interval.tv_usec == 0) tick_interval.tv_usec = 1000;
+            }
+            continue;
+        }
+        number = strtod(value, &end);
+        valid = end != value && *end == '\0' && number >= 0;
+        if (strcmp(item, "cpu") == 0) cpu_limit = number;
+        else if (strcmp(item, "memory") == 0) memory_limit = number;
+        else if (strcmp(item, "load") == 0) load_limit = number;
+        else valid = 0;
+    }
+    free(copy);
+    return valid ? 1 : -1;
+}
+
+// Follow changes to GOVERNOR: arm or disarm the sampling timer
+void update_governor(void) {
+    const char *setting = get_variable(&var_store, "GOVERNOR");
+    if (setting == NULL || setting[0] == '\0') setting = "off";
+    if (current_setting != NULL && strcmp(setting, current_setting) == 0) return;
+    free(current_setting);
+    current_setting = strdup(setting);
+
+    sigset_t oldmask;
+    block_governor(&oldmask);
+    int enable = parse_setting(setting);
+    if (enable < 0) {
+        fprintf(stderr, "GOVERNOR: %s: expected on, off or cpu=N,memory=N,load=N,interval=DURATION\n", setting);
+        enable = 0;
+    }
+
+    static int handler_installed;
+    if (enable && !handler_installed) {
+        struct sigaction sa;
+        sa.sa_handler = governor_tick;
+        sigemptyset(&sa.sa_mask);
+        sigaddset(&sa.sa_mask, SIGCHLD);  // Don't let the SIGCHLD handler run in the middle
+        sa.sa_flags = SA_RESTART;
+        sigaction(SIGALRM, &sa, NULL);
+        handler_installed = 1;
+    }
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_count = online > 0 ? online : 1;
+
+    struct itimerval timer = { .it_interval = tick_interval, .it_value = tick_interval };
+    if (!enable) memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_REAL, &timer, NULL);
+    governor_enabled = enable;
+    ticks_since_action = GOVERNOR_SETTLE_TICKS;
+
+    // Turning the governor off lets everything it stopped run again
+    if (!enable) {
+        for (int i = 0; i < job_table.job_count; i++) {
+            struct Job *job = &job_table.jobs[i];
+            if (job->throttled) unthrottle(job);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
@@ -0,0 +1,241 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/shell.h"
+
+// Background job output capture. With JOB_CAPTURE=on (or 1, or a ring size of at least 4K
+// such as 1M; "on" means 256K) every job started in the background writes its stdout and stderr into a
+// pipe the shell owns instead of the terminal, unless the command redirects them itself.
+// The shell drains the pipe into a ring in a memfd mapping, so a job never blocks on the
+// terminal and keeps at most the ring size of output; the oldest bytes are overwritten.
+// "joblog [-f] [%N]" prints what a job has written and with -f follows it until the job
+// and everything holding its output open are gone.
+//
+// Draining runs in the SIGIO handler (the pipe is O_ASYNC), so it keeps up while the
+// shell waits for a foreground job or runs a built-in. The ring is MAP_SHARED, so a
+// joblog forked into a pipeline ("joblog -f %1 | grep error") sees the shell's updates.
+// A captured job still running when the shell exits loses its reader.
+
+#define DEFAULT_RING_SIZE (256 * 1024)
+#define MIN_RING_SIZE 4096          // Smaller rings would keep only the tail of a line or two
+#define FOLLOW_POLL_NS 50000000L   // How often joblog -f looks for new output (50ms)
+
+struct JobLog {
+    int pipe_fd;                          // Shell's end of the job's output pipe; -1 after EOF
+    size_t size;                          // Bytes of ring in data[]
+    size_t map_size;
+    volatile unsigned long long written;  // Bytes captured so far; the newest size of them are kept
+    volatile sig_atomic_t closed;         // Every writer is gone
+    char data[];
+};
+
+// Bytes of ring to give a new background job: 0 when JOB_CAPTURE is off
+static size_t capture_ring_size(void) {
+    const char *setting = get_variable(&var_store, "JOB_CAPTURE");
+    if (setting == NULL || setting[0] == '\0' || strcmp(setting, "off") == 0 || strcmp(setting, "0") == 0) return 0;
+    if (strcmp(setting, "on") == 0 || strcmp(setting, "1") == 0) return DEFAULT_RING_SIZE;
+    long bytes;
+    if (parse_size(setting, &bytes) < 0 || bytes < MIN_RING_SIZE) {
+        fprintf(stderr, "JOB_CAPTURE: %s: expected on, off or a ring size of at least 4K, such as 64K or 1M\n",
+                setting);
+        return 0;
+    }
+    return (size_t)bytes;
+}
+
+// Read everything the pipe has into the ring; async-signal-safe
+static void drain(struct JobLog *log) {
+    while (log->pipe_fd >= 0) {
+        size_t pos = log->written % log->size;
+        ssize_t n = read(log->pipe_fd, log->data + pos, log->size - pos);
+        if (n > 0) {
+            log->written += n;
+        } else if (n == 0) {
+            close(log->pipe_fd);
+            log->pipe_fd = -1;
+            log->closed = 1;
+        } else if (errno != EINTR) {
+            return;  // EAGAIN: nothing more for now
+        }
+    }
+}
+
+static void sigio_handler(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    for (int i = 0; i < job_table.job_count; i++) {
+        if (job_table.jobs[i].joblog != NULL) drain(job_table.jobs[i].joblog);
+    }
+    errno = saved_errno;
+}
+
+static void block_sigio(sigset_t *oldmask) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGIO);
+    sigprocmask(SIG_BLOCK, &mask, oldmask);
+}
+
+// Set up capture for a background job about to start, if JOB_CAPTURE asks for it
+// Returns the ring, with the write end of its pipe (close-on-exec) in *write_fd, or NULL
+struct JobLog *joblog_create(int *write_fd) {
+    size_t size = capture_ring_size();
+    if (size == 0) return NULL;
+
+    static int handler_installed;
+    if (!handler_installed) {
+        struct sigaction sa;
+        sa.sa_handler = sigio_handler;
+        sigemptyset(&sa.sa_mask);
+        sigaddset(&sa.sa_mask, SIGCHLD);
+        sigaddset(&sa.sa_mask, SIGALRM);
+        sa.sa_flags = SA_RESTART;
+        sigaction(SIGIO, &sa, NULL);
+        handler_installed = 1;
+    }
+
+    size_t map_size = sizeof(struct JobLog) + size;
+    int memfd = memfd_create("mysh-joblog", MFD_CLOEXEC);
+    if (memfd < 0 || ftruncate(memfd, (off_t)map_size) < 0) {
+        perror("joblog: memfd failed");
+        if (memfd >= 0) close(memfd);
+        return NULL;
+    }
+    struct JobLog *log = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    close(memfd);  // The mapping keeps it alive
+    if (log == MAP_FAILED) {
+        perror("joblog: mmap failed");
+        return NULL;
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("joblog: pipe failed");
+        munmap(log, map_size);
+        return NULL;
+    }
+    fcntl(fds[0], F_SETOWN, getpid());
+    fcntl(fds[0], F_SETFL, O_NONBLOCK | O_ASYNC);
+    log->pipe_fd = fds[0];
+    log->size = size;
+    log->map_size = map_size;
+    log->written = 0;
+    log->closed = 0;
+    *write_fd = fds[1];
+    return log;
+}
+
+void joblog_free(struct JobLog *log) {
+    if (log == NULL) return;
+    sigset_t oldmask;
+    block_sigio(&oldmask);
+    if (log->pipe_fd >= 0) close(log->pipe_fd);
+    munmap(log, log->map_size);
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+// Write ring bytes [from, to) to stdout
+// Returns the position reached: to, or later if the writer lapped us meanwhile
+static unsigned long long print_range(struct JobLog *log, unsigned long long from, unsigned long long to,
+                                      int job_id) {
+    if (to - from > log->size) {
+        fprintf(stderr, "joblog: [%d] %llu earlier bytes were overwritten\n", job_id, to - from - log->size);
+        from = to - log->size;
+    }
+    while (from < to) {
+        size_t pos = from % log->size;
+        size_t len = log->size - pos;
+        if (len > to - from) len = to - from;
+        // In the shell the SIGIO handler may be writing; copy first, then check it didn't lap us
+        char chunk[8192];
+        if (len > sizeof(chunk)) len = sizeof(chunk);
+        memcpy(chunk, log->data + pos, len);
+        if (log->written - from > log->size) return print_range(log, from, log->written, job_id);
+        fwrite(chunk, 1, len, stdout);
+        from += len;
+    }
+    return to;
+}
+
+static volatile sig_atomic_t follow_interrupted;
+
+static void follow_interrupt_handler(int sig) {
+    (void)sig;
+    follow_interrupted = 1;
+}
+
+// joblog [-f] [%N]: print a captured job's output (default: the newest job with any);
+// -f keeps printing new output until the job's output pipe closes or Ctrl-C (status 130)
+int builtin_joblog(char **argv) {
+    int follow = 0;
+    int i = 1;
+    if (argv[i] != NULL && strcmp(argv[i], "-f") == 0) {
+        follow = 1;
+        i++;
+    }
+
+    struct Job *job = NULL;
+    if (argv[i] != NULL) {
+        const char *spec = argv[i][0] == '%' ? argv[i] + 1 : argv[i];
+        char *end;
+        long job_id = strtol(spec, &end, 10);
+        if (end != spec && *end == '\0') job = find_any_job_by_id(&job_table, (int)job_id);
+        if (job == NULL) {
+            fprintf(stderr, "joblog: %s: no such job\n", argv[i]);
+            return 1;
+        }
+        if (job->joblog == NULL) {
+            fprintf(stderr, "joblog: %s: output was not captured (set JOB_CAPTURE before starting it)\n", argv[i]);
+            return 1;
+        }
+    } else {
+        for (int k = 0; k < job_table.job_count; k++) {
+            struct Job *candidate = &job_table.jobs[k];
+            if (candidate->joblog != NULL && (job == NULL || candidate->job_id > job->job_id)) job = candidate;
+        }
+        if (job == NULL) {
+            fprintf(stderr, "joblog: no job output has been captured\n");
+            return 1;
+        }
+    }
+
+    struct JobLog *log = job->joblog;
+    unsigned long long written = log->written;
+    unsigned long long shown = print_range(log, 0, written, job->job_id);
+    fflush(stdout);
+    if (!follow) return 0;
+
+    struct sigaction sa, old_sa;
+    sa.sa_handler = follow_interrupt_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, &old_sa);
+    follow_interrupted = 0;
+
+    int status = 0;
+    while (1) {
+        int closed = log->closed;  // Read before written, so nothing after it is missed
+        written = log->written;
+        if (written != shown) {
+            shown = print_range(log, shown, written, job->job_id);
+            if (fflush(stdout) == EOF) break;  // Reader gone
+        } else if (closed) {
+            break;
+        }
+        if (follow_interrupted) {
+            status = 130;
+            break;
+        }
+        struct timespec tick = { 0, FOLLOW_POLL_NS };
+        nanosleep(&tick, NULL);
+    }
+    sigaction(SIGINT, &old_sa, NULL);
+    return status;
+}
@@ -1,4 +1,7 @@
+#define _GNU_SOURCE
 #include "../include/shell.h"
+#include <poll.h>
+#include <sys/syscall.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -8,7 +11,7 @@
 #include <errno.h>
 
 
-const char *job_commands[] = {"jobs", "fg", "bg", NULL};
+const char *job_commands[] = {"jobs", "fg", "bg", "wait", NULL};
 
 
 // Helper function to find job by ID
@@ -32,8 +35,8 @@ static struct Job* find_foreground_job(struct JobTable *job_table) {
     return NULL;
 }
 
-// Helper function to print jobs by state
-static void print_jobs_by_state(struct JobTable *job_table, int target_state) {
+// Helper function to print jobs by state; long_format adds each process's resource usage
+static void print_jobs_by_state(struct JobTable *job_table, int target_state, int long_format) {
     int found = 0;
     const char *section_header;
     const char *state_str;
@@ -52,6 +55,10 @@ static void print_jobs_by_state(struct JobTable *job_table, int target_state) {
             section_header = "=== DONE JOBS ===";
             state_str = "Done";
             break;
+        case JOB_QUEUED:
+            section_header = "=== QUEUED JOBS ===";
+            state_str = "Queued";
+            break;
         default:
             section_header = "=== UNKNOWN JOBS ===";
             state_str = "Unknown";
@@ -70,29 +77,33 @@ static void print_jobs_by_state(struct JobTable *job_table, int target_state) {
             printf("[%d]%c  %-20s %s %s\n", 
                    job->job_id,
                    (i == job_table->job_count - 1) ? '+' : '-',
-                   state_str,
+                   job->throttled ? "Throttled" : (job->timed_out && target_state == JOB_DONE) ? "Timed out" : state_str,
                    job->is_background ? "(bg)" : "(fg)",
                    job->command_line);
+            if (job->pipestat != NULL) pipestat_report(stdout, job->pipestat);
+            if (long_format && job->pid_count > 0) job_usage_report(stdout, job);
         }
     }
     if (found) printf("\n");
 }
 
 // Print complete job table for debugging
-static void print_jobs_table(struct JobTable *job_table) {
+static void print_jobs_table(struct JobTable *job_table, int long_format) {
     printf("=== COMPLETE JOB TABLE (count=%d, next_id=%d) ===\n", 
            job_table->job_count, job_table->next_job_id);
     
-    print_jobs_by_state(job_table, JOB_RUNNING);
-    print_jobs_by_state(job_table, JOB_STOPPED);
-    print_jobs_by_state(job_table, JOB_DONE);
+    print_jobs_by_state(job_table, JOB_RUNNING, long_format);
+    print_jobs_by_state(job_table, JOB_STOPPED, long_format);
+    print_jobs_by_state(job_table, JOB_QUEUED, long_format);
+    print_jobs_by_state(job_table, JOB_DONE, long_format);
     
     printf("=== END JOB TABLE ===\n");
 }
 
-// Handle 'jobs' command
-static int handle_jobs_command(struct JobTable *job_table) {
-    print_jobs_table(job_table);
+// Handle 'jobs' command; "jobs -l" also lists every process with its resource usage
+static int handle_jobs_command(struct Command *cmd, struct JobTable *job_table) {
+    int long_format = cmd->argv[1] != NULL && strcmp(cmd->argv[1], "-l") == 0;
+    print_jobs_table(job_table, long_format);
     return 1;
 }
 
@@ -115,6 +126,13 @@ static int handle_fg_command(struct Command *cmd, struct JobTable *job_table) {
         fprintf(stderr, "fg: job %d is already in foreground\n", job_id);
         return 1;
     }
+
+    // A queued job skips the queue and runs in the foreground, outside the slot limit
+    if (target_job->state == JOB_QUEUED) {
+        printf("Bringing job [%d] to foreground: %s\n", target_job->job_id, target_job->command_line);
+        start_queued_job(target_job, 1);
+        return 1;
+    }
     
     // Check if there's currently a foreground job
     struct Job *current_fg = find_foreground_job(job_table);
@@ -127,19 +145,31 @@ static int handle_fg_command(struct Command *cmd, struct JobTable *job_table) {
     
     // Move target job to foreground
     printf("Bringing job [%d] to foreground: %s\n", target_job->job_id, target_job->command_line);
+    // A governor tick in the middle would throttle a job that is on its way to the foreground
+    sigset_t alrm, oldmask;
+    sigemptyset(&alrm);
+    sigaddset(&alrm, SIGALRM);
+    sigprocmask(SIG_BLOCK, &alrm, &oldmask);
+    governor_release(target_job);
+    restore_job_priority(target_job);
     target_job->is_background = 0;
     
     if (target_job->state == JOB_STOPPED) {
         target_job->state = JOB_RUNNING;
         kill(-target_job->pids[0], SIGCONT);
     }
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+    jobshm_publish();
     
     tcsetpgrp(STDIN_FILENO, target_job->pids[0]);
     
     for (int k = 0; k < target_job->pid_count; k++) {
         if (target_job->pid_status[k] == 1) {
             int status;
-            waitpid(target_job->pids[k], &status, 0);
+            struct rusage usage;
+            if (waitpid_with_deadlines(target_job->pids[k], &status, 0, &usage) > 0)
+                job_pid_reaped(target_job, k, status, &usage);
+            target_job->pid_status[k] = 0;
         }
     }
     
@@ -162,28 +192,238 @@ static int handle_bg_command(struct Command *cmd, struct JobTable *job_table) {
         return 1;
     }
     
+    if (target_job->state == JOB_QUEUED) {
+        fprintf(stderr, "bg: job %d is queued; it starts when a JOB_SLOTS slot frees\n", job_id);
+        return 1;
+    }
     if (target_job->state != JOB_STOPPED) {
         fprintf(stderr, "bg: job %d is not stopped\n", job_id);
         return 1;
     }
     
     printf("[%d]+ %s &\n", target_job->job_id, target_job->command_line);
+    // Keep governor ticks out until the job really runs again, or our SIGCONT would
+    // resume a job the governor just throttled
+    sigset_t alrm, oldmask;
+    sigemptyset(&alrm);
+    sigaddset(&alrm, SIGALRM);
+    sigprocmask(SIG_BLOCK, &alrm, &oldmask);
+    governor_release(target_job);
+    lower_job_priority(target_job);
     target_job->is_background = 1;
     target_job->state = JOB_RUNNING;
-    
     kill(-target_job->pids[0], SIGCONT);
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+    jobshm_publish();
     return 1;
 }
 
+// A job (pid_index -1) or one process of a job that 'wait' is waiting for
+struct WaitTarget {
+    struct Job *job;
+    int job_id;       // Detects the slot being reused while we wait
+    int pid_index;
+};
+
+#define WAIT_MAX_PIDFDS 64
+#define WAIT_MAX_TARGETS 256
+
+static volatile sig_atomic_t wait_interrupted;
+
+static void wait_interrupt_handler(int sig) {
+    (void)sig;
+    wait_interrupted = 1;
+}
+
+// A job stopped by the user counts as finished so that 'wait' cannot hang on it;
+// one the governor throttled will be resumed, so it is still waited for
+static int wait_target_finished(struct WaitTarget *t) {
+    if (t->job->job_id != t->job_id) return 1;
+    if (t->pid_index >= 0) return t->job->pid_status[t->pid_index] == 0;
+    return t->job->state == JOB_DONE || (t->job->state == JOB_STOPPED && !t->job->throttled);
+}
+
+static int wait_target_status(struct WaitTarget *t) {
+    if (t->job->job_id != t->job_id) return 127;
+    if (t->pid_index >= 0 && !t->job->timed_out) return t->job->pid_exit[t->pid_index];
+    return job_exit_status(t->job);
+}
+
+// Any job with this ID, finished or not; IDs are never reused
+struct Job *find_any_job_by_id(struct JobTable *table, int job_id) {
+    for (int i = 0; i < table->job_count; i++) {
+        if (table->jobs[i].job_id == job_id) return &table->jobs[i];
+    }
+    return NULL;
+}
+
+// Resolve a 'wait' operand: %N or PID
+// Returns 0, or -1 after printing why
+static int resolve_wait_target(struct JobTable *table, const char *arg, struct WaitTarget *t) {
+    t->pid_index = -1;
+    if (arg[0] == '%') {
+        char *end;
+        long job_id = strtol(arg + 1, &end, 10);
+        t->job = (end != arg + 1 && *end == '\0') ? find_any_job_by_id(table, (int)job_id)
+                                                  : find_job_by_spec(table, arg);
+        if (t->job == NULL) {
+            fprintf(stderr, "wait: %s: no such job\n", arg);
+            return -1;
+        }
+        t->job_id = t->job->job_id;
+        return 0;
+    }
+
+    char *end;
+    long pid = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || pid <= 0) {
+        fprintf(stderr, "wait: %s: not a pid or valid job spec\n", arg);
+        return -1;
+    }
+    // The newest job wins if the PID was recycled
+    t->job = NULL;
+    for (int i = 0; i < table->job_count; i++) {
+        struct Job *job = &table->jobs[i];
+        for (int j = 0; j < job->pid_count; j++) {
+            if (job->pids[j] == pid && (t->job == NULL || job->job_id > t->job->job_id)) {
+                t->job = job;
+                t->pid_index = j;
+            }
+        }
+    }
+    if (t->job == NULL) {
+        fprintf(stderr, "wait: pid %ld is not a child of this shell\n", pid);
+        return -1;
+    }
+    t->job_id = t->job->job_id;
+    return 0;
+}
+
+// Block until every target has finished, or with any set until one has
+// Sleeps in ppoll() on pidfds of the processes being waited for; SIGCHLD is unblocked there too,
+// so stops and processes without a pidfd still wake it. Queued jobs are started as slots free.
+// Returns the index of a finished target, or -1 if interrupted
+static int wait_for_targets(struct JobTable *table, struct WaitTarget *targets, int count, int any) {
+    sigset_t block, oldmask;
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigaddset(&block, SIGINT);
+    sigprocmask(SIG_BLOCK, &block, &oldmask);
+    sigset_t waitmask = oldmask;
+    sigdelset(&waitmask, SIGCHLD);
+    sigdelset(&waitmask, SIGINT);
+    sigdelset(&waitmask, SIGALRM);  // The governor may throttle or resume jobs meanwhile
+    sigdelset(&waitmask, SIGIO);    // and captured output keeps being drained
+
+    // Ctrl-C ends the wait even though the shell itself ignores SIGINT
+    struct sigaction sa, old_sa;
+    sa.sa_handler = wait_interrupt_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, &old_sa);
+    wait_interrupted = 0;
+
+    int result = -1;
+    while (!wait_interrupted) {
+        cleanup_finished_jobs(table);
+        start_queued_jobs(table);
+
+        int pending = 0;
+        for (int k = 0; k < count; k++) {
+            if (!wait_target_finished(&targets[k])) pending++;
+            else if (result < 0) result = k;
+        }
+        if (pending == 0 || (any && result >= 0)) break;
+        result = -1;
+
+        // SIGCHLD is blocked and everything still running is unreaped, so these PIDs cannot
+        // have been recycled yet
+        struct pollfd fds[WAIT_MAX_PIDFDS + 1 + MAX_JOBS];
+        int nfds = 0;
+        for (int k = 0; k < count && nfds < WAIT_MAX_PIDFDS; k++) {
+            struct WaitTarget *t = &targets[k];
+            if (wait_target_finished(t) || t->job->state != JOB_RUNNING) continue;
+            for (int j = 0; j < t->job->pid_count && nfds < WAIT_MAX_PIDFDS; j++) {
+                if (t->job->pid_status[j] == 0 || (t->pid_index >= 0 && j != t->pid_index)) continue;
+                int fd = (int)syscall(SYS_pidfd_open, t->job->pids[j], 0);
+                if (fd >= 0) fds[nfds++] = (struct pollfd){ .fd = fd, .events = POLLIN };
+            }
+        }
+        int pidfd_count = nfds;
+        if (has_queued_jobs(table) && job_slot_fd() >= 0)
+            fds[nfds++] = (struct pollfd){ .fd = job_slot_fd(), .events = POLLIN };
+        nfds += add_deadline_fds(fds + nfds, MAX_JOBS);
+
+        ppoll(fds, nfds, NULL, &waitmask);
+        for (int k = 0; k < pidfd_count; k++) close(fds[k].fd);
+    }
+    if (wait_interrupted) result = -1;
+
+    sigaction(SIGINT, &old_sa, NULL);
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+    return result;
+}
+
+// Handle 'wait' command
+// wait             every background job; status 0
+// wait ID...       the given jobs (%N) or processes; status of the last one
+// wait -n [ID...]  the first of them (default: any background job) to finish; its status
+// 127 when there is nothing to wait for, 130 when interrupted
+static int handle_wait_command(struct Command *cmd, struct JobTable *job_table) {
+    int any = 0;
+    int first = 1;
+    if (cmd->argv[1] != NULL && strcmp(cmd->argv[1], "-n") == 0) {
+        any = 1;
+        first = 2;
+    }
+
+    struct WaitTarget targets[WAIT_MAX_TARGETS];
+    int count = 0;
+    if (cmd->argv[first] == NULL) {
+        for (int i = 0; i < job_table->job_count; i++) {
+            struct Job *job = &job_table->jobs[i];
+            if (!job->is_background || job->state == JOB_DONE || (job->state == JOB_STOPPED && !job->throttled))
+                continue;
+            targets[count++] = (struct WaitTarget){ job, job->job_id, -1 };
+        }
+        if (count == 0) return any ? 127 : 0;
+    } else {
+        int last_unknown = 0;
+        for (int i = first; cmd->argv[i] != NULL; i++) {
+            if (count == WAIT_MAX_TARGETS) {
+                fprintf(stderr, "wait: too many operands\n");
+                return 2;
+            }
+            last_unknown = resolve_wait_target(job_table, cmd->argv[i], &targets[count]) < 0;
+            if (!last_unknown) count++;
+        }
+        if (count == 0) return 127;
+        int finished = wait_for_targets(job_table, targets, count, any);
+        if (finished < 0) return 130;
+        if (any) return wait_target_status(&targets[finished]);
+        // Like bash, the status of the last operand, which is 127 if it was unknown
+        return last_unknown ? 127 : wait_target_status(&targets[count - 1]);
+    }
+
+    int finished = wait_for_targets(job_table, targets, count, any);
+    if (finished < 0) return 130;
+    return any ? wait_target_status(&targets[finished]) : 0;
+}
+
 // Checks and processes job commands 
-int process_job_command(struct Command *cmd, struct JobTable *job_table) {
+// The command's exit status goes to *status
+int process_job_command(struct Command *cmd, struct JobTable *job_table, int *status) {
     if (cmd == NULL || cmd->argv[0] == NULL) return 0;
 
     for (int i = 0; job_commands[i] != NULL; i++) {
         if (strcmp(cmd->argv[0], job_commands[i]) == 0) {
-            
+            *status = 0;
+            if (strcmp(cmd->argv[0], "wait") == 0) {
+                *status = handle_wait_command(cmd, job_table);
+                return 1;
+            }
             if (strcmp(cmd->argv[0], "jobs") == 0) {
-                return handle_jobs_command(job_table);
+                return handle_jobs_command(cmd, job_table);
             }
             else if (strcmp(cmd->argv[0], "fg") == 0) {
                 return handle_fg_command(cmd, job_table);
@@ -199,14 +439,21 @@ int process_job_command(struct Command *cmd, struct JobTable *job_table) {
 }
 
 // Initialize a new job
+// Returns: index of the job's slot in the table, or -1 if the table is full
 int createJob(struct JobTable *table, char *input, int *is_background, pid_t *pids, int pid_count) {
     int slot_index;
+    int fresh_slot = 0;
     
     // Find an available slot (either new or reuse finished job slot)
-    if (table->job_count < MAX_JOBS) {
+    // A queued job that is starting keeps its own slot and job ID
+    if (table->starting_slot >= 0) {
+        slot_index = table->starting_slot;
+        table->starting_slot = -1;
+    } else if (table->job_count < MAX_JOBS) {
         // Use next available slot
         slot_index = table->job_count;
         table->job_count++;  // Increment job count for new slot
+        fresh_slot = 1;
     } else {
         // Array is full, try to find a finished job slot to reuse
         slot_index = find_finished_job(table);
@@ -217,8 +464,32 @@ int createJob(struct JobTable *table, char *input, int *is_background, pid_t *pi
     }
 
     struct Job *new_job = &table->jobs[slot_index];
-    new_job->job_id = table->next_job_id++;  // Always increment - never reuse job IDs
+    if (new_job->state != JOB_QUEUED || pid_count == 0) {
+        new_job->job_id = table->next_job_id++;  // Always increment - never reuse job IDs
+        STAT_INC(STAT_JOBS_CREATED);
+    }
     new_job->pid_count = pid_count;
+    new_job->helper_count = 0;
+    pipestat_free(new_job->pipestat);  // Left over from the job that used this slot before
+    new_job->pipestat = NULL;
+    joblog_free(new_job->joblog);
+    new_job->joblog = NULL;
+    new_job->holds_slot = 0;
+    new_job->throttled = 0;
+    new_job->throttle_count = 0;
+    new_job->throttled_ns = 0;
+    new_job->deprioritized = 0;
+    if (!fresh_slot && new_job->deadline_fd >= 0) close(new_job->deadline_fd);
+    new_job->deadline_fd = -1;
+    new_job->timeout_stage = 0;
+    new_job->timed_out = 0;
+    new_job->time_limit = 0;
+    // A coproc's descriptors stay open after it ends, so its last output can still be read,
+    // until its slot is reused
+    for (int k = 0; k < 2; k++) {
+        if (!fresh_slot && new_job->coproc_fds[k] >= 0) close(new_job->coproc_fds[k]);
+        new_job->coproc_fds[k] = -1;
+    }
     new_job->is_background = *is_background;
     new_job->state = JOB_RUNNING;
 
@@ -230,16 +501,21 @@ int createJob(struct JobTable *table, char *input, int *is_background, pid_t *pi
     for (int i = 0; i < pid_count; i++) {
         new_job->pids[i] = pids[i];
         new_job->pid_status[i] = 1;  // Initialize as running
+        new_job->pid_exit[i] = 0;
+        new_job->pid_names[i][0] = '\0';
     }
+    new_job->timed = 0;
+    job_usage_start(new_job);
 
     *is_background = 0; // Reset for next command
 
-    return 0;
+    return slot_index;
 }
 
 // Check and update status of a single job
 // Returns: 1 if job completed, 0 if still running, -1 on error
 int cleanup_single_job(struct Job *job) {
+    if (job->state == JOB_QUEUED) return 0;
     if (job->state != JOB_RUNNING) {
         return (job->state == JOB_DONE) ? 1 : 0;  
     }
@@ -259,10 +535,10 @@ int cleanup_single_job(struct Job *job) {
     for (int j = 0; j < job->pid_count; j++) {
         if (job->pid_status[j] == 1) {  
             int status;
-            pid_t result = waitpid(job->pids[j], &status, WNOHANG);
+            struct rusage usage;
+            pid_t result = wait4(job->pids[j], &status, WNOHANG, &usage);
             if (result > 0) {
-                // Process finished
-                job->pid_status[j] = 0;
+                job_pid_reaped(job, j, status, &usage);  // Process finished
             } else if (result == 0) {
                 running_count++;
             } else if (result == -1) {
@@ -279,7 +555,7 @@ int cleanup_single_job(struct Job *job) {
     
     if (running_count == 0) {
         job->state = JOB_DONE;
-        if (job->is_background) {
+        if (job->is_background && !job->timed_out) {  // deadline_release() reports those
             printf("[%d]+  Done                    %s\n", 
                    job->job_id, job->command_line);
         }
@@ -289,16 +565,38 @@ int cleanup_single_job(struct Job *job) {
     return 0;
 }
 
+// Status of a finished job: that of the last command in its pipeline, or 124 if it timed out
+int job_exit_status(struct Job *job) {
+    if (job->timed_out) return TIMEOUT_STATUS;
+    int last_command = job->pid_count - job->helper_count - 1;
+    return last_command >= 0 ? job->pid_exit[last_command] : 0;
+}
+
 // Cleanup all finished jobs (wrapper function)
 void cleanup_finished_jobs(struct JobTable *table) {
     sigset_t mask, oldmask;
     sigemptyset(&mask);
     sigaddset(&mask, SIGCHLD);
-    sigprocmask(SIG_BLOCK, &mask, &oldmask); // Block SIGCHLD during cleanup
+    sigaddset(&mask, SIGALRM);
+    sigaddset(&mask, SIGIO);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask); // Block SIGCHLD (the governor, output capture) during cleanup
 
+    service_deadlines();
     for (int i = 0; i < table->job_count; i++) {
-        cleanup_single_job(&table->jobs[i]);
+        struct Job *job = &table->jobs[i];
+        cleanup_single_job(job);
+        if (job->holds_slot && job->state == JOB_DONE) {
+            release_job_slot();
+            job->holds_slot = 0;
+        }
+        if (job->state == JOB_DONE) {
+            governor_release(job);
+            governor_report(job);
+            deadline_release(job);
+            job_time_report(job);
+        }
     }
+    jobshm_publish();
 
     sigprocmask(SIG_SETMASK, &oldmask, NULL); // Restore signal mask
 }
@@ -313,3 +611,119 @@ int find_finished_job(struct JobTable *table) {
     }
     return -1; 
 }
+
+// Returns 1 if any background or stopped job has not finished yet
+int has_pending_jobs(struct JobTable *table) {
+    for (int i = 0; i < table->job_count; i++) {
+        if (table->jobs[i].is_background && table->jobs[i].state != JOB_DONE) return 1;
+    }
+    return 0;
+}
+
+// Resolve "%N" (or plain "N") to a job; "%%", "%+" and "%" mean the newest unfinished job
+struct Job *find_job_by_spec(struct JobTable *table, const char *spec) {
+    if (spec[0] == '%') spec++;
+    if (spec[0] == '\0' || strcmp(spec, "%") == 0 || strcmp(spec, "+") == 0) {
+        struct Job *newest = NULL;
+        for (int i = 0; i < table->job_count; i++) {
+            struct Job *job = &table->jobs[i];
+            if (job->state != JOB_DONE && (newest == NULL || job->job_id > newest->job_id)) newest = job;
+        }
+        return newest;
+    }
+
+    char *end;
+    long job_id = strtol(spec, &end, 10);
+    if (end == spec || *end != '\0') return NULL;
+    return find_job_by_id(table, (int)job_id);
+}
+
+// Send sig to every process of a job: to its process group when it has its own,
+// otherwise to each process that is still running
+// Returns 0 on success, -1 with errno set on failure
+int signal_job(struct Job *job, int sig) {
+    // Signalling a job that has not started takes it off the queue
+    if (job->state == JOB_QUEUED) {
+        if (sig != 0 && sig != SIGCONT) {
+            job->state = JOB_DONE;
+            printf("[%d]+  Removed from queue      %s\n", job->job_id, job->command_line);
+        }
+        return 0;
+    }
+    if (getpgid(job->pids[0]) == job->pids[0]) {
+        if (kill(-job->pids[0], sig) < 0) return -1;
+    } else {
+        for (int i = 0; i < job->pid_count; i++) {
+            if (job->pid_status[i] == 1 && kill(job->pids[i], sig) < 0 && errno != ESRCH) return -1;
+        }
+    }
+    if (sig == SIGCONT && job->state == JOB_STOPPED) {
+        job->state = JOB_RUNNING;
+        jobshm_stale = 1;  // The governor's SIGALRM handler gets here too
+    }
+    return 0;
+}
+
+// Put a background pipeline on the queue until a JOB_SLOTS slot is free
+// Returns 0, or -1 if the job table is full
+int queue_job(struct JobTable *table, const char *command_line) {
+    int background = 1;
+    int slot = createJob(table, (char *)command_line, &background, NULL, 0);
+    if (slot < 0) return -1;
+    struct Job *job = &table->jobs[slot];
+    job->state = JOB_QUEUED;
+    jobshm_publish();
+    printf("[%d] queued\n", job->job_id);
+    fflush(stdout);
+    return 0;
+}
+
+int has_queued_jobs(struct JobTable *table) {
+    for (int i = 0; i < table->job_count; i++) {
+        if (table->jobs[i].state == JOB_QUEUED) return 1;
+    }
+    return 0;
+}
+
+// Start queued jobs in the order they were queued while slots are free
+void start_queued_jobs(struct JobTable *table) {
+    while (1) {
+        struct Job *oldest = NULL;
+        for (int i = 0; i < table->job_count; i++) {
+            struct Job *job = &table->jobs[i];
+            if (job->state == JOB_QUEUED && (oldest == NULL || job->job_id < oldest->job_id)) oldest = job;
+        }
+        if (oldest == NULL) return;
+
+        int slot = acquire_job_slot();
+        if (slot == 0) return;
+        start_queued_job(oldest, 0);
+        if (oldest->state == JOB_QUEUED) oldest->state = JOB_DONE;  // Could not start; don't retry forever
+        if (slot == 1) {
+            if (oldest->state == JOB_DONE) release_job_slot();
+            else oldest->holds_slot = 1;
+        }
+    }
+}
+
+// Block until every queued job has been started (end of a script or -c string)
+void wait_for_job_queue(struct JobTable *table) {
+    sigset_t chld, oldmask;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+
+    while (1) {
+        cleanup_finished_jobs(table);
+        start_queued_jobs(table);
+        if (!has_queued_jobs(table)) return;
+
+        // Wake on a child exiting, or on a token coming back from a make outside our jobs
+        sigprocmask(SIG_BLOCK, &chld, &oldmask);
+        struct pollfd pfd = { .fd = job_slot_fd(), .events = POLLIN };
+        sigset_t waitmask = oldmask;
+        sigdelset(&waitmask, SIGCHLD);
+        struct timespec tick = { 0, 100000000 };  // Also covers a SIGCHLD that came before the block
+        ppoll(&pfd, pfd.fd >= 0 ? 1 : 0, &tick, &waitmask);
+        sigprocmask(SIG_SETMASK, &oldmask, NULL);
+    }
+}
@@ -0,0 +1,153 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/shell.h"
+
+// Background job slots. JOB_SLOTS=N allows N background jobs to run at once; the
+// rest wait in the job table as JOB_QUEUED. The slots are tokens in a FIFO that is
+// also a GNU make jobserver: MAKEFLAGS hands it to children, so a "make -j" started
+// from the shell takes its extra jobs from the same budget as the shell's own jobs.
+//
+// Each running background job holds one token; a make inside it uses that token as
+// its implicit one. MAKEFLAGS names the FIFO by inherited descriptors
+// (--jobserver-auth=R,W), which GNU make 4.3 and 4.4 both accept; make 4.3 rejects the
+// newer "fifo:PATH" form. The FIFO's path is exported as MYSH_JOBSERVER for tools
+// that open it by name.
+
+#define JOBSERVER_FD_BASE 10     // Keep the inherited descriptor clear of 0-9 for redirections
+
+static int pool_limit;           // Tokens the pool was built for; 0 before it exists
+static int token_fd = -1;        // Non-blocking, close-on-exec: the shell takes tokens here
+static int auth_fd = -1;         // Blocking and inherited: children (make) use this one
+static int token_debt;           // Tokens to swallow after JOB_SLOTS was lowered
+static int holders;              // Tokens held by our background jobs
+static int pool_failed;          // No FIFO: slots are only counted
+static char fifo_dir[64];
+static pid_t fifo_owner;         // Forked children that exit() must not remove the shell's FIFO
+
+static void remove_fifo(void) {
+    if (getpid() != fifo_owner) return;
+    char path[96];
+    snprintf(path, sizeof(path), "%s/fifo", fifo_dir);
+    unlink(path);
+    rmdir(fifo_dir);
+}
+
+// JOB_SLOTS as a number of background jobs; 0 means no limit
+int job_slot_limit(void) {
+    const char *setting = get_variable(&var_store, "JOB_SLOTS");
+    if (setting == NULL || setting[0] == '\0') return 0;
+    char *end;
+    long limit = strtol(setting, &end, 10);
+    if (*end != '\0' || limit < 0 || limit > 4096) {
+        fprintf(stderr, "JOB_SLOTS: %s: expected a number of jobs\n", setting);
+        return 0;
+    }
+    return (int)limit;
+}
+
+// Put n tokens into the pool, paying off any debt first
+static void add_tokens(int n) {
+    while (n > 0 && token_debt > 0) {
+        n--;
+        token_debt--;
+    }
+    char tokens[64];
+    memset(tokens, '+', sizeof(tokens));
+    while (n > 0) {
+        int chunk = n < (int)sizeof(tokens) ? n : (int)sizeof(tokens);
+        if (write(auth_fd, tokens, chunk) != chunk) break;
+        n -= chunk;
+    }
+}
+
+// Create the FIFO on first use, then follow changes to JOB_SLOTS
+static void sync_pool(int limit) {
+    if (pool_failed) return;
+    if (pool_limit == 0) {
+        snprintf(fifo_dir, sizeof(fifo_dir), "/tmp/mysh-jobserver-XXXXXX");
+        char path[96];
+        if (mkdtemp(fifo_dir) == NULL) {
+            perror("jobserver: mkdtemp failed");
+            pool_failed = 1;
+            return;
+        }
+        snprintf(path, sizeof(path), "%s/fifo", fifo_dir);
+        int fd = -1;
+        if (mkfifo(path, 0600) == 0) {
+            // Read end first (O_NONBLOCK opens without a writer), then the shared read-write end
+            token_fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            fd = open(path, O_RDWR);
+        }
+        if (token_fd < 0 || fd < 0) {
+            perror("jobserver: fifo failed");
+            if (token_fd >= 0) close(token_fd);
+            if (fd >= 0) close(fd);
+            token_fd = -1;
+            rmdir(fifo_dir);
+            pool_failed = 1;
+            return;
+        }
+        auth_fd = fcntl(fd, F_DUPFD, JOBSERVER_FD_BASE);
+        close(fd);
+        fifo_owner = getpid();
+        atexit(remove_fifo);
+        set_variable(&var_store, "MYSH_JOBSERVER", path, 1);
+        add_tokens(limit);
+    } else if (limit > pool_limit) {
+        add_tokens(limit - pool_limit);
+    } else if (limit < pool_limit) {
+        token_debt += pool_limit - limit;
+        char token;
+        while (token_debt > 0 && read(token_fd, &token, 1) == 1) token_debt--;
+    }
+
+    if (limit != pool_limit) {
+        char flags[96];
+        snprintf(flags, sizeof(flags), " -j%d --jobserver-auth=%d,%d", limit, auth_fd, auth_fd);
+        set_variable(&var_store, "MAKEFLAGS", flags, 1);
+        pool_limit = limit;
+    }
+}
+
+// Create or resize the pool after JOB_SLOTS changes, so MAKEFLAGS is in place before
+// the first command that might run make
+void update_job_slots(void) {
+    int limit = job_slot_limit();
+    if (limit > 0) sync_pool(limit);
+}
+
+// Take a slot for a new background job
+// Returns 1 if one was taken (release it when the job ends), 0 if none is free,
+// -1 if there is no limit
+int acquire_job_slot(void) {
+    int limit = job_slot_limit();
+    if (limit == 0) return -1;
+    sync_pool(limit);
+
+    if (pool_failed) {
+        if (holders >= limit) return 0;
+    } else {
+        char token;
+        while (token_debt > 0 && read(token_fd, &token, 1) == 1) token_debt--;
+        if (token_debt > 0 || read(token_fd, &token, 1) != 1) return 0;
+    }
+    holders++;
+    return 1;
+}
+
+void release_job_slot(void) {
+    if (holders == 0) return;
+    holders--;
+    if (!pool_failed && pool_limit > 0) add_tokens(1);
+}
+
+// Descriptor that becomes readable when a token comes back, or -1
+int job_slot_fd(void) {
+    return token_fd;
+}
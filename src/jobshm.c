@@ -0,0 +1,109 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "../include/shell.h"
+
+// Job table export. The shell mirrors its live jobs (running, stopped, throttled or
+// queued) into /dev/shm/mysh-PID so mysh-top, or anything else that knows the layout in
+// shell.h, can show what every shell on the host is running. The segment is rewritten
+// whenever a job changes state and removed when the shell exits or execs in place.
+//
+// It is a seqlock: the shell makes seq odd, rewrites the table and makes seq even again.
+// A reader copies the segment and keeps the copy only if seq was even and unchanged across
+// the copy, otherwise it tries again. The shell never waits for readers. The segment is
+// mode 0600, so other users (except root) cannot read command lines from it.
+
+volatile sig_atomic_t jobshm_stale;  // Set when a signal handler changed the job table
+
+static struct JobShmSegment *segment;
+static pid_t owner_pid;   // Subshells inherit the mapping but must not write to it
+static char segment_name[64];
+
+// Create this shell's segment; without one the shell just isn't visible to mysh-top
+void jobshm_open(void) {
+    owner_pid = getpid();
+    snprintf(segment_name, sizeof(segment_name), "/%s%ld", JOBSHM_PREFIX, (long)owner_pid);
+    int fd = shm_open(segment_name, O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+    if (ftruncate(fd, sizeof(struct JobShmSegment)) < 0) {
+        close(fd);
+        shm_unlink(segment_name);
+        return;
+    }
+    struct JobShmSegment *seg = mmap(NULL, sizeof(*seg), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg == MAP_FAILED) {
+        shm_unlink(segment_name);
+        return;
+    }
+    seg->shell_pid = owner_pid;
+    seg->shell_start_ns = monotonic_ns();
+    seg->version = JOBSHM_VERSION;
+    __atomic_store_n(&seg->magic, JOBSHM_MAGIC, __ATOMIC_RELEASE);  // Last: the segment is ready
+    segment = seg;
+    atexit(jobshm_close);
+}
+
+// Remove the segment: at exit, and before the shell execs another program in its place
+void jobshm_close(void) {
+    if (segment == NULL || getpid() != owner_pid) return;
+    munmap(segment, sizeof(*segment));
+    segment = NULL;
+    shm_unlink(segment_name);
+}
+
+static void write_entry(struct JobShmEntry *entry, const struct Job *job) {
+    int same_job = entry->job_id == job->job_id;
+    entry->job_id = job->job_id;
+    entry->state = job->state;
+    entry->throttled = job->throttled;
+    entry->is_background = job->is_background;
+    entry->pid_count = job->pid_count;
+    entry->start_ns = job->start_ns;
+    // A job that has exited its process group can't be asked again; keep what was seen
+    pid_t pgid = job->pid_count > 0 ? getpgid(job->pids[0]) : 0;
+    if (pgid > 0 || !same_job) entry->pgid = pgid > 0 ? pgid : 0;
+    size_t len = strnlen(job->command_line, sizeof(entry->command) - 1);
+    memcpy(entry->command, job->command_line, len);
+    entry->command[len] = '\0';
+}
+
+// Rewrite the segment from the job table. Signal handlers don't call this: they set
+// jobshm_stale and the main loop publishes for them (jobshm_sync)
+void jobshm_publish(void) {
+    if (segment == NULL || getpid() != owner_pid) return;
+
+    // The handlers must not change the job table in the middle of this
+    sigset_t mask, oldmask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+    jobshm_stale = 0;
+
+    unsigned int seq = __atomic_load_n(&segment->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&segment->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    int count = 0;
+    for (int i = 0; i < job_table.job_count; i++) {
+        const struct Job *job = &job_table.jobs[i];
+        if (job->state == JOB_DONE) continue;
+        write_entry(&segment->jobs[count++], job);
+    }
+    segment->job_count = count;
+    segment->updated_ns = monotonic_ns();
+
+    __atomic_store_n(&segment->seq, seq + 2, __ATOMIC_RELEASE);
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+// Publish what the signal handlers changed since the last publish
+void jobshm_sync(void) {
+    if (jobshm_stale) jobshm_publish();
+}
@@ -1,5 +1,6 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,7 +19,113 @@ struct JobTable job_table;
 extern char **environ;          // Original environment variables
 struct VariableStore var_store; // Store for shell variables
 
-int main() {
+// Where command lines (and here-document bodies) come from.
+// A -c string has no stream; a script file is read without prompts.
+static FILE *input_stream;
+static int show_prompt = 1;
+
+// At an interactive prompt, wait for input in ppoll() so what happens meanwhile is acted
+// on without waiting for the user to press Enter: a job stopping, continuing or finishing
+// (SIGCHLD) or the governor throttling one (SIGALRM) is published for mysh-top, and with
+// jobs queued for JOB_SLOTS or job deadlines armed, a make returning a token or a
+// deadline passing starts or ends jobs
+static void wait_for_input(FILE *stream) {
+    struct pollfd pfds[2 + MAX_JOBS];
+    if (!isatty(fileno(stream))) return;
+
+    sigset_t async, oldmask, waitmask;
+    sigemptyset(&async);
+    sigaddset(&async, SIGCHLD);
+    sigaddset(&async, SIGALRM);
+    sigprocmask(SIG_BLOCK, &async, &oldmask);
+    waitmask = oldmask;
+    sigdelset(&waitmask, SIGCHLD);
+    sigdelset(&waitmask, SIGALRM);
+
+    while (1) {
+        jobshm_sync();
+        int queued = has_queued_jobs(&job_table);
+        int deadlines = add_deadline_fds(pfds + 2, MAX_JOBS);
+        pfds[0] = (struct pollfd){ .fd = fileno(stream), .events = POLLIN };
+        pfds[1] = (struct pollfd){ .fd = queued ? job_slot_fd() : -1, .events = POLLIN };
+        int ready = ppoll(pfds, 2 + deadlines, NULL, &waitmask);
+        if (ready > 0 && pfds[0].revents) break;
+        if (queued || deadlines > 0) {
+            cleanup_finished_jobs(&job_table);
+            start_queued_jobs(&job_table);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+// Print prompt and read one line of input without its trailing newline
+// Returns a malloc'd line, or NULL at end of input
+char *read_input_line(const char *prompt) {
+    char *line = NULL;
+    size_t len = 0;
+
+    if (input_stream == NULL) return NULL;
+    if (show_prompt) {
+        printf("%s", prompt);
+        fflush(stdout);
+    }
+    wait_for_input(input_stream);
+
+    // SA_RESTART should handle EINTR automatically
+    if (getline(&line, &len, input_stream) == -1) {
+        free(line);
+        return NULL;
+    }
+    line[strcspn(line, "\n")] = 0;
+    return line;
+}
+
+// Returns 1 once the input stream has nothing left to read
+static int at_end_of_input(FILE *stream) {
+    int c = getc(stream);
+    if (c == EOF) return 1;
+    ungetc(c, stream);
+    return 0;
+}
+
+// Run every line of a script file. Blank lines and # comments are skipped.
+// The last line may replace the shell with its final command instead of forking it.
+static int run_script(const char *path) {
+    input_stream = fopen(path, "r");
+    if (input_stream == NULL) {
+        fprintf(stderr, "mysh: %s: ", path);
+        perror("");
+        return 127;
+    }
+    show_prompt = 0;
+
+    char *input;
+    while (!shell_should_exit && (input = read_input_line("")) != NULL) {
+        char *start = input + strspn(input, " \t");
+        if (*start != '\0' && *start != '#') {
+            tail_exec_enabled = at_end_of_input(input_stream);
+            unsigned long long start = monotonic_ns();
+            execute_line(input);
+            record_latency(LATENCY_COMMAND, start);
+            TRACE_END(TRACE_COMMAND, start, input);
+            tail_exec_enabled = 0;
+            arena_free(&line_arena);
+        }
+        free(input);
+        cleanup_finished_jobs(&job_table);
+        start_queued_jobs(&job_table);
+    }
+    wait_for_job_queue(&job_table);  // Queued jobs still run before the script ends
+
+    fclose(input_stream);
+    input_stream = NULL;
+    return last_exit_status;
+}
+
+int main(int argc, char *argv[]) {
+    input_stream = stdin;
+    shellstat_init();
+
     // Initialize variable store (includes environment variables)
     if (init_variable_store(&var_store) < 0) {
         fprintf(stderr, "Failed to initialize variable store\n");
@@ -28,6 +135,7 @@ int main() {
     // Initialize JobTable
     job_table.job_count = 0;
     job_table.next_job_id = 1;
+    job_table.starting_slot = -1;
 
     // Signal handling
         // handle SIGINT and SIGTSTP
@@ -47,247 +155,58 @@ int main() {
         sigaction(SIGTTOU, &sa, NULL);  
         sigaction(SIGTTIN, &sa, NULL); 
 
-    while(1){
-        // Cleanup finished jobs before processing new input
-        cleanup_finished_jobs(&job_table);
-
-        // Initialize pipeline
-        struct Pipeline *pipeline = malloc(sizeof(struct Pipeline));
-        pipeline->pipe_count = 0;
-        initialze_Command(&pipeline->commands[0]);
-
-        int pipes[MAX_COMMANDS - 1][2];  
-        pid_t child_pids[MAX_COMMANDS];  // Store child PIDs
-
-        char *input = NULL;
-        size_t len = 0;
-
-        int input_has_background_process = 0;
-
-        printf("mysh> ");
-        fflush(stdout);
-
-        // Read a line of input; SA_RESTART should handle EINTR automatically
-        if(getline(&input, &len, stdin) == -1 || input[0] == '\n') {
-            printf("\n");
-            break;
-        }
-        input[strcspn(input, "\n")] = 0;
-
-        parse_input(input, pipeline, &input_has_background_process);
-
-        // Debugging output
-        /*for (int k = 0; k <= pipeline->pipe_count; ++k) {
-            printf("DEBUG: command %d:", k);
-            for (int a = 0; pipeline->commands[k].argv[a]; ++a)
-                printf(" '%s'", pipeline->commands[k].argv[a]);
-            printf("\n");
-        }*/
-        
-        // Create pipes if needed (for pipe_count > 0, we need pipe_count pipes)
-        if(pipeline->pipe_count > 0) {
-            for (int i = 0; i < pipeline->pipe_count; i++) {
-                if (pipe(pipes[i]) < 0) {
-                    perror("pipe failed");
-                    exit(1);
-                }
-            }
+    // mysh -c "command line": run it and exit with its status
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "mysh: -c: option requires an argument\n");
+            return 2;
         }
+        input_stream = NULL;
+        tail_exec_enabled = 1;
+        execute_line(argv[2]);
+        wait_for_job_queue(&job_table);
+        arena_free(&line_arena);
+        free_variable_store(&var_store);
+        return last_exit_status;
+    }
 
-        //iterate through commands in the pipeline (pipe_count + 1 total commands)
-        int child_count = 0;
-        int should_exit = 0;
-        for (int i = 0; i <= pipeline->pipe_count; i++) {
-            struct Command *cmd = &pipeline->commands[i];
-            if (cmd->argv[0] == NULL) continue; 
-            if (strncmp(cmd->argv[0], "exit", 4) == 0) {
-                should_exit = 1; //set flag for outer loop
-                break;
-            }
-
-            // handle built-in commands
-            int builtin_result = process_built_in_command(cmd);
-            if (builtin_result == 0 || builtin_result == -1) continue;  // Built-in found (success or error)
-
-            // check and handle job commands
-            if (process_job_command(cmd, &job_table) == 1) continue;
-
-            // it's a regular command. fork
-            pid_t pid = fork();
-            if (pid < 0) perror("fork failed");
-            
-            //Child process
-            if (pid == 0) { 
-                // Restore default signal handling for children
-                struct sigaction sa_default;
-                sa_default.sa_handler = SIG_DFL;
-                sigemptyset(&sa_default.sa_mask);
-                sa_default.sa_flags = 0;
-                sigaction(SIGINT, &sa_default, NULL);
-                sigaction(SIGTSTP, &sa_default, NULL);
-
-                // Handle input redirection
-                if (cmd->redirect_flags & REDIRECT_IN) {
-                    int fd = open(cmd->redirects.input_file, O_RDONLY);
-                    if (fd == -1) { perror("Input redirection failed"); exit(1); }
-                    dup2(fd, STDIN_FILENO);
-                    close(fd);
-                }
-                if (cmd->redirect_flags & REDIRECT_OUT) {
-                    int fd = open(cmd->redirects.output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                    if (fd == -1) { perror("Output redirection failed"); exit(1); }
-                    dup2(fd, STDOUT_FILENO);
-                    close(fd);
-                }
-                if (cmd->redirect_flags & REDIRECT_APP) {
-                    int fd = open(cmd->redirects.append_file, O_WRONLY | O_CREAT | O_APPEND, 0644);
-                    if (fd == -1) { perror("Append redirection failed"); exit(1); }
-                    dup2(fd, STDOUT_FILENO);
-                    close(fd);
-                }
-
-                // Handle pipes
-                if(pipeline->pipe_count > 0) {
-                    if (i > 0)
-                        dup2(pipes[i - 1][0], STDIN_FILENO); // Read end of previous pipe
-                    if (i < pipeline->pipe_count) 
-                        dup2(pipes[i][1], STDOUT_FILENO); // Write end of current pipe
-                    
-                    // Close all pipe descriptors in child
-                    for (int j = 0; j < pipeline->pipe_count; j++) {
-                        close(pipes[j][0]);
-                        close(pipes[j][1]);
-                    }
-                }
+    // Visible to mysh-top; a -c string is usually gone too soon to be worth it
+    jobshm_open();
 
-                if (pipeline->pipe_count > 0 || input_has_background_process) 
-                    if (i == 0) setpgid(0, 0);  // Create new process group
-                
-                // Build environment array for child process
-                char **child_env = build_environ_array(&var_store);
-                if (child_env == NULL) {
-                    fprintf(stderr, "Failed to build environment for child process\n");
-                    exit(1);
-                }
-                //char **child_env = environ;  // Use original environment for testing
-                                
-                // Identify path to executable
-                char *full_path = find_executable_in_path(cmd->argv[0], &var_store);
-                if (full_path == NULL) {
-                    fprintf(stderr, "%s: command not found\n", cmd->argv[0]);
-                    exit(127);
-                }
-                execve(full_path, cmd->argv, child_env);
-    
-                fprintf(stderr, "%s: command not found\n", cmd->argv[0]);
-                exit(127);  // Standard exit code for "command not found"
+    // mysh script: run the file non-interactively
+    if (argc > 1) {
+        int status = run_script(argv[1]);
+        free_variable_store(&var_store);
+        return status;
+    }
 
-            } else {
-                // Parent Process
-                // Set pgid for job control only when needed
-                if (pipeline->pipe_count > 0 || input_has_background_process) {
-                    if (i == 0) {
-                        setpgid(pid, pid);  
-                    } else {
-                        setpgid(pid, child_pids[0]); 
-                    }
-                }
+    while(1){
+        // Cleanup finished jobs before processing new input; their slots go to queued jobs
+        cleanup_finished_jobs(&job_table);
+        start_queued_jobs(&job_table);
 
-                //store child PIDs
-                child_pids[child_count++] = pid;
-            }
-        }
-        
-        // handle exit in outer loop
-        if (should_exit) {
+        // Read a line of input; an empty line or end of input ends the session
+        char *input = read_input_line("mysh> ");
+        if (input == NULL || input[0] == '\0') {
+            printf("\n");
             free(input);
-            free(pipeline);
             break;
         }
-    
-        // Close all pipes in parent process
-        if(pipeline->pipe_count > 0) {
-            for (int i = 0; i < pipeline->pipe_count; i++) {
-                close(pipes[i][0]);
-                close(pipes[i][1]);
-            }
-        }
 
-        if (child_count > 0) {
-            if(createJob(&job_table, input, &input_has_background_process, child_pids, child_count) == -1) {
-                for (int i = 0; i < child_count; i++) {
-                    int status;
-                    waitpid(child_pids[i], &status, 0);
-                }
-                break;
-            }
-
-            struct Job *job = &job_table.jobs[job_table.job_count - 1];
-
-            if (job->is_background) {
-                // Background job (simple or pipeline) - print info, don't wait
-                printf("[%d] %ld\n", job->job_id, (long)job->pids[0]);
-                fflush(stdout);
-            } 
-            // Simple foreground command - no process group change needed; must wait for it
-            else if (pipeline->pipe_count == 0) {
-                for (int i = 0; i < child_count; i++) {
-                    int status;
-                    waitpid(child_pids[i], &status, 0);
-                    job->pid_status[i] = 0; 
-                }
-                job->state = JOB_DONE;
-
-            } else {
-                // Foreground pipeline - use process group and wait
-                tcsetpgrp(STDIN_FILENO, job->pids[0]);
-            
-                // Block SIGCHLD to prevent race condition with signal handler
-                sigset_t mask, oldmask;
-                sigemptyset(&mask);
-                sigaddset(&mask, SIGCHLD);
-                sigprocmask(SIG_BLOCK, &mask, &oldmask);
-            
-                // Pipeline - wait for process group 
-                int status;
-                waitpid(-job->pids[0], &status, 0);  // Wait for process group
-            
-                // Restore signal mask
-                sigprocmask(SIG_SETMASK, &oldmask, NULL);
-                
-                // Only restore terminal control if we changed it
-                // Small delay to ensure process group is fully cleaned up
-                struct timespec ts = {0, 1000000};  // 1 millisecond
-                nanosleep(&ts, NULL);                
-                
-                pid_t shell_pg = getpgrp();
-                
-                // Block SIGTTOU temporarily
-                sigset_t tto_mask, old_tto_mask;
-                sigemptyset(&tto_mask);
-                sigaddset(&tto_mask, SIGTTOU);
-                sigprocmask(SIG_BLOCK, &tto_mask, &old_tto_mask);
-
-                // Attempt to set the terminal's foreground process group
-                tcsetpgrp(STDIN_FILENO, shell_pg);
-
-                // Restore the original signal mask
-                sigprocmask(SIG_SETMASK, &old_tto_mask, NULL);
-                
-                job->state = JOB_DONE;
-                for (int i = 0; i < child_count; i++) 
-                    job->pid_status[i] = 0;  
-            }
-        }
+        // From Enter until the next prompt
+        unsigned long long start = monotonic_ns();
+        execute_line(input);
+        record_latency(LATENCY_COMMAND, start);
+        TRACE_END(TRACE_COMMAND, start, input);
 
+        // Everything parsed or expanded for this line lives in the arena
+        arena_free(&line_arena);
         free(input);
-        
-        for (int i = 0; i <= pipeline->pipe_count; i++)
-            initialze_Command(&pipeline->commands[i]);
-        pipeline->pipe_count = 0;
-        
-        free(pipeline);
+
+        if (shell_should_exit) break;
     }
+    if (!isatty(STDIN_FILENO)) wait_for_job_queue(&job_table);  // Piped input: nobody could fg them later
     
     free_variable_store(&var_store);
+    return last_exit_status;
 }
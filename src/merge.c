@@ -0,0 +1,174 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../include/shell.h"
+
+// merge [-t] 'cmd' 'cmd'...: fan-in of concurrent producers.
+// Every argument is a command line of its own, started at once in a subshell with its
+// stdout on a pipe. One epoll loop reads whichever pipes are ready and passes on only
+// whole lines, each batch in a single write, so lines from different producers never
+// mix. With -t every line is prefixed with "[N] ", N being the producer's position.
+// merge always runs in its own process (see builtin_needs_process), so it and its
+// producers share one job: "merge 'tail -f a' 'tail -f b' | grep x &" is job %1.
+
+#define MAX_MERGE_PRODUCERS 64
+#define MERGE_READ_SIZE (64 * 1024)
+
+struct Producer {
+    pid_t pid;
+    int fd;                 // Read end of its stdout; -1 at EOF
+    struct Buffer partial;  // Bytes after the last newline seen
+};
+
+// Write all of buf to stdout; returns -1 once the reader is gone
+static int merge_write(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Pass on the complete lines in p->partial (everything, newline-terminated, when final)
+static int emit_lines(struct Producer *p, int index, int tagged, int final, struct Buffer *out) {
+    size_t end = p->partial.len;
+    if (!final) {
+        while (end > 0 && p->partial.data[end - 1] != '\n') end--;
+    }
+    if (end == 0) return 0;
+
+    out->len = 0;
+    if (tagged) {
+        char tag[16];
+        int tag_len = snprintf(tag, sizeof(tag), "[%d] ", index + 1);
+        size_t start = 0;
+        while (start < end) {
+            char *nl = memchr(p->partial.data + start, '\n', end - start);
+            size_t line_end = nl ? (size_t)(nl - p->partial.data) + 1 : end;
+            if (buf_append(out, tag, tag_len) < 0 ||
+                buf_append(out, p->partial.data + start, line_end - start) < 0) return -1;
+            start = line_end;
+        }
+    } else if (buf_append(out, p->partial.data, end) < 0) {
+        return -1;
+    }
+    if (out->data[out->len - 1] != '\n' && buf_putc(out, '\n') < 0) return -1;  // A final unterminated line
+
+    memmove(p->partial.data, p->partial.data + end, p->partial.len - end);
+    p->partial.len -= end;
+    return merge_write(out->data, out->len);
+}
+
+int builtin_merge(char **argv) {
+    int tagged = 0, first = 1;
+    if (argv[1] != NULL && strcmp(argv[1], "-t") == 0) {
+        tagged = 1;
+        first = 2;
+    }
+    int count = 0;
+    while (argv[first + count] != NULL) count++;
+    if (count == 0 || count > MAX_MERGE_PRODUCERS) {
+        fprintf(stderr, "merge: usage: merge [-t] 'command' ['command'...] (at most %d)\n", MAX_MERGE_PRODUCERS);
+        return 2;
+    }
+
+    signal(SIGCHLD, SIG_DFL);  // merge runs in its own process; it reaps its producers itself
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror("merge: epoll_create1 failed");
+        return 1;
+    }
+
+    struct Producer producers[MAX_MERGE_PRODUCERS];
+    int open_count = 0, status = 0;
+    for (int i = 0; i < count; i++) {
+        struct Producer *p = &producers[i];
+        int fds[2];
+        p->pid = -1;
+        p->fd = -1;
+        buf_init(&p->partial);
+        if (pipe2(fds, O_CLOEXEC) < 0) {
+            perror("merge: pipe failed");
+            status = 1;
+            continue;
+        }
+        p->pid = spawn_command_text(argv[first + i], fds[1]);
+        close(fds[1]);
+        if (p->pid < 0) {
+            close(fds[0]);
+            status = 1;
+            continue;
+        }
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = i };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev);
+        p->fd = fds[0];
+        open_count++;
+    }
+
+    signal(SIGPIPE, SIG_IGN);  // Set after the producers start, which keep the default; see below
+
+    struct Buffer out;
+    buf_init(&out);
+    int broken = 0;  // Our reader went away
+    struct epoll_event events[MAX_MERGE_PRODUCERS];
+    while (open_count > 0 && !broken) {
+        int ready = epoll_wait(epfd, events, MAX_MERGE_PRODUCERS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("merge: epoll_wait failed");
+            break;
+        }
+        for (int k = 0; k < ready && !broken; k++) {
+            int i = events[k].data.u32;
+            struct Producer *p = &producers[i];
+            if (buf_reserve(&p->partial, MERGE_READ_SIZE) < 0) {
+                broken = 1;
+                break;
+            }
+            ssize_t n = read(p->fd, p->partial.data + p->partial.len, p->partial.cap - p->partial.len - 1);
+            if (n < 0 && errno == EINTR) continue;
+            if (n > 0) {
+                p->partial.len += n;
+                if (emit_lines(p, i, tagged, 0, &out) < 0) broken = 1;
+                continue;
+            }
+            // EOF (or error): flush a last unterminated line and stop watching
+            if (emit_lines(p, i, tagged, 1, &out) < 0) broken = 1;
+            epoll_ctl(epfd, EPOLL_CTL_DEL, p->fd, NULL);
+            close(p->fd);
+            p->fd = -1;
+            open_count--;
+        }
+    }
+    close(epfd);
+    buf_free(&out);
+
+    // Closing our ends makes producers that are still writing get SIGPIPE
+    for (int i = 0; i < count; i++) {
+        struct Producer *p = &producers[i];
+        if (p->fd >= 0) close(p->fd);
+        buf_free(&p->partial);
+        if (p->pid < 0) continue;
+        int wstatus = 0;
+        while (waitpid(p->pid, &wstatus, 0) < 0) {
+            if (errno != EINTR) break;
+        }
+        int code = wait_status_to_exit(wstatus);
+        if (code > status) status = code;
+    }
+    if (broken) {
+        signal(SIGPIPE, SIG_DFL);
+        raise(SIGPIPE);  // End like any other writer whose reader quit
+    }
+    return status;
+}
@@ -0,0 +1,148 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/shell.h"
+
+// mysh-top: list the live jobs of every mysh on the host from the segments the shells
+// export to /dev/shm (see jobshm.c). Segments are mapped read-only and read with the
+// seqlock protocol, so a shell is never held up by this; a shell that is mid-update on
+// every attempt is skipped for that refresh. Segments left by shells that were killed
+// are ignored, and a running job whose process group is gone shows as Done even if its
+// shell, idle at a prompt, has not republished yet.
+//
+// Usage: mysh-top [-1] [-d SECONDS]
+//   -1          print once and exit
+//   -d SECONDS  refresh interval (default 1)
+
+#define SHM_DIR "/dev/shm"
+#define READ_ATTEMPTS 100
+
+// The shell's monotonic_ns() lives in utils.c, which this standalone monitor doesn't link
+unsigned long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Copy a consistent snapshot of a shell's segment
+// Returns 0, or -1 if it is not a segment or the shell kept it busy
+static int read_segment(const char *name, struct JobShmSegment *out) {
+    char path[300];
+    snprintf(path, sizeof(path), "%s/%s", SHM_DIR, name);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct JobShmSegment)) {
+        close(fd);
+        return -1;
+    }
+    const struct JobShmSegment *seg = mmap(NULL, sizeof(*seg), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg == MAP_FAILED) return -1;
+
+    int result = -1;
+    if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) == JOBSHM_MAGIC && seg->version == JOBSHM_VERSION) {
+        for (int attempt = 0; attempt < READ_ATTEMPTS && result < 0; attempt++) {
+            unsigned int before = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+            if (before & 1) {
+                sched_yield();
+                continue;
+            }
+            memcpy(out, seg, sizeof(*out));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&seg->seq, __ATOMIC_RELAXED) == before) result = 0;
+        }
+    }
+    munmap((void *)seg, sizeof(*seg));
+    if (result == 0 && (out->job_count < 0 || out->job_count > MAX_JOBS)) result = -1;
+    return result;
+}
+
+static const char *state_name(const struct JobShmEntry *job) {
+    if (job->throttled) return "Throttled";
+    // The shell publishes a finished job only when it next gets back to its main loop
+    if (job->state == JOB_RUNNING && job->pgid > 0 && kill(-job->pgid, 0) < 0 && errno == ESRCH) return "Done";
+    switch (job->state) {
+        case JOB_RUNNING: return "Running";
+        case JOB_STOPPED: return "Stopped";
+        case JOB_QUEUED: return "Queued";
+        default: return "Done";
+    }
+}
+
+static void format_elapsed(char *buf, size_t size, unsigned long long ns) {
+    unsigned long long s = ns / 1000000000ULL;
+    if (s < 3600) snprintf(buf, size, "%llu:%02llu", s / 60, s % 60);
+    else snprintf(buf, size, "%lluh%02llum", s / 3600, s % 3600 / 60);
+}
+
+static int show(void) {
+    DIR *dir = opendir(SHM_DIR);
+    if (dir == NULL) {
+        perror(SHM_DIR);
+        return -1;
+    }
+    unsigned long long now = monotonic_ns();
+    int shells = 0, jobs = 0;
+    printf("%-8s %-5s %-8s %-10s %-3s %9s  %s\n", "SHELL", "JOB", "PGID", "STATE", "", "ELAPSED", "COMMAND");
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, JOBSHM_PREFIX, strlen(JOBSHM_PREFIX)) != 0) continue;
+        struct JobShmSegment seg;
+        if (read_segment(entry->d_name, &seg) < 0) continue;
+        if (kill(seg.shell_pid, 0) < 0 && errno == ESRCH) continue;  // Left behind by a killed shell
+        shells++;
+        for (int i = 0; i < seg.job_count; i++) {
+            struct JobShmEntry *job = &seg.jobs[i];
+            job->command[JOBSHM_COMMAND_SIZE - 1] = '\0';
+            char elapsed[32];
+            format_elapsed(elapsed, sizeof(elapsed), now > job->start_ns ? now - job->start_ns : 0);
+            printf("%-8d %-5d %-8d %-10s %-3s %9s  %s\n", seg.shell_pid, job->job_id, job->pgid, state_name(job),
+                   job->is_background ? "bg" : "fg", elapsed, job->command);
+            jobs++;
+        }
+    }
+    closedir(dir);
+    printf("%d job(s) in %d shell(s)\n", jobs, shells);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int once = 0;
+    double interval = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-1") == 0) {
+            once = 1;
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            char *end;
+            interval = strtod(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' || !(interval > 0)) {
+                fprintf(stderr, "mysh-top: -d: expected a number of seconds\n");
+                return 2;
+            }
+        } else {
+            fprintf(stderr, "usage: mysh-top [-1] [-d SECONDS]\n");
+            return 2;
+        }
+    }
+
+    if (once) return show() < 0 ? 1 : 0;
+    while (1) {
+        printf("\033[H\033[2J");  // Clear the screen
+        if (show() < 0) return 1;
+        fflush(stdout);
+        struct timespec pause = { (time_t)interval, (long)((interval - (time_t)interval) * 1e9) };
+        nanosleep(&pause, NULL);
+    }
+}
@@ -0,0 +1,685 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/sendfile.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../include/shell.h"
+
+// Parallel pipeline stages: "a |[N] b | c" runs b as N copies.
+// The stage's process becomes a coordinator that splits its stdin between the copies
+// on line boundaries and merges what they write back into its stdout, so to the rest
+// of the pipeline (and to the job table) the stage is still one process. The copies
+// share the job's process group, so Ctrl-C, Ctrl-Z, fg and kill reach all of them.
+//
+// Round-robin (|[N]): N long-running copies; each free copy in turn gets the next
+// chunk of whole lines, and their output is merged line by line as it arrives.
+// Ordered (|[N:ordered]): every chunk gets a fresh copy, at most N at a time, and
+// output is passed on in input order: the oldest chunk streams, later ones buffer.
+// The copy per chunk is deliberate. A copy's output can only be tied to its chunk when
+// the copy sees EOF and exits: a long-lived copy's output has no chunk boundaries, and
+// filters like sort or wc only write at EOF. The cost is a fork and exec per
+// ORDERED_CHUNK_SIZE of input, about 1ms, which only shows against a stage that does
+// next to nothing per line (cat); use round-robin when order doesn't matter.
+
+#define PARALLEL_CHUNK_SIZE (64 * 1024)      // Round-robin: input handed to a copy at once
+#define ORDERED_CHUNK_SIZE (1024 * 1024)     // Ordered: input for one copy; amortizes its fork and exec
+#define ORDERED_BUFFER_LIMIT (8 * 1024 * 1024) // Ordered: stop reading a copy that is this far ahead
+
+struct ParallelWorker {
+    pid_t pid;              // 0 when the slot is empty
+    int in_fd;              // Write end of the copy's stdin; -1 once closed
+    int out_fd;             // Read end of the copy's stdout; -1 at EOF
+    struct Buffer pending;  // Input assigned to the copy, not yet written
+    size_t pending_off;
+    struct Buffer output;   // Output read from the copy, not yet passed on
+};
+
+static struct ParallelWorker workers[MAX_PARALLEL];
+static int worker_count;
+
+// Write all of buf to fd (a blocking stdout)
+static void write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            // Downstream is gone: end the way an ordinary stage would
+            signal(SIGPIPE, SIG_DFL);
+            raise(SIGPIPE);
+            _exit(1);
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+// Drop the first n bytes of a buffer
+static void buf_consume(struct Buffer *b, size_t n) {
+    memmove(b->data, b->data + n, b->len - n);
+    b->len -= n;
+}
+
+// Pass on the complete lines in a copy's output (all of it when final)
+static void flush_lines(struct ParallelWorker *w, int final) {
+    size_t end = w->output.len;
+    if (!final) {
+        while (end > 0 && w->output.data[end - 1] != '\n') end--;
+    }
+    if (end == 0) return;
+    write_all(STDOUT_FILENO, w->output.data, end);
+    buf_consume(&w->output, end);
+}
+
+// Fork a copy into slot w. Returns 0 in the copy (with stdin/stdout wired up),
+// 1 in the coordinator, -1 on error.
+static int spawn_worker(struct ParallelWorker *w) {
+    int in[2], out[2];
+    if (pipe2(in, O_CLOEXEC) < 0) {
+        perror("parallel: pipe failed");
+        return -1;
+    }
+    if (pipe2(out, O_CLOEXEC) < 0) {
+        perror("parallel: pipe failed");
+        close(in[0]);
+        close(in[1]);
+        return -1;
+    }
+
+    pid_t pid = fork();
+
+    if (pid > 0) STAT_INC(STAT_FORKS);
+    if (pid < 0) {
+        perror("parallel: fork failed");
+        close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGTERM);  // Don't outlive a coordinator that was killed
+        signal(SIGPIPE, SIG_DFL);
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+        // Other copies' pipes would hold their input open (and matter for built-ins, which don't exec)
+        for (int k = 0; k < worker_count; k++) {
+            if (workers[k].in_fd >= 0) close(workers[k].in_fd);
+            if (workers[k].out_fd >= 0) close(workers[k].out_fd);
+        }
+        return 0;
+    }
+
+    close(in[0]);
+    close(out[1]);
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+    w->pid = pid;
+    w->in_fd = in[1];
+    w->out_fd = out[0];
+    w->output.len = 0;
+    return 1;
+}
+
+// Move the next chunk of whole lines (at most max bytes unless one line is longer)
+// from input into w's pending input. Returns 0 if input holds no complete chunk yet.
+static int assign_chunk(struct Buffer *input, int input_eof, size_t max, int need_full,
+                        struct ParallelWorker *w) {
+    if (input->len == 0) return 0;
+    if (need_full && !input_eof && input->len < max) return 0;
+
+    size_t end = input->len < max ? input->len : max;
+    while (end > 0 && input->data[end - 1] != '\n') end--;
+    if (end == 0) {
+        // One line longer than max: it goes out whole once its newline arrives
+        char *nl = memchr(input->data, '\n', input->len);
+        if (nl != NULL) end = nl - input->data + 1;
+        else if (input_eof) end = input->len;
+        else return 0;
+    }
+    if (buf_append(&w->pending, input->data, end) < 0) _exit(1);
+    w->pending_off = 0;
+    buf_consume(input, end);
+    return 1;
+}
+
+// Write as much pending input as the copy's pipe takes; close its stdin when told to
+// and everything is written
+static void feed_worker(struct ParallelWorker *w, int close_when_done) {
+    while (w->pending_off < w->pending.len) {
+        ssize_t n = write(w->in_fd, w->pending.data + w->pending_off, w->pending.len - w->pending_off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return;
+            w->pending_off = w->pending.len;  // The copy stopped reading (EPIPE): drop its input
+            break;
+        }
+        w->pending_off += n;
+    }
+    w->pending.len = w->pending_off = 0;
+    if (close_when_done) {
+        close(w->in_fd);
+        w->in_fd = -1;
+    }
+}
+
+// Read what the copy has written. Returns 0 at EOF.
+static int drain_worker(struct ParallelWorker *w) {
+    if (buf_reserve(&w->output, PARALLEL_CHUNK_SIZE) < 0) _exit(1);
+    ssize_t n = read(w->out_fd, w->output.data + w->output.len, w->output.cap - w->output.len - 1);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return 1;
+    if (n <= 0) {
+        close(w->out_fd);
+        w->out_fd = -1;
+        return 0;
+    }
+    w->output.len += n;
+    return 1;
+}
+
+// Read more of the stage's stdin. Returns 0 at EOF.
+static int read_input(struct Buffer *input) {
+    if (buf_reserve(input, PARALLEL_CHUNK_SIZE) < 0) _exit(1);
+    ssize_t n = read(STDIN_FILENO, input->data + input->len, input->cap - input->len - 1);
+    if (n < 0 && errno == EINTR) return 1;
+    if (n <= 0) return 0;
+    input->len += n;
+    return 1;
+}
+
+// Collect a copy's exit status into the stage's (the highest one wins)
+static void reap_worker(struct ParallelWorker *w, int *status) {
+    int wstatus = 0;
+    while (waitpid(w->pid, &wstatus, 0) < 0 && errno == EINTR) {}
+    int code = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+    if (code > *status) *status = code;
+    w->pid = 0;
+}
+
+// Round-robin: N copies for the whole run
+static int run_round_robin(int copies) {
+    struct Buffer input;
+    buf_init(&input);
+    int input_eof = 0, next = 0, status = 0;
+    struct pollfd pfds[1 + 2 * MAX_PARALLEL];
+    struct ParallelWorker *owners[1 + 2 * MAX_PARALLEL];
+
+    for (worker_count = 0; worker_count < copies; worker_count++) {
+        struct ParallelWorker *w = &workers[worker_count];
+        buf_init(&w->pending);
+        buf_init(&w->output);
+        int r = spawn_worker(w);
+        if (r == 0) return 0;
+        if (r < 0) break;
+    }
+    if (worker_count == 0) _exit(1);
+
+    while (1) {
+        // Hand chunks to idle copies, starting after the one that got the last chunk
+        for (int tried = 0; tried < worker_count; tried++) {
+            struct ParallelWorker *w = &workers[next];
+            if (w->in_fd >= 0 && w->pending.len == 0) {
+                if (!assign_chunk(&input, input_eof, PARALLEL_CHUNK_SIZE, 0, w)) break;
+                feed_worker(w, 0);
+            }
+            next = (next + 1) % worker_count;
+        }
+
+        int idle = 0, nfds = 0;
+        for (int k = 0; k < worker_count; k++) {
+            struct ParallelWorker *w = &workers[k];
+            if (w->in_fd >= 0 && w->pending.len == 0) {
+                if (input_eof && input.len == 0) {
+                    close(w->in_fd);
+                    w->in_fd = -1;
+                } else {
+                    idle = 1;
+                }
+            }
+            if (w->in_fd >= 0 && w->pending.len > 0) {
+                pfds[nfds] = (struct pollfd){ .fd = w->in_fd, .events = POLLOUT };
+                owners[nfds++] = w;
+            }
+            if (w->out_fd >= 0) {
+                pfds[nfds] = (struct pollfd){ .fd = w->out_fd, .events = POLLIN };
+                owners[nfds++] = w;
+            }
+        }
+        // Only read ahead when a copy can take the data (or a line is still incomplete)
+        int want_input = !input_eof && (idle || memchr(input.data, '\n', input.len) == NULL);
+        if (want_input) {
+            pfds[nfds] = (struct pollfd){ .fd = STDIN_FILENO, .events = POLLIN };
+            owners[nfds++] = NULL;
+        }
+        if (nfds == 0) break;
+
+        if (poll(pfds, nfds, -1) < 0) {
+            if (errno == EINTR) continue;
+            _exit(1);
+        }
+        for (int k = 0; k < nfds; k++) {
+            if (pfds[k].revents == 0) continue;
+            struct ParallelWorker *w = owners[k];
+            if (w == NULL) {
+                if (!read_input(&input)) input_eof = 1;
+            } else if (pfds[k].events == POLLOUT) {
+                feed_worker(w, 0);
+            } else if (drain_worker(w)) {
+                flush_lines(w, 0);
+            } else {
+                flush_lines(w, 1);
+            }
+        }
+    }
+
+    for (int k = 0; k < worker_count; k++) reap_worker(&workers[k], &status);
+    _exit(status);
+}
+
+// Ordered: a fresh copy per chunk (see above), output released in input order
+static int run_ordered(int copies) {
+    struct Buffer input;
+    buf_init(&input);
+    int input_eof = 0, status = 0;
+    long head = 0, next_seq = 0;     // Oldest running chunk, next chunk to start
+    struct pollfd pfds[1 + 2 * MAX_PARALLEL];
+    struct ParallelWorker *owners[1 + 2 * MAX_PARALLEL];
+
+    worker_count = copies;
+    for (int k = 0; k < copies; k++) {
+        workers[k].pid = 0;
+        workers[k].in_fd = workers[k].out_fd = -1;
+        buf_init(&workers[k].pending);
+        buf_init(&workers[k].output);
+    }
+
+    while (1) {
+        // Start copies for complete chunks while fewer than N run
+        while (next_seq - head < copies) {
+            struct ParallelWorker *w = &workers[next_seq % copies];
+            if (!assign_chunk(&input, input_eof, ORDERED_CHUNK_SIZE, 1, w)) break;
+            int r = spawn_worker(w);
+            if (r == 0) return 0;
+            if (r < 0) _exit(1);
+            next_seq++;
+            feed_worker(w, 1);
+        }
+
+        // The oldest chunk streams straight through; when it ends, the next one catches up
+        while (head < next_seq) {
+            struct ParallelWorker *w = &workers[head % copies];
+            flush_lines(w, 1);
+            if (w->out_fd >= 0) break;
+            if (w->in_fd >= 0) {  // The copy quit without reading all of its chunk
+                close(w->in_fd);
+                w->in_fd = -1;
+            }
+            reap_worker(w, &status);
+            head++;
+        }
+        if (input_eof && input.len == 0 && head == next_seq) break;
+
+        int nfds = 0;
+        for (long seq = head; seq < next_seq; seq++) {
+            struct ParallelWorker *w = &workers[seq % copies];
+            if (w->in_fd >= 0) {
+                pfds[nfds] = (struct pollfd){ .fd = w->in_fd, .events = POLLOUT };
+                owners[nfds++] = w;
+            }
+            if (w->out_fd >= 0 && (seq == head || w->output.len < ORDERED_BUFFER_LIMIT)) {
+                pfds[nfds] = (struct pollfd){ .fd = w->out_fd, .events = POLLIN };
+                owners[nfds++] = w;
+            }
+        }
+        if (!input_eof && (next_seq - head < copies || input.len < ORDERED_CHUNK_SIZE)) {
+            pfds[nfds] = (struct pollfd){ .fd = STDIN_FILENO, .events = POLLIN };
+            owners[nfds++] = NULL;
+        }
+        if (nfds == 0) break;  // Not reached: the head copy's output is always polled
+
+        if (poll(pfds, nfds, -1) < 0) {
+            if (errno == EINTR) continue;
+            _exit(1);
+        }
+        for (int k = 0; k < nfds; k++) {
+            if (pfds[k].revents == 0) continue;
+            struct ParallelWorker *w = owners[k];
+            if (w == NULL) {
+                if (!read_input(&input)) input_eof = 1;
+            } else if (pfds[k].events == POLLOUT) {
+                feed_worker(w, 1);
+            } else {
+                drain_worker(w);
+            }
+        }
+    }
+    _exit(status);
+}
+
+// Turn the current process (a forked pipeline stage, stdin and stdout already wired)
+// into the coordinator of cmd->parallel copies. Returns only in a copy, which then
+// runs the command as usual; the coordinator exits with the highest exit status.
+void run_parallel_stage(struct Command *cmd) {
+    signal(SIGPIPE, SIG_IGN);  // A copy that quits early must not take the coordinator with it
+    signal(SIGCHLD, SIG_DFL);  // The shell's handler would reap the copies before we can
+    if (cmd->parallel_ordered) run_ordered(cmd->parallel);
+    else run_round_robin(cmd->parallel);
+}
+
+// ---------------------------------------------------------------------------
+// parallel [-j N] [--line-buffer] cmd [args...] [::: arg...]   (-jN works too)
+// Runs cmd once per argument with at most N copies alive, starting the next one as
+// soon as any exits. Arguments come after ":::", or one per line from stdin (the
+// copies then get /dev/null as stdin). "{}" in cmd or its args is replaced by the
+// argument; without one the argument is appended.
+// Output is grouped by default: each copy writes to a memfd that is copied out in
+// one piece when it exits. --line-buffer passes on whole lines as they arrive.
+// Exit status: the number of copies that failed, at most 101 (as GNU parallel).
+// ---------------------------------------------------------------------------
+
+#define PARALLEL_MAX_JOBS 1024
+#define PARALLEL_MAX_FAILURES 101
+
+struct ParallelJob {
+    pid_t pid;              // 0 for a free slot
+    int out_fd;             // memfd (grouped) or read end of a pipe (line mode); -1 at EOF
+    struct Buffer partial;  // Line mode: output after the last newline
+};
+
+struct ParallelRun {
+    char **templ;           // cmd and its arguments
+    char **list;            // Arguments after :::, or NULL to read stdin
+    int list_pos;
+    struct Buffer input;    // Stdin read so far but not used yet
+    int input_eof;
+    int line_mode;
+};
+
+// Next argument, or NULL when there is none right now (*done is set when none will come)
+static char *next_argument(struct ParallelRun *run, int *done) {
+    *done = 0;
+    if (run->list != NULL) {
+        if (run->list[run->list_pos] == NULL) {
+            *done = 1;
+            return NULL;
+        }
+        return strdup(run->list[run->list_pos++]);
+    }
+    char *nl = memchr(run->input.data, '\n', run->input.len);
+    size_t len;
+    if (nl != NULL) {
+        len = nl - run->input.data;
+    } else if (run->input_eof && run->input.len > 0) {
+        len = run->input.len;
+    } else {
+        *done = run->input_eof;
+        return NULL;
+    }
+    char *arg = strndup(run->input.data, len);
+    buf_consume(&run->input, nl != NULL ? len + 1 : len);
+    return arg;
+}
+
+// Replace every "{}" in word with arg; returns a malloc'd string
+static char *substitute_argument(const char *word, const char *arg, int *used) {
+    struct Buffer out;
+    buf_init(&out);
+    for (const char *p = word; *p != '\0'; p++) {
+        if (p[0] == '{' && p[1] == '}') {
+            buf_append(&out, arg, strlen(arg));
+            *used = 1;
+            p++;
+        } else {
+            buf_putc(&out, *p);
+        }
+    }
+    return buf_detach(&out);
+}
+
+// Fork a copy of the command for arg into job; returns 0 or -1
+static int start_job(struct ParallelRun *run, struct ParallelJob *job, const char *arg, sigset_t *oldmask) {
+    int fds[2] = { -1, -1 };
+    if (run->line_mode) {
+        if (pipe2(fds, O_CLOEXEC) < 0) {
+            perror("parallel: pipe failed");
+            return -1;
+        }
+    } else {
+        fds[0] = fds[1] = memfd_create("mysh-parallel", MFD_CLOEXEC);
+        if (fds[0] < 0) {
+            perror("parallel: memfd_create failed");
+            return -1;
+        }
+    }
+
+    pid_t pid = fork();
+
+    if (pid > 0) STAT_INC(STAT_FORKS);
+    if (pid < 0) {
+        perror("parallel: fork failed");
+        close(fds[0]);
+        if (fds[1] != fds[0]) close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        sigprocmask(SIG_SETMASK, oldmask, NULL);
+        signal(SIGCHLD, SIG_DFL);
+        dup2(fds[1], STDOUT_FILENO);
+        if (run->list == NULL) {
+            int null_fd = open("/dev/null", O_RDONLY);
+            if (null_fd >= 0) dup2(null_fd, STDIN_FILENO);
+        }
+
+        struct Command cmd;
+        initialze_Command(&cmd);
+        int argc = 0, used = 0;
+        for (int i = 0; run->templ[i] != NULL && argc < MAX_TOKENS - 2; i++)
+            cmd.argv[argc++] = substitute_argument(run->templ[i], arg, &used);
+        if (!used) cmd.argv[argc++] = (char *)arg;
+        cmd.argv[argc] = NULL;
+        run_command_in_child(&cmd);
+    }
+
+    if (fds[1] != fds[0]) close(fds[1]);
+    job->pid = pid;
+    job->out_fd = fds[0];
+    job->partial.len = 0;
+    return 0;
+}
+
+// Copy a finished copy's grouped output (its whole memfd) to stdout
+static void dump_grouped(struct ParallelJob *job) {
+    off_t size = lseek(job->out_fd, 0, SEEK_CUR);
+    off_t offset = 0;
+    while (offset < size) {
+        ssize_t n = sendfile(STDOUT_FILENO, job->out_fd, &offset, size - offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+    }
+    if (offset < size) {
+        // sendfile() can't write to this stdout; fall back to read/write
+        char buf[PARALLEL_CHUNK_SIZE];
+        ssize_t n;
+        while ((n = pread(job->out_fd, buf, sizeof(buf), offset)) > 0) {
+            write_all(STDOUT_FILENO, buf, n);
+            offset += n;
+        }
+    }
+    close(job->out_fd);
+    job->out_fd = -1;
+}
+
+// Line mode: read what a copy wrote and pass on its complete lines
+static void drain_job(struct ParallelJob *job) {
+    if (buf_reserve(&job->partial, PARALLEL_CHUNK_SIZE) < 0) _exit(1);
+    ssize_t n = read(job->out_fd, job->partial.data + job->partial.len,
+                     job->partial.cap - job->partial.len - 1);
+    if (n < 0 && errno == EINTR) return;
+    int eof = (n <= 0);
+    if (!eof) job->partial.len += n;
+
+    size_t end = job->partial.len;
+    if (!eof) {
+        while (end > 0 && job->partial.data[end - 1] != '\n') end--;
+    } else if (end > 0 && job->partial.data[end - 1] != '\n') {
+        buf_putc(&job->partial, '\n');  // Keep an unterminated last line to itself
+        end++;
+    }
+    write_all(STDOUT_FILENO, job->partial.data, end);
+    buf_consume(&job->partial, end);
+
+    if (eof) {
+        close(job->out_fd);
+        job->out_fd = -1;
+    }
+}
+
+int builtin_parallel(char **argv) {
+    struct ParallelRun run = { 0 };
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1;
+
+    for (; argv[i] != NULL && argv[i][0] == '-'; i++) {
+        // -j N or -jN
+        if ((strcmp(argv[i], "-j") == 0 && argv[i + 1] != NULL) || (strncmp(argv[i], "-j", 2) == 0 && argv[i][2] != '\0')) {
+            const char *count = argv[i][2] != '\0' ? argv[i] + 2 : argv[++i];
+            char *end;
+            jobs = strtol(count, &end, 10);
+            if (*end != '\0' || jobs < 1 || jobs > PARALLEL_MAX_JOBS) {
+                fprintf(stderr, "parallel: -j: expected 1 to %d\n", PARALLEL_MAX_JOBS);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--line-buffer") == 0) {
+            run.line_mode = 1;
+        } else if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        } else {
+            fprintf(stderr, "parallel: unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (jobs < 1) jobs = 1;
+
+    run.templ = &argv[i];
+    for (; argv[i] != NULL; i++) {
+        if (strcmp(argv[i], ":::") == 0) {
+            argv[i] = NULL;  // Ends the template
+            run.list = &argv[i + 1];
+            break;
+        }
+    }
+    if (run.templ[0] == NULL) {
+        fprintf(stderr, "parallel: usage: parallel [-j N] [--line-buffer] command [args...] [::: arg...]\n");
+        return 2;
+    }
+    buf_init(&run.input);
+
+    // Copies are reaped as SIGCHLD arrives on a signalfd, so one poll() covers exits,
+    // output (line mode) and more arguments on stdin
+    sigset_t chld, oldmask;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    signal(SIGCHLD, SIG_DFL);
+    sigprocmask(SIG_BLOCK, &chld, &oldmask);
+    int sfd = signalfd(-1, &chld, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (sfd < 0) {
+        perror("parallel: signalfd failed");
+        sigprocmask(SIG_SETMASK, &oldmask, NULL);
+        return 1;
+    }
+
+    struct ParallelJob *slots = calloc(jobs, sizeof(struct ParallelJob));
+    struct pollfd *pfds = calloc(jobs + 2, sizeof(struct pollfd));
+    if (slots == NULL || pfds == NULL) {
+        perror("parallel: calloc failed");
+        return 1;
+    }
+    for (int k = 0; k < jobs; k++) slots[k].out_fd = -1;
+
+    int busy = 0, failures = 0, done = 0;
+    while (1) {
+        // Fill free slots
+        while (busy < jobs && !done) {
+            char *arg = next_argument(&run, &done);
+            if (arg == NULL) break;
+            int k = 0;
+            while (slots[k].pid != 0 || slots[k].out_fd >= 0) k++;
+            if (start_job(&run, &slots[k], arg, &oldmask) == 0) busy++;
+            else failures++;
+            free(arg);
+        }
+        if (busy == 0 && done) break;
+
+        int nfds = 0, stdin_index = -1;
+        pfds[nfds++] = (struct pollfd){ .fd = sfd, .events = POLLIN };
+        if (run.list == NULL && !run.input_eof && busy < jobs) {
+            stdin_index = nfds;
+            pfds[nfds++] = (struct pollfd){ .fd = STDIN_FILENO, .events = POLLIN };
+        }
+        int first_job_fd = nfds;
+        if (run.line_mode) {
+            for (int k = 0; k < jobs; k++) {
+                pfds[nfds] = (struct pollfd){ .fd = slots[k].out_fd, .events = POLLIN };
+                nfds++;  // A negative fd is ignored by poll()
+            }
+        }
+
+        if (poll(pfds, nfds, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("parallel: poll failed");
+            break;
+        }
+
+        if (stdin_index >= 0 && pfds[stdin_index].revents) {
+            if (buf_reserve(&run.input, PARALLEL_CHUNK_SIZE) < 0) break;
+            ssize_t n = read(STDIN_FILENO, run.input.data + run.input.len, run.input.cap - run.input.len - 1);
+            if (n > 0) run.input.len += n;
+            else if (n == 0 || errno != EINTR) run.input_eof = 1;
+        }
+        if (run.line_mode) {
+            for (int k = 0; k < jobs; k++) {
+                if (slots[k].out_fd >= 0 && pfds[first_job_fd + k].revents) drain_job(&slots[k]);
+                if (slots[k].pid < 0 && slots[k].out_fd < 0) {
+                    slots[k].pid = 0;  // Exited and drained: the slot is free
+                    busy--;
+                }
+            }
+        }
+        if (pfds[0].revents) {
+            struct signalfd_siginfo info;
+            while (read(sfd, &info, sizeof(info)) > 0) {}
+            int wstatus;
+            pid_t pid;
+            while ((pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+                if (wait_status_to_exit(wstatus) != 0) failures++;
+                for (int k = 0; k < jobs; k++) {
+                    if (slots[k].pid != pid) continue;
+                    if (!run.line_mode) {
+                        dump_grouped(&slots[k]);
+                        slots[k].pid = 0;
+                        busy--;
+                    } else if (slots[k].out_fd >= 0) {
+                        slots[k].pid = -1;  // Exited; free once its output is drained
+                    } else {
+                        slots[k].pid = 0;
+                        busy--;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    close(sfd);
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+    for (int k = 0; k < jobs; k++) buf_free(&slots[k].partial);
+    free(slots);
+    free(pfds);
+    buf_free(&run.input);
+    return failures > PARALLEL_MAX_FAILURES ? PARALLEL_MAX_FAILURES : failures;
+}
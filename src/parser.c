@@ -5,133 +5,785 @@
 #include "../include/shell.h"
 
 // FUNCTION PROTOTYPES
-char *expand_var(const char *input, struct VariableStore *var_store);
 int var_name_end(const char *s);
 
+// Token kinds produced by the lexer
+enum TokenKind { TOK_WORD, TOK_PIPE, TOK_AMP, TOK_SEMI, TOK_AND_IF, TOK_OR_IF,
+                 TOK_LESS, TOK_GREAT, TOK_DGREAT, TOK_DLESS, TOK_DLESSDASH, TOK_TLESS,
+                 TOK_LPAREN, TOK_RPAREN, TOK_RBRACE, TOK_EOF, TOK_ERROR };
 
+struct Lexer {
+    const char *input;
+    size_t pos;
+    size_t token_start;   // Where the last token returned by next_token began
+    size_t heredoc_end;   // End of the here-document bodies taken from the input, 0 if none
+};
+
+// Characters that end an unquoted word
+static int is_metachar(char c) {
+    return c == '|' || c == '&' || c == ';' || c == '<' || c == '>' || c == '(' || c == ')';
+}
+
+// True at the start of a process substitution: <(cmd) or >(cmd)
+static int is_procsubst_start(const char *s) {
+    return (s[0] == '<' || s[0] == '>') && s[1] == '(';
+}
+
+// Default IFS: unquoted expansion results are split on these
+static int is_ifs_char(char c) {
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+// Returns index of the closing quote matching the '"' at s[start], or -1 if unterminated
+static long find_closing_dquote(const char *s, size_t start) {
+    for (size_t i = start + 1; s[i] != '\0'; i++) {
+        if (s[i] == '\\' && s[i + 1] != '\0') {
+            i++;
+        } else if (s[i] == '$' && s[i + 1] == '(') {
+            long end = find_matching_paren(s, i + 2);
+            if (end < 0) return -1;
+            i = end;
+        } else if (s[i] == '"') {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+// Returns index of the backtick closing the one at s[start], or -1 if unterminated
+static long find_closing_backtick(const char *s, size_t start) {
+    for (size_t i = start + 1; s[i] != '\0'; i++) {
+        if (s[i] == '\\' && s[i + 1] != '\0') i++;
+        else if (s[i] == '`') return (long)i;
+    }
+    return -1;
+}
+
+// Returns index of the ')' that closes a "$(" whose body starts at s[start],
+// or -1 if unmatched. Quotes and nested substitutions are skipped over.
+long find_matching_paren(const char *s, size_t start) {
+    int depth = 1;
+    for (size_t i = start; s[i] != '\0'; i++) {
+        char c = s[i];
+        long end;
+        if (c == '\\' && s[i + 1] != '\0') {
+            i++;
+        } else if (c == '\'') {
+            const char *close = strchr(s + i + 1, '\'');
+            if (close == NULL) return -1;
+            i = close - s;
+        } else if (c == '"') {
+            if ((end = find_closing_dquote(s, i)) < 0) return -1;
+            i = end;
+        } else if (c == '`') {
+            if ((end = find_closing_backtick(s, i)) < 0) return -1;
+            i = end;
+        } else if (c == '$' && s[i + 1] == '(') {
+            if ((end = find_matching_paren(s, i + 2)) < 0) return -1;
+            i = end;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')' && --depth == 0) {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+// Scan one word starting at lx->pos, keeping quotes and $(...) intact for expansion
+// Returns the word copied into the line arena, or NULL on unterminated quoting
+static char *scan_word(struct Lexer *lx) {
+    const char *s = lx->input;
+    size_t start = lx->pos;
+    size_t i = start;
+
+    while (s[i] != '\0' && !isspace((unsigned char)s[i]) && (!is_metachar(s[i]) || is_procsubst_start(s + i))) {
+        long end = (long)i;
+        if (is_procsubst_start(s + i)) {
+            end = find_matching_paren(s, i + 2);
+        } else if (s[i] == '\\' && s[i + 1] != '\0') {
+            end = i + 1;
+        } else if (s[i] == '\'') {
+            const char *close = strchr(s + i + 1, '\'');
+            end = close ? close - s : -1;
+        } else if (s[i] == '"') {
+            end = find_closing_dquote(s, i);
+        } else if (s[i] == '`') {
+            end = find_closing_backtick(s, i);
+        } else if (s[i] == '$' && s[i + 1] == '(') {
+            end = find_matching_paren(s, i + 2);
+        } else if (s[i] == '$' && s[i + 1] == '{') {
+            const char *close = strchr(s + i, '}');
+            end = close ? close - s : -1;
+        }
+        if (end < 0) {
+            fprintf(stderr, "Error: Unterminated quote or substitution\n");
+            return NULL;
+        }
+        i = end + 1;
+    }
+
+    lx->pos = i;
+    return arena_strndup(&line_arena, s + start, i - start);
+}
+
+// Step over the newline at lx->pos, and over any here-document bodies that follow it
+static void skip_newline(struct Lexer *lx) {
+    lx->pos++;
+    if (lx->heredoc_end > lx->pos) lx->pos = lx->heredoc_end;
+}
+
+// Skip blanks and newlines between commands
+static void skip_space(struct Lexer *lx) {
+    while (isspace((unsigned char)lx->input[lx->pos])) {
+        if (lx->input[lx->pos] == '\n') skip_newline(lx);
+        else lx->pos++;
+    }
+}
+
+// Return the next token; for TOK_WORD the raw word is stored in *word
+// An unquoted newline ends a command like ';'
+static enum TokenKind next_token(struct Lexer *lx, char **word) {
+    const char *s = lx->input;
+    while (isspace((unsigned char)s[lx->pos]) && s[lx->pos] != '\n') lx->pos++;
+    lx->token_start = lx->pos;
+
+    char c = s[lx->pos];
+    if (c == '\0') return TOK_EOF;
+    if (c == '\n') { skip_newline(lx); return TOK_SEMI; }
+    if (is_procsubst_start(s + lx->pos)) {
+        *word = scan_word(lx);
+        return (*word == NULL) ? TOK_ERROR : TOK_WORD;
+    }
+    if (c == '|') {
+        if (s[lx->pos + 1] == '|') { lx->pos += 2; return TOK_OR_IF; }
+        lx->pos++;
+        return TOK_PIPE;
+    }
+    if (c == '&') {
+        if (s[lx->pos + 1] == '&') { lx->pos += 2; return TOK_AND_IF; }
+        lx->pos++;
+        return TOK_AMP;
+    }
+    if (c == ';') { lx->pos++; return TOK_SEMI; }
+    if (c == '(') { lx->pos++; return TOK_LPAREN; }
+    if (c == ')') { lx->pos++; return TOK_RPAREN; }
+    if (c == '<') {
+        if (strncmp(s + lx->pos, "<<<", 3) == 0) { lx->pos += 3; return TOK_TLESS; }
+        if (strncmp(s + lx->pos, "<<-", 3) == 0) { lx->pos += 3; return TOK_DLESSDASH; }
+        if (s[lx->pos + 1] == '<') { lx->pos += 2; return TOK_DLESS; }
+        lx->pos++;
+        return TOK_LESS;
+    }
+    if (c == '>') {
+        if (s[lx->pos + 1] == '>') { lx->pos += 2; return TOK_DGREAT; }
+        lx->pos++;
+        return TOK_GREAT;
+    }
+
+    *word = scan_word(lx);
+    return (*word == NULL) ? TOK_ERROR : TOK_WORD;
+}
 
 // Initialize a Command structure
 struct Command *initialze_Command(struct Command *cmd) {
     for (int i = 0; i < MAX_TOKENS; i++) {
         cmd->argv[i] = NULL;
     }
-    cmd->redirects = (struct Redirection){ .input_file = "", .output_file = "", .append_file = "" };
+    cmd->redirects.input_file[0] = '\0';
+    cmd->redirects.output_count = 0;
     cmd->redirect_flags = 0;
+    cmd->heredoc = NULL;
+    cmd->heredoc_type = HEREDOC_LITERAL;
+    cmd->heredoc_fd = -1;
+    cmd->fanout_fd = -1;
+    cmd->group = NULL;
+    cmd->group_type = GROUP_NONE;
+    cmd->parallel = 0;
+    cmd->parallel_ordered = 0;
     return cmd;
 }
 
-void parse_input(char *input, struct Pipeline *pipeline, int *input_has_background_process) {
+// "|[N]" or "|[N:ordered]" right after a pipe runs the next stage as N parallel copies.
+// A "[" not followed by a digit is left alone, so "| [ -f x ]" still reaches test.
+// Returns 0 (nothing or a valid spec consumed) or -1 on a malformed spec
+static int parse_parallel_spec(struct Lexer *lx, struct Command *cmd) {
+    const char *s = lx->input + lx->pos;
+    if (s[0] != '[' || !isdigit((unsigned char)s[1])) return 0;
 
-    char *input_expanded = expand_var(input, &var_store);
+    char *end;
+    long copies = strtol(s + 1, &end, 10);
+    if (*end == ':') {
+        const char *mode = end + 1;
+        size_t len = strcspn(mode, "]");
+        if (len == 7 && strncmp(mode, "ordered", 7) == 0) cmd->parallel_ordered = 1;
+        else if (!(len == 2 && strncmp(mode, "rr", 2) == 0)) {
+            fprintf(stderr, "Error: Unknown parallel mode '%.*s' (use rr or ordered)\n", (int)len, mode);
+            return -1;
+        }
+        end = (char *)mode + len;
+    }
+    if (*end != ']' || copies < 1 || copies > MAX_PARALLEL) {
+        fprintf(stderr, "Error: Expected |[N] or |[N:ordered] with N from 1 to %d\n", MAX_PARALLEL);
+        return -1;
+    }
+    cmd->parallel = (int)copies;
+    lx->pos = end + 1 - lx->input;
+    return 0;
+}
 
-    int argc = 0;
-    char *token = strtok(input_expanded, " \t\n");
+// Strip quotes and backslashes from a here-doc delimiter word
+// Returns 1 if any quoting was present (which disables expansion of the body)
+static int unquote_delimiter(const char *word, char *out, size_t out_size) {
+    size_t n = 0;
+    int quoted = 0;
+    for (size_t i = 0; word[i] != '\0' && n < out_size - 1; i++) {
+        if (word[i] == '\'' || word[i] == '"') {
+            quoted = 1;
+        } else if (word[i] == '\\' && word[i + 1] != '\0') {
+            quoted = 1;
+            out[n++] = word[++i];
+        } else {
+            out[n++] = word[i];
+        }
+    }
+    out[n] = '\0';
+    return quoted;
+}
+
+// Read here-document lines up to the delimiter line. When more lines follow in the
+// input itself (a -c string), the body starts on the line after the current one, or after
+// the previous body on that line; otherwise it is read from the shell's input.
+// With strip_tabs (<<-), leading tabs are removed from each line
+// Returns the body (each line newline-terminated) in the line arena
+static char *read_heredoc_body(struct Lexer *lx, const char *delimiter, int strip_tabs) {
+    struct Buffer body;
+    buf_init(&body);
+    buf_reserve(&body, 0);
+
+    const char *s = lx->input;
+    const char *next_line = strchr(s + lx->pos, '\n');
+    if (lx->heredoc_end > lx->pos || next_line != NULL) {
+        size_t i = (lx->heredoc_end > lx->pos) ? lx->heredoc_end : (size_t)(next_line - s) + 1;
+        while (s[i] != '\0') {
+            size_t len = strcspn(s + i, "\n");
+            const char *text = s + i;
+            i += len + (s[i + len] == '\n');
+            if (strip_tabs) while (*text == '\t') { text++; len--; }
+            if (strlen(delimiter) == len && strncmp(text, delimiter, len) == 0) {
+                lx->heredoc_end = i;
+                return arena_adopt(&line_arena, buf_detach(&body));
+            }
+            buf_append(&body, text, len);
+            buf_putc(&body, '\n');
+        }
+        lx->heredoc_end = i;
+        fprintf(stderr, "Warning: here-document delimited by end-of-file (wanted '%s')\n", delimiter);
+        return arena_adopt(&line_arena, buf_detach(&body));
+    }
+
+    char *line;
+    while ((line = read_input_line("> ")) != NULL) {
+        char *text = line;
+        if (strip_tabs) while (*text == '\t') text++;
+        if (strcmp(text, delimiter) == 0) {
+            free(line);
+            return arena_adopt(&line_arena, buf_detach(&body));
+        }
+        buf_append(&body, text, strlen(text));
+        buf_putc(&body, '\n');
+        free(line);
+    }
+    fprintf(stderr, "Warning: here-document delimited by end-of-file (wanted '%s')\n", delimiter);
+    return arena_adopt(&line_arena, buf_detach(&body));
+}
+
+static enum TokenKind parse_list(struct Lexer *lx, struct CommandList *list, enum TokenKind closer);
+
+// Parses one pipeline, stopping at a list operator (; & && ||), a group closer, or end of input.
+// Words are stored unexpanded; expansion happens right before each command runs (see expand_word).
+// Returns the token that ended the pipeline, or TOK_ERROR on syntax error
+static enum TokenKind parse_pipeline(struct Lexer *lx, struct Pipeline *pipeline) {
     struct Pipeline *p = pipeline;
+    int argc = 0;
+    char *word = NULL;
+    enum TokenKind tok;
+
+    p->pipe_count = 0;
+    p->pipe_size = NULL;
+    p->pipestat = PIPESTAT_OFF;
+    p->coproc_name = NULL;
+    p->affinity = NULL;
+    p->timeout = NULL;
+    p->timed = 0;
+    initialze_Command(&p->commands[0]);
+
+    while ((tok = next_token(lx, &word)) != TOK_EOF) {
+        struct Command *cmd = &p->commands[p->pipe_count];
+
+        if (tok == TOK_ERROR) return TOK_ERROR;
+        if (tok == TOK_SEMI || tok == TOK_AMP || tok == TOK_AND_IF || tok == TOK_OR_IF || tok == TOK_RPAREN) break;
+
+        // "pipesize SIZE" in front of a pipeline sets the capacity of its pipes
+        if (tok == TOK_WORD && p->pipe_count == 0 && argc == 0 && cmd->group == NULL &&
+            p->pipe_size == NULL && strcmp(word, "pipesize") == 0) {
+            if (next_token(lx, &p->pipe_size) != TOK_WORD) {
+                fprintf(stderr, "Error: Missing size after 'pipesize'\n");
+                return TOK_ERROR;
+            }
+            continue;
+        }
+
+        // "affinity SETTING" in front of a pipeline places its stages on CPUs
+        if (tok == TOK_WORD && p->pipe_count == 0 && argc == 0 && cmd->group == NULL &&
+            p->affinity == NULL && strcmp(word, "affinity") == 0) {
+            if (next_token(lx, &p->affinity) != TOK_WORD) {
+                fprintf(stderr, "Error: Missing CPU list after 'affinity'\n");
+                return TOK_ERROR;
+            }
+            continue;
+        }
 
-    while (token != NULL && argc < MAX_TOKENS - 1) {
-        if(strcmp(token, "|") == 0) {
+        // "timeout DURATION" in front of a pipeline gives its job a deadline; with options
+        // ("timeout -s KILL 5 cmd") the word is left to be run as timeout(1)
+        if (tok == TOK_WORD && p->pipe_count == 0 && argc == 0 && cmd->group == NULL &&
+            p->timeout == NULL && strcmp(word, "timeout") == 0) {
+            size_t option_pos = lx->pos;
+            char *limit = NULL;
+            if (next_token(lx, &limit) != TOK_WORD) {
+                fprintf(stderr, "Error: Missing duration after 'timeout'\n");
+                return TOK_ERROR;
+            }
+            if (limit[0] != '-') {
+                p->timeout = limit;
+                continue;
+            }
+            lx->pos = option_pos;
+        }
+
+        // "time" in front of a pipeline reports what each of its processes used; with options
+        // ("time -v cmd") the word is left to be run as time(1)
+        if (tok == TOK_WORD && p->pipe_count == 0 && argc == 0 && cmd->group == NULL &&
+            !p->timed && strcmp(word, "time") == 0) {
+            size_t option_pos = lx->pos;
+            char *next = NULL;
+            enum TokenKind next_tok = next_token(lx, &next);
+            lx->pos = option_pos;
+            if (next_tok != TOK_WORD || next[0] != '-') {
+                p->timed = 1;
+                continue;
+            }
+        }
+
+        // "pipestat" in front of a pipeline reports how its stages held each other up when it
+        // finishes; "pipestat -d" relays every pipe to count bytes and blocked time as well
+        if (tok == TOK_WORD && p->pipe_count == 0 && argc == 0 && cmd->group == NULL &&
+            p->pipestat == PIPESTAT_OFF && strcmp(word, "pipestat") == 0) {
+            size_t option_pos = lx->pos;
+            char *option = NULL;
+            if (next_token(lx, &option) == TOK_WORD && strcmp(option, "-d") == 0) {
+                p->pipestat = PIPESTAT_DETAILED;
+            } else {
+                lx->pos = option_pos;
+                p->pipestat = PIPESTAT_SAMPLED;
+            }
+            continue;
+        }
+
+        // "coproc NAME" in front of a pipeline runs it in the background with its stdin and
+        // stdout connected to the shell through $NAME_WRITE and $NAME_READ
+        if (tok == TOK_WORD && p->pipe_count == 0 && argc == 0 && cmd->group == NULL &&
+            p->coproc_name == NULL && strcmp(word, "coproc") == 0) {
+            if (next_token(lx, &p->coproc_name) != TOK_WORD || p->coproc_name[0] == '\0' ||
+                var_name_end(p->coproc_name) != (int)strlen(p->coproc_name)) {
+                fprintf(stderr, "Error: Missing or invalid name after 'coproc'\n");
+                return TOK_ERROR;
+            }
+            continue;
+        }
+
+        // "}" closes a brace group only where a command name could start
+        if (tok == TOK_WORD && argc == 0 && cmd->group == NULL && strcmp(word, "}") == 0) {
+            tok = TOK_RBRACE;
+            break;
+        }
+
+        // ( list ) and { list; } open a group where a command name could start
+        int opens_group = (tok == TOK_LPAREN) || (tok == TOK_WORD && strcmp(word, "{") == 0);
+        if (opens_group && argc == 0 && cmd->group == NULL) {
+            enum TokenKind closer = (tok == TOK_LPAREN) ? TOK_RPAREN : TOK_RBRACE;
+            cmd->group = arena_alloc(&line_arena, sizeof(struct CommandList));
+            if (cmd->group == NULL) return TOK_ERROR;
+            if (parse_list(lx, cmd->group, closer) != closer) return TOK_ERROR;
+            cmd->group_type = (closer == TOK_RPAREN) ? GROUP_SUBSHELL : GROUP_BRACE;
+            continue;
+        }
+        if (tok == TOK_LPAREN) {
+            fprintf(stderr, "Error: Syntax error near unexpected '('\n");
+            return TOK_ERROR;
+        }
+
+        if (tok == TOK_PIPE) {
+            if (argc == 0 && cmd->group == NULL) {
+                fprintf(stderr, "Error: Missing command before '|'\n");
+                return TOK_ERROR;
+            }
             if (p->pipe_count < MAX_COMMANDS - 1) {
                 // Null-terminate current command; Initialize next command and restart argument count
-                p->commands[p->pipe_count].argv[argc] = NULL; 
+                cmd->argv[argc] = NULL;
                 p->pipe_count++;
                 initialze_Command(&p->commands[p->pipe_count]);
-                argc = 0; 
+                argc = 0;
+                if (parse_parallel_spec(lx, &p->commands[p->pipe_count]) < 0) return TOK_ERROR;
             } else {
                 fprintf(stderr, "Error: Too many commands in pipeline\n");
-                return;
-            }
-        }  else if (strcmp(token, "<") == 0) {
-            p->commands[p->pipe_count].redirect_flags |= REDIRECT_IN;
-            token = strtok(NULL, " \t\n"); // Get the filename
-            if (token) {
-                strcpy(p->commands[p->pipe_count].redirects.input_file, token);
-            }
-        } else if (strcmp(token, ">") == 0) {
-            p->commands[p->pipe_count].redirect_flags |= REDIRECT_OUT;
-            token = strtok(NULL, " \t\n"); // Get the filename
-            if (token) {
-                strcpy(p->commands[p->pipe_count].redirects.output_file, token);
-            }
-        } else if (strcmp(token, ">>") == 0) {
-            p->commands[p->pipe_count].redirect_flags |= REDIRECT_APP;
-            token = strtok(NULL, " \t\n"); // Get the filename
-            if (token) {
-                strcpy(p->commands[p->pipe_count].redirects.append_file, token);
+                return TOK_ERROR;
             }
+        } else if (tok == TOK_LESS || tok == TOK_GREAT || tok == TOK_DGREAT) {
+            char *file = NULL;
+            if (next_token(lx, &file) != TOK_WORD) {
+                fprintf(stderr, "Error: Missing file name for redirection\n");
+                return TOK_ERROR;
+            }
+            if (tok == TOK_LESS) {
+                cmd->redirect_flags = (cmd->redirect_flags & ~REDIRECT_HEREDOC) | REDIRECT_IN;  // Last stdin source wins
+                strncpy(cmd->redirects.input_file, file, MAX_INPUT_SIZE - 1);
+                cmd->redirects.input_file[MAX_INPUT_SIZE - 1] = '\0';
+            } else {
+                // Each > or >> adds a target; output goes to all of them
+                if (cmd->redirects.output_count == MAX_OUTPUT_TARGETS) {
+                    fprintf(stderr, "Error: Too many output redirections\n");
+                    return TOK_ERROR;
+                }
+                struct OutputTarget *out = &cmd->redirects.outputs[cmd->redirects.output_count++];
+                out->file = file;
+                out->append = (tok == TOK_DGREAT);
+                cmd->redirect_flags |= out->append ? REDIRECT_APP : REDIRECT_OUT;
+            }
+        } else if (tok == TOK_DLESS || tok == TOK_DLESSDASH || tok == TOK_TLESS) {
+            char *delim = NULL;
+            if (next_token(lx, &delim) != TOK_WORD) {
+                fprintf(stderr, "Error: Missing delimiter for here-document\n");
+                return TOK_ERROR;
+            }
+            cmd->redirect_flags = (cmd->redirect_flags & ~REDIRECT_IN) | REDIRECT_HEREDOC;
+            if (tok == TOK_TLESS) {
+                cmd->heredoc = delim;
+                cmd->heredoc_type = HEREDOC_STRING;
+            } else {
+                char delimiter[MAX_INPUT_SIZE];
+                int quoted = unquote_delimiter(delim, delimiter, sizeof(delimiter));
+                cmd->heredoc = read_heredoc_body(lx, delimiter, tok == TOK_DLESSDASH);
+                cmd->heredoc_type = quoted ? HEREDOC_LITERAL : HEREDOC_EXPAND;
+            }
+        } else if (cmd->group != NULL) {
+            // Only redirections may follow a group
+            fprintf(stderr, "Error: Syntax error near unexpected '%s'\n", word);
+            return TOK_ERROR;
+        } else if (argc < MAX_TOKENS - 1) {
+            cmd->argv[argc++] = word;
         } else {
-            p->commands[p->pipe_count].argv[argc++] = token;
+            fprintf(stderr, "Error: Too many arguments\n");
+            return TOK_ERROR;
         }
-        token = strtok(NULL, " \t\n");
-    }
-    // Check for background job and null-terminate
-    if (argc > 0 && strcmp(p->commands[p->pipe_count].argv[argc - 1], "&") == 0) {
-        *input_has_background_process = 1; // Set background flag if last token is '&'
-        p->commands[p->pipe_count].argv[--argc] = NULL; // Remove '&' from argv
     }
     // Null-terminate the last command's argv array
     p->commands[p->pipe_count].argv[argc] = NULL;
+    if (p->pipe_count == 0 && argc == 0 && p->commands[0].group == NULL) {
+        // A prefix needs a pipeline to apply to
+        if (p->coproc_name != NULL) {
+            fprintf(stderr, "Error: Missing command after 'coproc %s'\n", p->coproc_name);
+            return TOK_ERROR;
+        }
+        const char *prefix = p->timeout != NULL ? "timeout" : p->timed ? "time" :
+                             p->pipestat != PIPESTAT_OFF ? "pipestat" : p->affinity != NULL ? "affinity" :
+                             p->pipe_size != NULL ? "pipesize" : NULL;
+        if (prefix != NULL) {
+            fprintf(stderr, "Error: Missing command after '%s'\n", prefix);
+            return TOK_ERROR;
+        }
+    }
+    return tok;
 }
 
-// Takes user's full input and expands variables
-// If variable not found, returns user's input 
-char *expand_var(const char *input, struct VariableStore *var_store){
+// True if a parsed pipeline has nothing to run
+static int pipeline_is_empty(const struct Pipeline *p) {
+    const struct Command *cmd = &p->commands[0];
+    return p->pipe_count == 0 && cmd->argv[0] == NULL && cmd->redirect_flags == 0 && cmd->group == NULL;
+}
+
+// Parses pipelines joined by ; & && || until closer: TOK_EOF for a whole line,
+// TOK_RPAREN for ( list ), or TOK_RBRACE for { list; }
+// Returns closer on success, or TOK_ERROR on syntax error
+static enum TokenKind parse_list(struct Lexer *lx, struct CommandList *list, enum TokenKind closer) {
+    const char *input = lx->input;
+    list->count = 0;
+
+    while (1) {
+        skip_space(lx);
+        size_t start = lx->pos;
+
+        struct Pipeline *p = arena_alloc(&line_arena, sizeof(struct Pipeline));
+        if (p == NULL) return TOK_ERROR;
+
+        enum TokenKind tok = parse_pipeline(lx, p);
+        if (tok == TOK_ERROR) return TOK_ERROR;
+
+        int ends_list = (tok == TOK_EOF || tok == TOK_RPAREN || tok == TOK_RBRACE);
+        if (pipeline_is_empty(p)) {
+            // Allowed only after a trailing ; or & (e.g. "a;" or "{ a; }")
+            int after_separator = list->count == 0 || list->ops[list->count - 1] == LIST_SEQ || list->ops[list->count - 1] == LIST_BG;
+            if (!ends_list || !after_separator || (list->count == 0 && closer != TOK_EOF)) {
+                fprintf(stderr, "Error: Syntax error near unexpected list operator\n");
+                return TOK_ERROR;
+            }
+        } else {
+            if (list->count >= MAX_LIST_ITEMS) {
+                fprintf(stderr, "Error: Too many commands in list\n");
+                return TOK_ERROR;
+            }
+
+            // Keep the pipeline's own text (without the operator) for job display
+            size_t end = (tok == TOK_EOF) ? lx->pos : lx->token_start;
+            while (end > start && isspace((unsigned char)input[end - 1])) end--;
 
-    size_t cap = 1024;
-    char *out = malloc(cap);
-    if (!out) return NULL;
-    char *marker = out;
+            int i = list->count++;
+            list->pipelines[i] = p;
+            list->texts[i] = arena_strndup(&line_arena, input + start, end - start);
+            list->ops[i] = (tok == TOK_AND_IF) ? LIST_AND : (tok == TOK_OR_IF) ? LIST_OR : (tok == TOK_AMP) ? LIST_BG : LIST_SEQ;
+        }
+
+        if (ends_list) {
+            if (tok != closer) {
+                if (tok == TOK_EOF) fprintf(stderr, "Error: Missing '%s' at end of input\n", closer == TOK_RPAREN ? ")" : "}");
+                else fprintf(stderr, "Error: Syntax error near unexpected '%s'\n", tok == TOK_RPAREN ? ")" : "}");
+                return TOK_ERROR;
+            }
+            return tok;
+        }
+        if (tok == TOK_AND_IF || tok == TOK_OR_IF) {
+            // && and || need a right-hand side
+            skip_space(lx);
+            if (input[lx->pos] == '\0') {
+                fprintf(stderr, "Error: Missing command after '%s'\n", tok == TOK_AND_IF ? "&&" : "||");
+                return TOK_ERROR;
+            }
+        }
+    }
+}
+
+// Parses a whole line into a command list: pipelines joined by ; & && ||
+// The line is parsed once up front; each pipeline is expanded only when it runs.
+// Returns 0 on success, -1 on syntax error
+int parse_input(char *input, struct CommandList *list) {
+    unsigned long long start = TRACE_START();
+    struct Lexer lx = { input, 0, 0, 0 };
+    int result = (parse_list(&lx, list, TOK_EOF) == TOK_EOF) ? 0 : -1;
+    TRACE_END(TRACE_PARSE, start, input);
+    return result;
+}
+
+// Appends the expansion of the '$' or '`' construct at s[0] to out
+// Handles $NAME, ${NAME}, $?, $(command) and `command`
+// Returns the number of input characters consumed, or -1 on error
+static long expand_dollar(const char *s, struct Buffer *out) {
+    if (s[0] == '`') {
+        long end = find_closing_backtick(s, 0);
+        if (end < 0) {
+            fprintf(stderr, "Error: Unmatched backtick in command substitution\n");
+            return -1;
+        }
+        // Inside backticks, \` \\ and \$ stand for the literal character
+        struct Buffer body;
+        buf_init(&body);
+        for (long i = 1; i < end; i++) {
+            if (s[i] == '\\' && strchr("`\\$", s[i + 1])) i++;
+            buf_putc(&body, s[i]);
+        }
+        command_substitution(body.data ? body.data : "", out);
+        buf_free(&body);
+        return end + 1;
+    }
+
+    if (s[1] == '(') {
+        long end = find_matching_paren(s, 2);
+        if (end < 0) {
+            fprintf(stderr, "Error: Unmatched parenthesis in command substitution\n");
+            return -1;
+        }
+        char *body = arena_strndup(&line_arena, s + 2, end - 2);
+        command_substitution(body, out);
+        return end + 1;
+    }
+
+    if (s[1] == '?' || s[1] == '!') {
+        char status[16];
+        int len = (s[1] == '?') ? snprintf(status, sizeof(status), "%d", last_exit_status)
+                                : snprintf(status, sizeof(status), "%ld", (long)last_background_pid);
+        if (s[1] == '?' || last_background_pid > 0) buf_append(out, status, len);
+        return 2;
+    }
+
+    const char *name = s + 1;
+    int name_len;
+    long consumed;
+    if (s[1] == '{') {
+        const char *close = strchr(s, '}');
+        if (close == NULL) {
+            fprintf(stderr, "Error: Unmatched brace in variable expansion\n");
+            return -1;
+        }
+        name = s + 2;
+        name_len = close - name;
+        consumed = close - s + 1;
+    } else {
+        name_len = var_name_end(name);
+        if (name_len == 0) {
+            buf_putc(out, '$');  // Lone '$' is literal
+            return 1;
+        }
+        consumed = name_len + 1;
+    }
+
+    char var_name[256];
+    if (name_len >= (int)sizeof(var_name)) name_len = sizeof(var_name) - 1;
+    strncpy(var_name, name, name_len);
+    var_name[name_len] = '\0';
+
+    char *val = get_variable(&var_store, var_name);
+    if (val) buf_append(out, val, strlen(val));
+    return consumed;
+}
+
+// Takes user's full input and expands variables and command substitutions
+// Quotes are kept as-is; used for text that is not split into words
+// Returns a malloc'd string, or NULL on error
+char *expand_var(const char *input, struct VariableStore *var_store){
+    (void)var_store;  // Lookups go through expand_dollar
+    struct Buffer out;
+    buf_init(&out);
+    buf_reserve(&out, strlen(input));
 
     for (size_t i = 0; input[i] != '\0'; i++) {
         if (input[i] == '\\' && input[i+1] == '$') {
             // Escape sequence, just copy the next character
-            *marker++ = '$';
+            buf_putc(&out, '$');
             i++;
-        } else if (input[i] == '$') {
-            if (input[i+1] == '(') {
-                //handle $(VAR) structure
-                char* end_brace = strchr(input + i, ')');
-                if (!end_brace){
-                    fprintf(stderr, "Error: Unmatched parenthesis in variable expansion\n");
-                    free(out);
-                    return NULL;
-                }
-                               size_t var_name_len = end_brace - (input + i + 2);
-                char var_name[256];
-                strncpy(var_name, input + i + 2, var_name_len);
-                var_name[var_name_len] = '\0';
-
-                char *val = get_variable(var_store, var_name);
-                if (val) {
-                    size_t len = strlen(val);
-                    memcpy(marker, val, len);
-                    marker += len;
-                }
-                i = end_brace - input;
+        } else if (input[i] == '$' || input[i] == '`') {
+            long consumed = expand_dollar(input + i, &out);
+            if (consumed < 0) {
+                buf_free(&out);
+                return NULL;
+            }
+            i += consumed - 1;
+        } else {
+            buf_putc(&out, input[i]);
+        }
+    }
+    return buf_detach(&out);
+}
+
+// Finish the field being built and store it in fields[]
+static void emit_field(struct Buffer *field, char **fields, int *count, int max_fields) {
+    if (*count >= max_fields - 1) {
+        fprintf(stderr, "Warning: Too many arguments, extra words dropped\n");
+        buf_free(field);
+        return;
+    }
+    fields[(*count)++] = arena_adopt(&line_arena, buf_detach(field));
+}
+
+// Expand a raw word into fields: performs $, ` and <(...) expansion, splits the
+// results of unquoted expansions on whitespace, and removes quotes.
+// Fields are allocated in the line arena and fields[] is NULL-terminated.
+// Returns the number of fields, or -1 on error
+static int expand_fields(const char *word, char **fields, int max_fields) {
+    struct Buffer field;
+    buf_init(&field);
+    int have_field = 0;   // Quotes produce a field even when empty
+    int in_double = 0;
+    int count = 0;
+
+    for (size_t i = 0; word[i] != '\0'; i++) {
+        char c = word[i];
+
+        if (c == '\'' && !in_double) {
+            const char *close = strchr(word + i + 1, '\'');
+            size_t len = close ? (size_t)(close - (word + i + 1)) : strlen(word + i + 1);
+            buf_append(&field, word + i + 1, len);
+            have_field = 1;
+            i += len + (close ? 1 : 0);
+        } else if (c == '"') {
+            in_double = !in_double;
+            have_field = 1;
+        } else if (c == '\\' && word[i + 1] != '\0') {
+            // Inside double quotes a backslash only escapes $ ` " and itself
+            if (in_double && !strchr("$`\"\\", word[i + 1])) buf_putc(&field, c);
+            buf_putc(&field, word[++i]);
+            have_field = 1;
+        } else if (!in_double && is_procsubst_start(word + i)) {
+            // The command's end of the pipe is passed as a /dev/fd path
+            long end = find_matching_paren(word, i + 2);
+            if (end < 0) {
+                fprintf(stderr, "Error: Unmatched parenthesis in process substitution\n");
+                buf_free(&field);
+                return -1;
+            }
+            char *body = arena_strndup(&line_arena, word + i + 2, end - i - 2);
+            if (process_substitution(body, c == '>', &field) < 0) {
+                buf_free(&field);
+                return -1;
+            }
+            have_field = 1;
+            i = end;
+        } else if (c == '$' || c == '`') {
+            long consumed;
+            if (in_double) {
+                // Quoted expansions are appended as-is; captured output streams straight into the field
+                consumed = expand_dollar(word + i, &field);
+                have_field = 1;
             } else {
-                //handle $VAR structure
-                int name_len = var_name_end(input + i + 1);
-                if (name_len > 0) {
-                    char var_name[256];
-                    strncpy(var_name, input + i + 1, name_len);
-                    var_name[name_len] = '\0';
-
-                    char *val = get_variable(var_store, var_name);
-                    if (val) {
-                        size_t len = strlen(val);
-                        memcpy(marker, val, len);
-                        marker += len;
+                struct Buffer value;
+                buf_init(&value);
+                consumed = expand_dollar(word + i, &value);
+                size_t k = 0;
+                while (k < value.len) {
+                    if (is_ifs_char(value.data[k])) {
+                        if (have_field) emit_field(&field, fields, &count, max_fields);
+                        have_field = 0;
+                        k++;
+                        continue;
                     }
-                    i += name_len; // skip past var
-                } else {
-                    *marker++ = '$';
+                    // Copy the whole run of non-blank bytes at once
+                    size_t run = k;
+                    while (run < value.len && !is_ifs_char(value.data[run])) run++;
+                    buf_append(&field, value.data + k, run - k);
+                    have_field = 1;
+                    k = run;
                 }
+                buf_free(&value);
             }
+            if (consumed < 0) {
+                buf_free(&field);
+                return -1;
+            }
+            i += consumed - 1;
         } else {
-            *marker++ = input[i];
+            buf_putc(&field, c);
+            have_field = 1;
         }
     }
-    *marker = '\0';
-    return out;
+    if (have_field) emit_field(&field, fields, &count, max_fields);
+    buf_free(&field);
+    fields[count] = NULL;
+    return count;
+}
+
+int expand_word(const char *word, char **fields, int max_fields) {
+    unsigned long long start = TRACE_START();
+    int count = expand_fields(word, fields, max_fields);
+    TRACE_END(TRACE_EXPAND, start, word);
+    return count;
 }
 
 // Returns first non-name char index after start
@@ -141,4 +793,4 @@ int var_name_end(const char *s) {
     // Consume letters, digits, underscores
     while (isalnum((unsigned char)s[i]) || s[i] == '_') i++;
     return i; // index of first char after var name
-}
\ No newline at end of file
+}
@@ -0,0 +1,268 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/shell.h"
+
+// pipestat: per-stage bytes, throughput and blocked time, to show which stage of a
+// pipeline holds the others up.
+//
+// By default one sampler process looks at the pipeline every PIPESTAT_SAMPLE_NS. It reads
+// each writer's output byte count from /proc/PID/io, and each pipe's fill level (FIONREAD)
+// through its reader's /proc/PID/fd/0. The interval since the last sample is charged to
+// the writer as blocked time when the pipe is full, and to the reader as starved time
+// when it is empty. The stages' data never passes through the sampler, so the pipeline
+// runs at full speed; the figures are as exact as the sampling interval.
+//
+// "pipestat -d" (or PIPESTAT=detailed) splits each pipe in two instead, with a relay
+// process splicing data from one half to the other. The relay counts the bytes and the
+// time spent waiting on either side exactly, at the cost of an extra copy of every byte.
+//
+// Counters live in shared memory that the shell reads when the job finishes and
+// whenever "jobs" runs.
+
+#define PIPESTAT_SAMPLE_NS 1000000L   // 1ms
+
+// Relays and the sampler update counters while the shell may be reading them
+static void stat_add(unsigned long long *counter, unsigned long long amount) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+static unsigned long long stat_get(const unsigned long long *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+// Allocate a pipeline's shared counters and record its stage names
+// Returns NULL if the mapping fails (the pipeline then runs without pipestat)
+struct PipeStatTable *pipestat_create(struct Pipeline *pipeline, int mode) {
+    struct PipeStatTable *table = mmap(NULL, sizeof(struct PipeStatTable), PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+        perror("pipestat: mmap failed");
+        return NULL;
+    }
+    table->stage_count = pipeline->pipe_count + 1;
+    table->mode = mode;
+    table->start_ns = monotonic_ns();
+    for (int i = 0; i < table->stage_count; i++) {
+        const char *name = pipeline->commands[i].argv[0];
+        if (pipeline->commands[i].group != NULL) name = "(group)";
+        snprintf(table->names[i], sizeof(table->names[i]), "%s", name ? name : "");
+    }
+    return table;   // Anonymous mappings start zeroed
+}
+
+void pipestat_free(struct PipeStatTable *table) {
+    if (table != NULL) munmap(table, sizeof(struct PipeStatTable));
+}
+
+// Wait until fd is ready for events, adding the time spent to *wait_ns
+// Returns the revents, or 0 on error
+static short wait_ready(int fd, short events, unsigned long long *wait_ns) {
+    struct pollfd pfd = { .fd = fd, .events = events };
+    unsigned long long start = monotonic_ns();
+    int ready;
+    do {
+        ready = poll(&pfd, 1, -1);
+    } while (ready < 0 && errno == EINTR);
+    stat_add(wait_ns, monotonic_ns() - start);
+    return ready > 0 ? pfd.revents : 0;
+}
+
+// Relay body: move everything from in_fd to out_fd with non-blocking splice, and
+// account the time when neither side was ready
+static void run_relay(struct PipeStatLink *link, int in_fd, int out_fd) {
+    int keep[2] = { in_fd, out_fd };
+    close_other_fds(keep, 2);
+    signal(SIGPIPE, SIG_IGN);  // A reader that quits ends the relay; the writer then gets SIGPIPE
+
+    link->start_ns = monotonic_ns();
+    size_t chunk = fcntl(out_fd, F_GETPIPE_SZ) > 0 ? (size_t)fcntl(out_fd, F_GETPIPE_SZ) : 65536;
+
+    while (1) {
+        ssize_t n = splice(in_fd, NULL, out_fd, NULL, chunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            stat_add(&link->bytes, n);
+            continue;
+        }
+        if (n == 0) break;  // Writer closed and the pipe is drained
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN) break;
+
+        // Either the input is empty or the output is full; find out which and wait on it
+        struct pollfd probe[2] = { { .fd = in_fd, .events = POLLIN }, { .fd = out_fd, .events = POLLOUT } };
+        poll(probe, 2, 0);
+        if (probe[1].revents & (POLLERR | POLLHUP)) break;
+        if (!(probe[0].revents & (POLLIN | POLLHUP))) {
+            if (!(wait_ready(in_fd, POLLIN, &link->read_wait_ns) & (POLLIN | POLLHUP))) break;
+        } else if (!(probe[1].revents & POLLOUT)) {
+            if (!(wait_ready(out_fd, POLLOUT, &link->write_wait_ns) & POLLOUT)) break;
+        }
+    }
+    __atomic_store_n(&link->end_ns, monotonic_ns(), __ATOMIC_RELAXED);
+    _exit(0);
+}
+
+// Start the relay for pipe number link: it reads in_fd and writes out_fd.
+// The caller closes its copies of both afterwards.
+// Returns the relay's pid, or -1 on error
+pid_t pipestat_start_relay(struct PipeStatTable *table, int link, int in_fd, int out_fd) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid > 0) STAT_INC(STAT_FORKS);
+    if (pid < 0) {
+        perror("pipestat: fork failed");
+        return -1;
+    }
+    // Keeps the shell's SIGINT/SIGTSTP handling so it drains what the stages wrote
+    if (pid == 0) run_relay(&table->links[link], in_fd, out_fd);
+    return pid;
+}
+
+// Take one fill-level sample of a pipe, charging the dt_ns since the last one to the
+// reader (pipe empty) or the writer (pipe full)
+// Returns 0 once the pipe's reader has exited, 1 otherwise
+static int sample_fill(struct PipeStatLink *link, unsigned long long dt_ns) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%ld/fd/0", (long)link->reader);
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    int queued = 0;
+    int capacity = fcntl(fd, F_GETPIPE_SZ);
+    // Otherwise stdin is not (or not yet, right after fork) the pipe; look again next time
+    if (fstat(fd, &st) == 0 && st.st_ino == link->inode && capacity > 0 && ioctl(fd, FIONREAD, &queued) == 0) {
+        stat_add(&link->samples, 1);
+        stat_add(&link->fill_sum, (unsigned long long)queued * 100 / capacity);
+        if (queued == 0) stat_add(&link->read_wait_ns, dt_ns);
+        else if (queued >= capacity - PIPE_BUF) stat_add(&link->write_wait_ns, dt_ns);
+    }
+    close(fd);
+    return 1;
+}
+
+// Bytes a process has written so far (wchar in /proc/PID/io)
+// Returns 0, or -1 once the process is gone
+static int read_wchar(pid_t pid, unsigned long long *wchar) {
+    char path[64], buf[512];
+    snprintf(path, sizeof(path), "/proc/%ld/io", (long)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+    const char *field = strstr(buf, "wchar:");
+    if (field == NULL) return -1;
+    *wchar = strtoull(field + 6, NULL, 10);
+    return 0;
+}
+
+// Sampler body: every PIPESTAT_SAMPLE_NS, read each pipe's fill level through its reader
+// and each writer's output byte count, until all of the stages are gone. A writer's count
+// is its total output (stderr included) as of the last sample before it exited.
+static void run_sampler(struct PipeStatTable *table) {
+    close_other_fds(NULL, 0);
+    int links = table->stage_count - 1;
+    int reading[MAX_COMMANDS - 1], writing[MAX_COMMANDS - 1];
+    unsigned long long last = monotonic_ns();
+    for (int i = 0; i < links; i++) {
+        __atomic_store_n(&table->links[i].start_ns, last, __ATOMIC_RELAXED);
+        reading[i] = table->links[i].reader > 0;
+        writing[i] = table->links[i].writer > 0;
+    }
+
+    struct timespec tick = { 0, PIPESTAT_SAMPLE_NS };
+    int running = links;
+    while (running > 0) {
+        unsigned long long now = monotonic_ns();
+        running = 0;
+        for (int i = 0; i < links; i++) {
+            struct PipeStatLink *link = &table->links[i];
+            if (writing[i]) {
+                unsigned long long wchar;
+                if (read_wchar(link->writer, &wchar) == 0) {
+                    __atomic_store_n(&link->bytes, wchar, __ATOMIC_RELAXED);
+                } else {
+                    writing[i] = 0;
+                    __atomic_store_n(&link->end_ns, now, __ATOMIC_RELAXED);
+                }
+            }
+            if (reading[i]) reading[i] = sample_fill(link, now - last);
+            running += reading[i] || writing[i];
+        }
+        last = now;
+        nanosleep(&tick, NULL);
+    }
+    _exit(0);
+}
+
+// Start the sampler once the stages are running and each link knows its reader and inode
+// Returns the sampler's pid, or -1 on error
+pid_t pipestat_start_sampler(struct PipeStatTable *table) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid > 0) STAT_INC(STAT_FORKS);
+    if (pid < 0) {
+        perror("pipestat: fork failed");
+        return -1;
+    }
+    if (pid == 0) run_sampler(table);
+    return pid;
+}
+
+// Print per-stage bytes, throughput and blocked time.
+// A stage's output is what went into the pipe after it; it was blocked on write while
+// that pipe was full, and blocked on read while the pipe before it was empty. The first stage's input and last stage's output are not
+// measured and show as "-". Sampled figures are as exact as the sampling interval; the
+// sampled report also shows how full each stage's output pipe was on average.
+void pipestat_report(FILE *out, const struct PipeStatTable *table) {
+    int sampled = table->mode == PIPESTAT_SAMPLED;
+    unsigned long long now = monotonic_ns();
+    char bytes[32], rate[32], read_wait[32], write_wait[32], fill[16];
+
+    fprintf(out, "  %-5s %-16s %10s %10s %12s %12s%s\n", "stage", "command", "bytes out", "MB/s",
+            "read-wait", "write-wait", sampled ? "   out-fill" : "");
+    for (int i = 0; i < table->stage_count; i++) {
+        const struct PipeStatLink *down = (i < table->stage_count - 1) ? &table->links[i] : NULL;
+        const struct PipeStatLink *up = (i > 0) ? &table->links[i - 1] : NULL;
+
+        snprintf(bytes, sizeof(bytes), "-");
+        snprintf(rate, sizeof(rate), "-");
+        snprintf(read_wait, sizeof(read_wait), "-");
+        snprintf(write_wait, sizeof(write_wait), "-");
+        snprintf(fill, sizeof(fill), "-");
+
+        if (down != NULL && stat_get(&down->start_ns) != 0) {
+            unsigned long long moved = stat_get(&down->bytes);
+            unsigned long long end = stat_get(&down->end_ns) ? stat_get(&down->end_ns) : now;
+            double seconds = (double)(end - stat_get(&down->start_ns)) / 1e9;
+            format_bytes(bytes, sizeof(bytes), moved);
+            snprintf(rate, sizeof(rate), "%.1f", seconds > 0 ? moved / seconds / 1e6 : 0.0);
+            snprintf(write_wait, sizeof(write_wait), "%.3fs", stat_get(&down->write_wait_ns) / 1e9);
+            if (stat_get(&down->samples) > 0)
+                snprintf(fill, sizeof(fill), "%.0f%%", (double)stat_get(&down->fill_sum) / stat_get(&down->samples));
+        }
+        if (up != NULL && stat_get(&up->start_ns) != 0)
+            snprintf(read_wait, sizeof(read_wait), "%.3fs", stat_get(&up->read_wait_ns) / 1e9);
+
+        if (sampled) {
+            fprintf(out, "  %-5d %-16.16s %10s %10s %12s %12s %10s\n", i + 1, table->names[i], bytes, rate,
+                    read_wait, write_wait, fill);
+        } else {
+            fprintf(out, "  %-5d %-16.16s %10s %10s %12s %12s\n", i + 1, table->names[i], bytes, rate,
+                    read_wait, write_wait);
+        }
+    }
+}
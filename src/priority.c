@@ -0,0 +1,143 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "../include/shell.h"
+
+// Background priority. BG_PRIORITY="nice=10,io=idle" (or "on" for those defaults) lowers
+// the CPU and I/O priority of every job that runs in the background, whether it started
+// with & or was moved there with bg, so it yields to whatever runs in the foreground.
+// fg puts the shell's own priorities back. io is "idle", a best-effort level 0-7, or
+// "keep" to leave I/O priority alone.
+//
+// Raising priority again needs CAP_SYS_NICE (or a RLIMIT_NICE allowance) for the nice
+// value; without it fg says so once and the job keeps running reniced.
+
+// <linux/ioprio.h> is not in every libc's headers
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_WHO_PGRP 2
+#define IOPRIO_VALUE(cls, data) (((cls) << IOPRIO_CLASS_SHIFT) | (data))
+
+static int nice_increment;       // Added to the shell's nice value; 0 leaves CPU priority alone
+static int background_ioprio;    // ioprio for background jobs; -1 leaves I/O priority alone
+static int enabled;
+static char *current_setting;    // The BG_PRIORITY value the settings above came from
+static int warned_restore;
+
+static int ioprio_set(int which, int who, int ioprio) {
+    return (int)syscall(SYS_ioprio_set, which, who, ioprio);
+}
+
+static int ioprio_get(int which, int who) {
+    return (int)syscall(SYS_ioprio_get, which, who);
+}
+
+// Parse BG_PRIORITY
+// Returns 1 if enabled, 0 if off, -1 if the setting is invalid
+static int parse_setting(const char *setting) {
+    nice_increment = 10;
+    background_ioprio = IOPRIO_VALUE(IOPRIO_CLASS_IDLE, 0);
+    if (strcmp(setting, "off") == 0 || strcmp(setting, "0") == 0) return 0;
+    if (strcmp(setting, "on") == 0) return 1;
+
+    char *copy = strdup(setting);
+    if (copy == NULL) return -1;
+    int valid = 1;
+    for (char *item = strtok(copy, ","); item != NULL && valid; item = strtok(NULL, ",")) {
+        char *value = strchr(item, '=');
+        if (value == NULL) {
+            valid = 0;
+            break;
+        }
+        *value++ = '\0';
+        char *end;
+        if (strcmp(item, "nice") == 0) {
+            long n = strtol(value, &end, 10);
+            valid = end != value && *end == '\0' && n >= 0 && n <= 39;
+            nice_increment = (int)n;
+        } else if (strcmp(item, "io") == 0) {
+            if (strcmp(value, "idle") == 0) {
+                background_ioprio = IOPRIO_VALUE(IOPRIO_CLASS_IDLE, 0);
+            } else if (strcmp(value, "keep") == 0) {
+                background_ioprio = -1;
+            } else {
+                long level = strtol(value, &end, 10);
+                valid = end != value && *end == '\0' && level >= 0 && level <= 7;
+                background_ioprio = IOPRIO_VALUE(IOPRIO_CLASS_BE, (int)level);
+            }
+        } else {
+            valid = 0;
+        }
+    }
+    free(copy);
+    return valid ? 1 : -1;
+}
+
+// Follow changes to BG_PRIORITY
+// Returns 1 if background jobs should be deprioritized
+int update_bg_priority(void) {
+    const char *setting = get_variable(&var_store, "BG_PRIORITY");
+    if (setting == NULL || setting[0] == '\0') setting = "off";
+    if (current_setting != NULL && strcmp(setting, current_setting) == 0) return enabled;
+    free(current_setting);
+    current_setting = strdup(setting);
+
+    enabled = parse_setting(setting);
+    if (enabled < 0) {
+        fprintf(stderr, "BG_PRIORITY: %s: expected on, off or nice=N,io=idle|0-7|keep\n", setting);
+        enabled = 0;
+    }
+    return enabled;
+}
+
+// The shell's nice value, which background jobs are lowered from and fg restores
+static int shell_nice(void) {
+    errno = 0;
+    int value = getpriority(PRIO_PROCESS, 0);
+    return (value == -1 && errno != 0) ? 0 : value;
+}
+
+// Apply priorities to a job's process group, or to each of its processes when it has none
+// Returns 0 on success, -1 with errno set if the nice value could not be changed
+static int set_job_priority(struct Job *job, int nice_value, int ioprio) {
+    int failure = 0;
+    if (job->pid_count > 0 && getpgid(job->pids[0]) == job->pids[0]) {
+        if (setpriority(PRIO_PGRP, job->pids[0], nice_value) < 0) failure = errno;
+        if (ioprio >= 0) ioprio_set(IOPRIO_WHO_PGRP, job->pids[0], ioprio);
+    } else {
+        for (int i = 0; i < job->pid_count; i++) {
+            if (job->pid_status[i] == 0) continue;
+            if (setpriority(PRIO_PROCESS, job->pids[i], nice_value) < 0 && errno != ESRCH) failure = errno;
+            if (ioprio >= 0) ioprio_set(IOPRIO_WHO_PROCESS, job->pids[i], ioprio);
+        }
+    }
+    errno = failure;
+    return failure ? -1 : 0;
+}
+
+// A job just started with & (all of its stages forked) or moved to the background with bg.
+// The shell sets the whole process group rather than each child lowering itself, so an
+// fg straight after & cannot restore priorities before a child gets round to lowering them.
+void lower_job_priority(struct Job *job) {
+    if (!update_bg_priority() || job->deprioritized) return;
+    set_job_priority(job, nice_increment > 0 ? shell_nice() + nice_increment : shell_nice(), background_ioprio);
+    job->deprioritized = 1;
+}
+
+// A job coming back to the foreground with fg gets the shell's priorities back
+void restore_job_priority(struct Job *job) {
+    if (!job->deprioritized) return;
+    job->deprioritized = 0;
+    int ioprio = background_ioprio >= 0 ? ioprio_get(IOPRIO_WHO_PROCESS, 0) : -1;
+    if (set_job_priority(job, shell_nice(), ioprio) < 0 && errno == EACCES && !warned_restore) {
+        fprintf(stderr, "fg: cannot raise job %d's CPU priority again without CAP_SYS_NICE\n", job->job_id);
+        warned_restore = 1;
+    }
+}
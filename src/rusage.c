@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../include/shell.h"
+
+// Resource accounting for jobs. Every process of a job is reaped with wait4(), wherever
+// that happens (the foreground wait, fg, job cleanup or the SIGCHLD handler), and its
+// rusage is kept in the job. "time pipeline" prints the totals and a row per process
+// when the job finishes; "jobs -l" prints the same rows for every job, reading
+// /proc/PID for processes that are still running.
+
+// Start the job's clock; createJob() calls this as its processes are recorded
+void job_usage_start(struct Job *job) {
+    job->start_ns = monotonic_ns();
+    for (int i = 0; i < job->pid_count; i++) {
+        memset(&job->pid_usage[i], 0, sizeof(job->pid_usage[i]));
+        job->pid_end_ns[i] = 0;
+    }
+}
+
+// Record a process of the job that wait4() returned; async-signal-safe
+void job_pid_reaped(struct Job *job, int index, int wstatus, const struct rusage *usage) {
+    job->pid_exit[index] = wait_status_to_exit(wstatus);
+    if (WIFSTOPPED(wstatus)) return;
+    job->pid_status[index] = 0;
+    job->pid_usage[index] = *usage;
+    job->pid_end_ns[index] = monotonic_ns();
+    for (int i = 0; i < job->pid_count; i++) {
+        if (job->pid_status[i] != 0) return;
+    }
+    STAT_INC(STAT_JOBS_REAPED);  // That was the job's last process
+}
+
+// Usage so far of a process that is still running, from /proc/PID/stat and /proc/PID/status
+// Returns 0, or -1 if the process is gone
+static int live_usage(pid_t pid, struct rusage *ru) {
+    char path[64], buf[2048];
+    memset(ru, 0, sizeof(*ru));
+
+    snprintf(path, sizeof(path), "/proc/%ld/stat", (long)pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return -1;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    // Fields after the command name, which may itself contain spaces and ')'
+    char *p = strrchr(buf, ')');
+    unsigned long minflt, majflt, utime, stime;
+    if (p == NULL || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %lu %*u %lu %*u %lu %lu",
+                            &minflt, &majflt, &utime, &stime) != 4)
+        return -1;
+    long ticks = sysconf(_SC_CLK_TCK);
+    if (ticks <= 0) ticks = 100;
+    ru->ru_minflt = minflt;
+    ru->ru_majflt = majflt;
+    ru->ru_utime.tv_sec = utime / ticks;
+    ru->ru_utime.tv_usec = (utime % ticks) * 1000000 / ticks;
+    ru->ru_stime.tv_sec = stime / ticks;
+    ru->ru_stime.tv_usec = (stime % ticks) * 1000000 / ticks;
+
+    snprintf(path, sizeof(path), "/proc/%ld/status", (long)pid);
+    f = fopen(path, "r");
+    if (f == NULL) return 0;
+    while (fgets(buf, sizeof(buf), f) != NULL) {
+        sscanf(buf, "VmHWM: %ld", &ru->ru_maxrss);
+        sscanf(buf, "voluntary_ctxt_switches: %ld", &ru->ru_nvcsw);
+        sscanf(buf, "nonvoluntary_ctxt_switches: %ld", &ru->ru_nivcsw);
+    }
+    fclose(f);
+    return 0;
+}
+
+static double seconds_of(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// A process's usage: what wait4() reported, or a live reading while it runs
+// Returns 0, or -1 if nothing is known about it
+static int process_usage(struct Job *job, int i, struct rusage *ru) {
+    if (job->pid_status[i] == 0) {
+        *ru = job->pid_usage[i];
+        return job->pid_end_ns[i] != 0 ? 0 : -1;
+    }
+    return live_usage(job->pids[i], ru);
+}
+
+// One row per process: wall time, CPU time, peak RSS, context switches and page faults
+void job_usage_report(FILE *out, struct Job *job) {
+    unsigned long long now = monotonic_ns();
+    fprintf(out, "  %-8s %-16s %9s %9s %9s %8s %8s %8s %8s %7s\n", "pid", "command", "real", "user",
+            "sys", "maxrss", "vcsw", "ivcsw", "minflt", "majflt");
+    for (int i = 0; i < job->pid_count; i++) {
+        struct rusage ru;
+        if (process_usage(job, i, &ru) < 0) {
+            fprintf(out, "  %-8ld %-16.16s %9s\n", (long)job->pids[i], job->pid_names[i], "-");
+            continue;
+        }
+        unsigned long long end = job->pid_end_ns[i] ? job->pid_end_ns[i] : now;
+        char rss[32];
+        format_bytes(rss, sizeof(rss), (unsigned long long)ru.ru_maxrss * 1024);
+        fprintf(out, "  %-8ld %-16.16s %8.3fs %8.3fs %8.3fs %8s %8ld %8ld %8ld %7ld\n", (long)job->pids[i],
+                job->pid_names[i], (end - job->start_ns) / 1e9, seconds_of(ru.ru_utime), seconds_of(ru.ru_stime),
+                rss, ru.ru_nvcsw, ru.ru_nivcsw, ru.ru_minflt, ru.ru_majflt);
+    }
+}
+
+// time: once a timed job has finished, print its totals (like the shell keyword) and
+// the per-process table to stderr
+void job_time_report(struct Job *job) {
+    if (!job->timed || job->state != JOB_DONE) return;
+    job->timed = 0;
+
+    unsigned long long end = job->start_ns;
+    double user = 0, sys = 0;
+    for (int i = 0; i < job->pid_count; i++) {
+        if (job->pid_end_ns[i] > end) end = job->pid_end_ns[i];
+        user += seconds_of(job->pid_usage[i].ru_utime);
+        sys += seconds_of(job->pid_usage[i].ru_stime);
+    }
+    fflush(stdout);
+    fprintf(stderr, "\nreal\t%.3fs\nuser\t%.3fs\nsys\t%.3fs\n", (end - job->start_ns) / 1e9, user, sys);
+    job_usage_report(stderr, job);
+}
@@ -0,0 +1,152 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "../include/shell.h"
+
+// Always-on counters and latency histograms. The shell counts forks, execs, PATH probes,
+// variable lookups, environment rebuilds, jobs and the bytes its buffers and arenas
+// allocate, and keeps log2-bucketed histograms of parse time, spawn time (first fork to
+// last fork of a pipeline) and command-to-prompt time. "shellstat" prints them for
+// people, "shellstat -m" in the Prometheus text format for scrapers, "shellstat -r"
+// starts over.
+//
+// The counters live in a MAP_SHARED mapping, so a child counts its PATH probes and exec
+// (or exec failure) into the shell's totals before it becomes another program. Updates
+// are relaxed atomic adds.
+
+static struct ShellStats private_stats;  // Until shellstat_init(), or if mmap fails
+struct ShellStats *shell_stats = &private_stats;
+
+static const char *counter_names[STAT_COUNTER_COUNT] = {
+    [STAT_FORKS] = "forks",
+    [STAT_EXECS] = "execs",
+    [STAT_EXEC_FAILURES] = "exec_failures",
+    [STAT_PATH_PROBES] = "path_probes",
+    [STAT_VAR_LOOKUPS] = "var_lookups",
+    [STAT_ENV_REBUILDS] = "env_rebuilds",
+    [STAT_JOBS_CREATED] = "jobs_created",
+    [STAT_JOBS_REAPED] = "jobs_reaped",
+    [STAT_BYTES_ALLOCATED] = "bytes_allocated",
+};
+
+static const char *latency_names[LATENCY_COUNT] = {
+    [LATENCY_PARSE] = "parse",
+    [LATENCY_SPAWN] = "spawn",
+    [LATENCY_COMMAND] = "command",
+};
+
+static const char *latency_titles[LATENCY_COUNT] = {
+    [LATENCY_PARSE] = "parse time",
+    [LATENCY_SPAWN] = "spawn time",
+    [LATENCY_COMMAND] = "command-to-prompt time",
+};
+
+void shellstat_init(void) {
+    struct ShellStats *shared = mmap(NULL, sizeof(struct ShellStats), PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("shellstat: mmap failed");
+        return;
+    }
+    shell_stats = shared;
+}
+
+// Bucket 0 holds latencies under 1us, bucket k those in [2^(k-1), 2^k) us; the last is open
+static int latency_bucket(unsigned long long ns) {
+    unsigned long long us = ns / 1000;
+    int bucket = 0;
+    while (us > 0 && bucket < LATENCY_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// Add the time since start_ns (a monotonic_ns() value) to a histogram
+void record_latency(int which, unsigned long long start_ns) {
+    unsigned long long ns = monotonic_ns() - start_ns;
+    __atomic_fetch_add(&shell_stats->buckets[which][latency_bucket(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&shell_stats->latency_count[which], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&shell_stats->latency_sum_ns[which], ns, __ATOMIC_RELAXED);
+}
+
+// Upper bound of a bucket in microseconds
+static unsigned long long bucket_limit_us(int bucket) {
+    return 1ULL << bucket;
+}
+
+static void format_us(char *buf, size_t size, unsigned long long us) {
+    if (us < 1000) snprintf(buf, size, "%lluus", us);
+    else if (us < 1000000) snprintf(buf, size, "%llums", us / 1000);
+    else snprintf(buf, size, "%llus", us / 1000000);
+}
+
+static void print_human(const struct ShellStats *s) {
+    for (int i = 0; i < STAT_COUNTER_COUNT; i++) printf("%-16s %llu\n", counter_names[i], s->counters[i]);
+
+    for (int h = 0; h < LATENCY_COUNT; h++) {
+        unsigned long long count = s->latency_count[h];
+        printf("\n%s: %llu samples", latency_titles[h], count);
+        if (count > 0) printf(", mean %.1fus", s->latency_sum_ns[h] / 1e3 / count);
+        printf("\n");
+
+        unsigned long long peak = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) if (s->buckets[h][b] > peak) peak = s->buckets[h][b];
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            if (s->buckets[h][b] == 0) continue;
+            char low[16], high[16];
+            format_us(low, sizeof(low), b == 0 ? 0 : bucket_limit_us(b - 1));
+            format_us(high, sizeof(high), bucket_limit_us(b));
+            int bar = (int)(s->buckets[h][b] * 40 / peak);
+            printf("  %6s - %-6s %8llu %.*s\n", low, high, s->buckets[h][b], bar > 0 ? bar : 1,
+                   "########################################");
+        }
+    }
+}
+
+// Prometheus text exposition format
+static void print_machine(const struct ShellStats *s) {
+    for (int i = 0; i < STAT_COUNTER_COUNT; i++) {
+        printf("# TYPE mysh_%s_total counter\n", counter_names[i]);
+        printf("mysh_%s_total %llu\n", counter_names[i], s->counters[i]);
+    }
+    for (int h = 0; h < LATENCY_COUNT; h++) {
+        const char *name = latency_names[h];
+        printf("# TYPE mysh_%s_seconds histogram\n", name);
+        unsigned long long cumulative = 0;
+        for (int b = 0; b < LATENCY_BUCKETS - 1; b++) {
+            cumulative += s->buckets[h][b];
+            printf("mysh_%s_seconds_bucket{le=\"%g\"} %llu\n", name, bucket_limit_us(b) / 1e6, cumulative);
+        }
+        printf("mysh_%s_seconds_bucket{le=\"+Inf\"} %llu\n", name, s->latency_count[h]);
+        printf("mysh_%s_seconds_sum %.9f\n", name, s->latency_sum_ns[h] / 1e9);
+        printf("mysh_%s_seconds_count %llu\n", name, s->latency_count[h]);
+    }
+}
+
+// shellstat [-m | -r]
+int builtin_shellstat(char **argv) {
+    if (argv[1] != NULL && strcmp(argv[1], "-r") == 0) {
+        memset(shell_stats, 0, sizeof(*shell_stats));
+        return 0;
+    }
+    if (argv[1] != NULL && strcmp(argv[1], "-m") != 0) {
+        fprintf(stderr, "shellstat: usage: shellstat [-m | -r]\n");
+        return 1;
+    }
+
+    // Take a copy so every line comes from the same moment, more or less
+    struct ShellStats snapshot;
+    memcpy(&snapshot, shell_stats, sizeof(snapshot));
+    // The +Inf bucket must match the buckets even if a sample landed mid-copy
+    for (int h = 0; h < LATENCY_COUNT; h++) {
+        unsigned long long total = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) total += snapshot.buckets[h][b];
+        snapshot.latency_count[h] = total;
+    }
+
+    if (argv[1] != NULL) print_machine(&snapshot);
+    else print_human(&snapshot);
+    return 0;
+}
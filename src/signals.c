@@ -7,20 +7,29 @@
 void sigchld_handler(int sig) {
     int status;
     pid_t pid;
+    struct rusage usage;
 
-    // Reap all finished children and mark them as done
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) > 0) {
+    // Reap all finished children and mark them as done; note stops and continues too
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {
         for (int i = 0; i < job_table.job_count; i++) {
             for (int j = 0; j < job_table.jobs[i].pid_count; j++) {
                 if (job_table.jobs[i].pids[j] == pid) {
-                    // Mark this specific PID as finished
-                    job_table.jobs[i].pid_status[j] = 0;
+                    struct Job *job = &job_table.jobs[i];
+                    if (WIFCONTINUED(status)) {
+                        // Resumed by someone else's SIGCONT (fg and bg set the state themselves)
+                        if (job->state == JOB_STOPPED) job->state = JOB_RUNNING;
+                        goto next_pid;
+                    }
+                    job_pid_reaped(job, j, status, &usage);
 
                     if (WIFSTOPPED(status)) {
-                        job_table.jobs[i].state = JOB_STOPPED;
-                        job_table.jobs[i].is_background = 1;
+                        job->state = JOB_STOPPED;
+                        job->is_background = 1;
                     } else if (WIFEXITED(status) || WIFSIGNALED(status)) {
-                        job_table.jobs[i].state = JOB_DONE;
+                        // The job is done with its last PID
+                        int running = 0;
+                        for (int k = 0; k < job->pid_count; k++) running |= job->pid_status[k];
+                        if (!running) job->state = JOB_DONE;
                     }
                     goto next_pid;
                 }
@@ -28,4 +37,5 @@ void sigchld_handler(int sig) {
         }
     next_pid:;
     }
+    jobshm_stale = 1;  // Published from the main loop (jobshm_sync)
 }
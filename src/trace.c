@@ -0,0 +1,200 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "../include/shell.h"
+
+// Event trace. "trace on [RECORDS]" starts recording where the time of each command line
+// goes (parse, expansion, PATH lookup, environment, fork, exec, wait, handing over the
+// terminal) as fixed-size records with CLOCK_MONOTONIC timestamps in a ring, keeping the
+// newest RECORDS (default 16384). "trace dump FILE" writes the ring as Chrome trace JSON,
+// which chrome://tracing and ui.perfetto.dev open; "trace off" stops recording and
+// "trace clear" empties the ring.
+//
+// The ring is a MAP_SHARED mapping, so children record their PATH lookup and exec into it
+// too; writers claim a slot with an atomic add and publish it with a sequence number, so
+// no lock is taken. While tracing is off every trace point costs one pointer test.
+
+#define DEFAULT_TRACE_RECORDS 16384
+
+struct TraceRecord {
+    uint64_t seq;         // Index + 1 once the record is complete; 0 while being written
+    uint64_t start_ns;
+    uint64_t dur_ns;
+    int32_t tid;          // Process that recorded it
+    uint16_t event;
+    uint16_t instant;     // A point in time rather than a span
+    char detail[32];
+};
+
+struct TraceRing {
+    uint64_t head;        // Records claimed so far; the newest capacity of them are kept
+    size_t capacity;
+    size_t map_size;
+    pid_t shell_pid;
+    struct TraceRecord records[];
+};
+
+struct TraceRing *trace_ring;   // The ring while recording, NULL while tracing is off
+static struct TraceRing *ring;  // Kept after "trace off" so it can still be dumped
+
+static const char *event_names[TRACE_EVENT_COUNT] = {
+    [TRACE_COMMAND] = "command",
+    [TRACE_PARSE] = "parse",
+    [TRACE_EXPAND] = "expand",
+    [TRACE_PATH_LOOKUP] = "path lookup",
+    [TRACE_ENVIRON] = "build environ",
+    [TRACE_FORK] = "fork",
+    [TRACE_EXEC] = "exec",
+    [TRACE_WAIT] = "wait",
+    [TRACE_TERMINAL] = "tcsetpgrp",
+};
+
+static void append(int event, unsigned long long start_ns, unsigned long long dur_ns, int instant,
+                   const char *detail) {
+    struct TraceRing *r = trace_ring;
+    if (r == NULL) return;
+    uint64_t n = __atomic_fetch_add(&r->head, 1, __ATOMIC_RELAXED);
+    struct TraceRecord *rec = &r->records[n % r->capacity];
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    rec->start_ns = start_ns;
+    rec->dur_ns = dur_ns;
+    rec->tid = (int32_t)getpid();
+    rec->event = (uint16_t)event;
+    rec->instant = (uint16_t)instant;
+    snprintf(rec->detail, sizeof(rec->detail), "%s", detail != NULL ? detail : "");
+    __atomic_store_n(&rec->seq, n + 1, __ATOMIC_RELEASE);
+}
+
+// A span from start_ns (a TRACE_START() value) until now; use TRACE_END()
+void trace_record(int event, unsigned long long start_ns, const char *detail) {
+    if (start_ns == 0) return;  // Started before tracing was turned on
+    unsigned long long now = monotonic_ns();
+    append(event, start_ns, now - start_ns, 0, detail);
+}
+
+// A point in time; use TRACE_MARK()
+void trace_mark(int event, const char *detail) {
+    append(event, monotonic_ns(), 0, 1, detail);
+}
+
+static int trace_start(long records) {
+    if (ring != NULL && (long)ring->capacity != records) {
+        trace_ring = NULL;
+        munmap(ring, ring->map_size);
+        ring = NULL;
+    }
+    if (ring == NULL) {
+        size_t map_size = sizeof(struct TraceRing) + (size_t)records * sizeof(struct TraceRecord);
+        struct TraceRing *r = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (r == MAP_FAILED) {
+            perror("trace: mmap failed");
+            return 1;
+        }
+        r->capacity = (size_t)records;
+        r->map_size = map_size;
+        ring = r;
+    }
+    ring->shell_pid = getpid();
+    trace_ring = ring;
+    return 0;
+}
+
+// Write s as the body of a JSON string
+static void json_string(FILE *out, const char *s) {
+    for (; *s != '\0'; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+}
+
+// Chrome trace event format: complete ("X") events for spans, instant ("i") events for points
+static int trace_dump(const char *path) {
+    if (ring == NULL) {
+        fprintf(stderr, "trace: nothing recorded (start with trace on)\n");
+        return 1;
+    }
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > ring->capacity ? head - ring->capacity : 0;
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"args\":{\"name\":\"mysh\"}}",
+            (long)ring->shell_pid);
+    for (uint64_t n = first; n < head; n++) {
+        struct TraceRecord rec = ring->records[n % ring->capacity];
+        if (__atomic_load_n(&ring->records[n % ring->capacity].seq, __ATOMIC_ACQUIRE) != n + 1 || rec.seq != n + 1)
+            continue;  // Overwritten or still being written
+        const char *name = rec.event < TRACE_EVENT_COUNT ? event_names[rec.event] : "unknown";
+        fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"mysh\",\"pid\":%ld,\"tid\":%ld,\"ts\":%.3f", name,
+                (long)ring->shell_pid, (long)rec.tid, rec.start_ns / 1e3);
+        if (rec.instant) fprintf(out, ",\"ph\":\"i\",\"s\":\"t\"");
+        else fprintf(out, ",\"ph\":\"X\",\"dur\":%.3f", rec.dur_ns / 1e3);
+        if (rec.detail[0] != '\0') {
+            rec.detail[sizeof(rec.detail) - 1] = '\0';
+            fprintf(out, ",\"args\":{\"detail\":\"");
+            json_string(out, rec.detail);
+            fprintf(out, "\"}");
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n]}\n");
+    if (fclose(out) == EOF) {
+        perror(path);
+        return 1;
+    }
+    return 0;
+}
+
+// trace on [RECORDS] | off | clear | dump FILE; with no arguments, say whether it is on
+int builtin_trace(char **argv) {
+    if (argv[1] == NULL) {
+        if (ring == NULL) {
+            printf("trace: off\n");
+        } else {
+            uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+            printf("trace: %s, %llu of %zu records used\n", trace_ring != NULL ? "on" : "off",
+                   (unsigned long long)(head < ring->capacity ? head : ring->capacity), ring->capacity);
+        }
+        return 0;
+    }
+    if (strcmp(argv[1], "on") == 0) {
+        long records = DEFAULT_TRACE_RECORDS;
+        if (argv[2] != NULL) {
+            char *end;
+            records = strtol(argv[2], &end, 10);
+            if (end == argv[2] || *end != '\0' || records <= 0 || records > 1L << 24) {
+                fprintf(stderr, "trace: %s: expected a number of records\n", argv[2]);
+                return 1;
+            }
+        }
+        return trace_start(records);
+    }
+    if (strcmp(argv[1], "off") == 0) {
+        trace_ring = NULL;
+        return 0;
+    }
+    if (strcmp(argv[1], "clear") == 0) {
+        if (ring != NULL) __atomic_store_n(&ring->head, 0, __ATOMIC_RELEASE);
+        return 0;
+    }
+    if (strcmp(argv[1], "dump") == 0) {
+        if (argv[2] == NULL) {
+            fprintf(stderr, "trace: dump: missing file name\n");
+            return 1;
+        }
+        return trace_dump(argv[2]);
+    }
+    fprintf(stderr, "trace: usage: trace [on [RECORDS] | off | clear | dump FILE]\n");
+    return 1;
+}
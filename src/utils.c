@@ -0,0 +1,205 @@
+#include "../include/shell.h"
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Initialize an empty growable buffer
+void buf_init(struct Buffer *b) {
+    b->data = NULL;
+    b->len = 0;
+    b->cap = 0;
+}
+
+// Make room for at least `extra` more bytes plus a NUL terminator
+// Capacity doubles so appending N bytes costs O(N) overall
+// Returns 0 on success, -1 on allocation failure
+int buf_reserve(struct Buffer *b, size_t extra) {
+    size_t needed = b->len + extra + 1;
+    if (needed <= b->cap) return 0;
+
+    size_t new_cap = b->cap ? b->cap : 256;
+    while (new_cap < needed) new_cap *= 2;
+
+    char *new_data = realloc(b->data, new_cap);
+    if (new_data == NULL) {
+        perror("realloc failed for buffer");
+        return -1;
+    }
+    STAT_ADD(STAT_BYTES_ALLOCATED, new_cap - b->cap);
+    b->data = new_data;
+    b->cap = new_cap;
+    return 0;
+}
+
+int buf_append(struct Buffer *b, const char *s, size_t n) {
+    if (buf_reserve(b, n) < 0) return -1;
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+    return 0;
+}
+
+int buf_putc(struct Buffer *b, char c) {
+    return buf_append(b, &c, 1);
+}
+
+// Hand ownership of the NUL-terminated contents to the caller and reset the buffer
+char *buf_detach(struct Buffer *b) {
+    if (buf_reserve(b, 0) < 0) return NULL;
+    b->data[b->len] = '\0';
+    char *data = b->data;
+    buf_init(b);
+    return data;
+}
+
+void buf_free(struct Buffer *b) {
+    free(b->data);
+    buf_init(b);
+}
+
+// Close every descriptor except those in keep[]; used by helpers that never exec
+void close_other_fds(const int *keep, int keep_count) {
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir == NULL) return;
+    int dir_fd = dirfd(dir);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        int fd = atoi(entry->d_name);
+        int kept = (fd <= STDERR_FILENO || fd == dir_fd);
+        for (int k = 0; k < keep_count && !kept; k++) kept = (fd == keep[k]);
+        if (!kept) close(fd);
+    }
+    closedir(dir);
+}
+
+// Parse a duration such as "1.5", "30s", "2m", "1h" or "1d" into seconds
+// Returns 0 on success, -1 if the text is not a valid non-negative duration
+int parse_duration(const char *s, double *seconds) {
+    char *end;
+    double value = strtod(s, &end);
+    if (end == s || !(value >= 0) || value == HUGE_VAL) return -1;  // Also rejects nan and inf
+
+    switch (*end) {
+        case '\0': case 's': break;
+        case 'm': value *= 60; break;
+        case 'h': value *= 3600; break;
+        case 'd': value *= 86400; break;
+        default: return -1;
+    }
+    if (*end != '\0' && end[1] != '\0') return -1;
+    *seconds = value;
+    return 0;
+}
+
+// Parse a byte count such as "65536", "256K", "1M" or "1G"
+// Returns 0 on success, -1 if the text is not a valid positive size
+int parse_size(const char *s, long *bytes) {
+    char *end;
+    long value = strtol(s, &end, 10);
+    if (end == s || value <= 0) return -1;
+
+    switch (*end) {
+        case '\0': break;
+        case 'k': case 'K': value <<= 10; end++; break;
+        case 'm': case 'M': value <<= 20; end++; break;
+        case 'g': case 'G': value <<= 30; end++; break;
+        default: return -1;
+    }
+    if (*end == 'B' || *end == 'b') end++;
+    if (*end != '\0') return -1;
+    *bytes = value;
+    return 0;
+}
+
+// Format a byte count as 123B, 4.5K, 6.7M or 8.9G
+void format_bytes(char *buf, size_t size, unsigned long long bytes) {
+    const char *units = "BKMGT";
+    double value = (double)bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+    if (unit == 0) snprintf(buf, size, "%lluB", bytes);
+    else snprintf(buf, size, "%.1f%c", value, units[unit]);
+}
+
+// Nanoseconds on CLOCK_MONOTONIC; the one clock behind traces, job timing and pipe stats
+// clock_gettime() is async-signal-safe, so handlers may call this too
+unsigned long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Arena allocator: every allocation made while running one command line
+// is released in a single arena_free() once the line has finished
+#define ARENA_BLOCK_SIZE 4096
+
+void *arena_alloc(struct Arena *a, size_t size) {
+    size = (size + 15) & ~(size_t)15;  // Keep allocations 16-byte aligned
+
+    if (a->blocks == NULL || a->blocks->used + size > a->blocks->size) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        struct ArenaBlock *block = malloc(sizeof(struct ArenaBlock) + block_size);
+        if (block == NULL) {
+            perror("malloc failed for arena block");
+            return NULL;
+        }
+        block->used = 0;
+        block->size = block_size;
+        block->next = a->blocks;
+        a->blocks = block;
+    }
+
+    void *ptr = a->blocks->data + a->blocks->used;
+    a->blocks->used += size;
+    STAT_ADD(STAT_BYTES_ALLOCATED, size);
+    return ptr;
+}
+
+char *arena_strndup(struct Arena *a, const char *s, size_t n) {
+    char *copy = arena_alloc(a, n + 1);
+    if (copy == NULL) return NULL;
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+char *arena_strdup(struct Arena *a, const char *s) {
+    return arena_strndup(a, s, strlen(s));
+}
+
+// Take ownership of a malloc'd pointer so it is freed with the arena.
+// Lets large buffers (e.g. captured command output) join the arena without a copy.
+void *arena_adopt(struct Arena *a, void *ptr) {
+    if (ptr == NULL) return NULL;
+    struct ArenaOwned *owned = arena_alloc(a, sizeof(struct ArenaOwned));
+    if (owned == NULL) {
+        free(ptr);
+        return NULL;
+    }
+    owned->ptr = ptr;
+    owned->next = a->owned;
+    a->owned = owned;
+    return ptr;
+}
+
+void arena_free(struct Arena *a) {
+    // Owned pointers live inside the blocks, so release them first
+    for (struct ArenaOwned *o = a->owned; o != NULL; o = o->next) free(o->ptr);
+    a->owned = NULL;
+
+    struct ArenaBlock *block = a->blocks;
+    while (block != NULL) {
+        struct ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    a->blocks = NULL;
+}
@@ -126,6 +126,7 @@ int set_variable(struct VariableStore *vs, const char *name, const char *value,
 // Get a variable's value by name
 // Returns pointer to value or NULL if not found
 char *get_variable(const struct VariableStore *vs, const char *name) {
+    STAT_INC(STAT_VAR_LOOKUPS);
     int index = find_variable(vs, name);
     if (index >= 0) {
         return vs->vars[index].value;
@@ -168,6 +169,8 @@ int unset_variable(struct VariableStore *vs, const char *name) {
 // Returns a NULL-terminated array of "name=value" strings
 // Caller is responsible for freeing the returned array (but not the strings inside)
 char **build_environ_array(const struct VariableStore *vs) {
+    unsigned long long start = TRACE_START();
+    STAT_INC(STAT_ENV_REBUILDS);
     // Count exported variables
     int exported_count = 0;
     for (int i = 0; i < vs->count; i++) {
@@ -205,6 +208,7 @@ char **build_environ_array(const struct VariableStore *vs) {
     }
     
     env_array[exported_count] = NULL; // NULL terminate
+    TRACE_END(TRACE_ENVIRON, start, NULL);
     return env_array;
 }
 
@@ -239,11 +243,12 @@ void free_variable_store(struct VariableStore *vs) {
     vs->capacity = 0;
 }
 
-char *find_executable_in_path(char* command, struct VariableStore *vs){
+static char *search_path(char* command, struct VariableStore *vs){
     // If command contains '/', it's already a path - just check if it exists
     const char *path = vs->PATH_PTR;
 
     if (strchr(command, '/') != NULL) {
+        STAT_INC(STAT_PATH_PROBES);
         if (access(command, X_OK) == 0) {
             return strdup(command);
         }
@@ -264,6 +269,7 @@ char *find_executable_in_path(char* command, struct VariableStore *vs){
         snprintf(full_path, full_path_len, "%s/%s", dir, command);
         
         // Check if executable exists
+        STAT_INC(STAT_PATH_PROBES);
         if (access(full_path, X_OK) == 0) {
             free(path_copy);
             return full_path;  
@@ -276,3 +282,10 @@ char *find_executable_in_path(char* command, struct VariableStore *vs){
     free(path_copy);
     return NULL;  // Not found
 }
+
+char *find_executable_in_path(char* command, struct VariableStore *vs){
+    unsigned long long start = TRACE_START();
+    char *full_path = search_path(command, vs);
+    TRACE_END(TRACE_PATH_LOOKUP, start, command);
+    return full_path;
+}
@@ -0,0 +1,334 @@
+#!/bin/bash
+
+# Shell Benchmark Suite
+# Times shell features against large inputs and repeated invocations
+# Run from the repository root after building: make benchmarks
+
+SHELL_EXEC="./mysh"
+BENCH_FILTER="$1"   # Optional: only run benchmarks whose name contains this
+
+# Colors for output
+YELLOW='\033[1;33m'
+BLUE='\033[0;34m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+if [ ! -x "$SHELL_EXEC" ]; then
+    echo -e "${RED}Error: $SHELL_EXEC not found${NC}"
+    exit 1
+fi
+
+cleanup_benchmarks() {
+    rm -f bench_*.tmp
+}
+trap cleanup_benchmarks EXIT
+
+# Current time in nanoseconds
+now_ns() {
+    date +%s%N
+}
+
+# Run a mysh script from a file and print elapsed milliseconds
+time_script_ms() {
+    local script="$1"
+    local start end
+    start=$(now_ns)
+    $SHELL_EXEC < "$script" > /dev/null 2>&1
+    end=$(now_ns)
+    echo $(( (end - start) / 1000000 ))
+}
+
+# Write "line" to the script file N times, followed by exit
+repeat_line() {
+    local file="$1" count="$2" line="$3"
+    : > "$file"
+    for ((i = 0; i < count; i++)); do
+        echo "$line" >> "$file"
+    done
+    echo "exit" >> "$file"
+}
+
+run_benchmark() {
+    local name="$1"
+    local function="$2"
+    if [ -n "$BENCH_FILTER" ] && [[ "$name" != *"$BENCH_FILTER"* ]]; then
+        return
+    fi
+    echo -e "${BLUE}Benchmark: ${name}${NC}"
+    $function
+    echo
+}
+
+# Benchmark 1: Command substitution throughput
+# Captures 100MB through a pipe into the expansion buffer
+bench_cmdsubst_throughput() {
+    local mb=100
+    cat > bench_cmdsubst.tmp << EOF
+set BIG \$(head -c $((mb * 1024 * 1024)) /dev/zero | tr '\\0' x)
+exit
+EOF
+    local ms
+    ms=$(time_script_ms bench_cmdsubst.tmp)
+    [ "$ms" -eq 0 ] && ms=1
+    echo "  captured ${mb}MB in ${ms}ms ($(( mb * 1000 / ms )) MB/s)"
+}
+
+# Benchmark 2: Command substitution latency
+# $(pwd) runs in-process; $(/bin/pwd) forks a subshell
+bench_cmdsubst_latency() {
+    local n=1000
+    repeat_line bench_empty.tmp "$n" 'set X done'
+    repeat_line bench_builtin.tmp "$n" 'set X $(pwd)'
+    repeat_line bench_external.tmp "$n" 'set X $(/bin/pwd)'
+
+    local base builtin external
+    base=$(time_script_ms bench_empty.tmp)
+    builtin=$(time_script_ms bench_builtin.tmp)
+    external=$(time_script_ms bench_external.tmp)
+
+    echo "  \$(pwd) built-in:    $(( (builtin - base) * 1000 / n ))us per substitution"
+    echo "  \$(/bin/pwd) forked: $(( (external - base) * 1000 / n ))us per substitution"
+}
+
+# Count processes used by "mysh -c TEMPLATE", where %s is replaced by a command
+# that prints its parent's pid. If that parent is mysh, mysh forked it (2 processes).
+wrapper_processes() {
+    local leaf='cut -d" " -f4 /proc/self/stat'
+    local out
+    out=$(bash -c 'echo $$; exec "$0" -c "$1"' "$SHELL_EXEC" "$(printf "$1" "$leaf")")
+    local shell_pid leaf_ppid
+    shell_pid=$(echo "$out" | sed -n 1p)
+    leaf_ppid=$(echo "$out" | sed -n 2p)
+    [ "$shell_pid" = "$leaf_ppid" ] && echo 2 || echo 1
+}
+
+# Benchmark 3: Tail exec in -c wrappers
+# "mysh -c cmd" execs cmd in place; "mysh -c (cmd)" forces the old fork-and-wait
+bench_tail_exec() {
+    local n=500 start end i
+    local tail_ms fork_ms
+
+    start=$(now_ns)
+    for ((i = 0; i < n; i++)); do $SHELL_EXEC -c '/bin/true'; done
+    end=$(now_ns)
+    tail_ms=$(( (end - start) / 1000000 ))
+
+    start=$(now_ns)
+    for ((i = 0; i < n; i++)); do $SHELL_EXEC -c '(/bin/true)'; done
+    end=$(now_ns)
+    fork_ms=$(( (end - start) / 1000000 ))
+
+    echo "  tail exec: $(( tail_ms * 1000 / n ))us per wrapper, $(wrapper_processes '%s') process(es)"
+    echo "  forked:    $(( fork_ms * 1000 / n ))us per wrapper, $(wrapper_processes '(%s)') process(es)"
+}
+
+# Set LAST_PID to the most recently allocated pid (no fork, so it doesn't disturb the count)
+read_last_pid() {
+    read -r _ _ _ _ LAST_PID < /proc/loadavg
+}
+
+# Run a mysh script and print "<processes created> <elapsed ms>".
+# Counts pids allocated system-wide, so run it on an otherwise quiet machine.
+count_script_processes() {
+    local script="$1" before start end
+    read_last_pid; before=$LAST_PID
+    start=$(now_ns)
+    $SHELL_EXEC < "$script" > /dev/null 2>&1
+    end=$(now_ns)
+    read_last_pid
+    # The two dates in $(now_ns) and mysh itself are not the script's processes
+    echo "$(( LAST_PID - before - 3 )) $(( (end - start) / 1000000 ))"
+}
+
+# Benchmark 4: Fork count of a typical script
+# The same script with utilities as built-ins, then forced to /bin and /usr/bin
+bench_builtin_forks() {
+    local n=200 prefix out
+    for variant in builtin external; do
+        if [ "$variant" = builtin ]; then prefix=""; else prefix="/usr/bin/"; fi
+        : > bench_forks_$variant.tmp
+        for ((i = 0; i < n; i++)); do
+            {
+                echo "${prefix}[ -d /tmp ] && ${prefix}echo step $i > bench_forks_out.tmp"
+                echo "${prefix}printf '%s %d\\n' item $i >> bench_forks_out.tmp"
+                echo "${prefix}test -s bench_forks_out.tmp || ${prefix}false"
+                echo "${prefix}true"
+            } >> bench_forks_$variant.tmp
+        done
+        echo "exit" >> bench_forks_$variant.tmp
+    done
+
+    out=$(count_script_processes bench_forks_builtin.tmp)
+    echo "  built-ins: ${out% *} processes, ${out#* }ms for $((n * 5)) commands"
+    out=$(count_script_processes bench_forks_external.tmp)
+    echo "  external:  ${out% *} processes, ${out#* }ms for $((n * 5)) commands"
+}
+
+# Benchmark 5: Output fan-out
+# "cmd > a > b | wc" through the tee(2)/splice(2) helper vs piping through tee(1)
+bench_multios() {
+    local mb=512
+    head -c $((mb * 1024 * 1024)) /dev/zero > bench_multios_src.tmp
+    echo "cat bench_multios_src.tmp > bench_multios_a.tmp > bench_multios_b.tmp | wc -c" > bench_multios.tmp
+    echo "exit" >> bench_multios.tmp
+    echo "cat bench_multios_src.tmp | tee bench_multios_a.tmp bench_multios_b.tmp | wc -c" > bench_tee.tmp
+    echo "exit" >> bench_tee.tmp
+
+    local fanout tee1
+    fanout=$(time_script_ms bench_multios.tmp)
+    tee1=$(time_script_ms bench_tee.tmp)
+    [ "$fanout" -eq 0 ] && fanout=1
+    [ "$tee1" -eq 0 ] && tee1=1
+    echo "  multios fan-out: ${mb}MB to 3 sinks in ${fanout}ms ($(( mb * 1000 / fanout )) MB/s)"
+    echo "  | tee a b:       ${mb}MB to 3 sinks in ${tee1}ms ($(( mb * 1000 / tee1 )) MB/s)"
+}
+
+# Benchmark 6: Pipe capacity
+# 3-stage pipeline moving 4GB with each pipesize setting
+bench_pipe_size() {
+    local gb=4 ms
+    for size in 64K 256K 1M auto; do
+        echo "pipesize $size head -c $((gb * 1024 * 1024 * 1024)) /dev/zero | cat | wc -c" > bench_pipesize.tmp
+        echo "exit" >> bench_pipesize.tmp
+        ms=$(time_script_ms bench_pipesize.tmp)
+        [ "$ms" -eq 0 ] && ms=1
+        printf "  %-5s %6dms (%d MB/s)\n" "$size" "$ms" $(( gb * 1024 * 1000 / ms ))
+    done
+}
+
+# Benchmark 7: pipestat overhead
+# The same 3-stage pipeline without pipestat, with the sampler, and with relays (-d)
+bench_pipestat() {
+    local gb=2 ms
+    for mode in off sampled detailed; do
+        local prefix=""
+        [ "$mode" = sampled ] && prefix="pipestat "
+        [ "$mode" = detailed ] && prefix="pipestat -d "
+        echo "${prefix}head -c $((gb * 1024 * 1024 * 1024)) /dev/zero | cat | wc -c" > bench_pipestat.tmp
+        echo "exit" >> bench_pipestat.tmp
+        ms=$(time_script_ms bench_pipestat.tmp)
+        [ "$ms" -eq 0 ] && ms=1
+        printf "  pipestat %-8s %6dms (%d MB/s)\n" "$mode" "$ms" $(( gb * 1024 * 1000 / ms ))
+    done
+}
+
+# Benchmark 8: Parallel stage
+# A CPU-bound awk filter as one stage, as |[N] copies, and as ordered |[N:ordered] copies
+bench_parallel_stage() {
+    local lines=1000000 n ms
+    n=$(nproc)
+    [ "$n" -lt 2 ] && n=2
+    for op in "|" "|[$n]" "|[$n:ordered]"; do
+        echo "seq 1 $lines $op awk '{ s = 0; for (i = 0; i < 20; i++) s += \$1 * i; print s }' | wc -l" > bench_parallel.tmp
+        echo "exit" >> bench_parallel.tmp
+        ms=$(time_script_ms bench_parallel.tmp)
+        printf "  %-12s %6dms for %d lines\n" "$op" "$ms" "$lines"
+    done
+}
+
+# Benchmark 9: Fan-in
+# Four producers merged line by line into one reader
+bench_merge() {
+    local lines=1000000 ms
+    local producer="seq 1 $lines | sed s/^/shard_/"
+    echo "merge '$producer' '$producer' '$producer' '$producer' | wc -l" > bench_merge.tmp
+    echo "exit" >> bench_merge.tmp
+    ms=$(time_script_ms bench_merge.tmp)
+    [ "$ms" -eq 0 ] && ms=1
+    echo "  merge: $((lines * 4)) lines from 4 producers in ${ms}ms ($(( lines * 4 / ms ))K lines/s)"
+}
+
+# Benchmark 10: parallel vs xargs -P
+# 2000 short tasks, N at a time, each printing a line
+bench_parallel_builtin() {
+    local tasks=2000 n start end ms_parallel ms_xargs
+    n=$(nproc)
+    echo "seq 1 $tasks | parallel -j $n /bin/echo task | wc -l" > bench_parallel_builtin.tmp
+    echo "exit" >> bench_parallel_builtin.tmp
+    ms_parallel=$(time_script_ms bench_parallel_builtin.tmp)
+
+    start=$(now_ns)
+    seq 1 $tasks | xargs -P "$n" -n 1 /bin/echo task > /dev/null
+    end=$(now_ns)
+    ms_xargs=$(( (end - start) / 1000000 ))
+
+    echo "  parallel -j $n: ${ms_parallel}ms for $tasks tasks ($(( ms_parallel * 1000 / tasks ))us each, grouped output)"
+    echo "  xargs -P $n:    ${ms_xargs}ms for $tasks tasks ($(( ms_xargs * 1000 / tasks ))us each, unordered output)"
+}
+
+# Benchmark 11: coproc vs a process per item
+# 500 requests to a doubling filter: one sh per request, or one sh coproc answering all of them
+bench_coproc() {
+    local items=500 ms_spawn ms_coproc
+    repeat_line bench_coproc_spawn.tmp $items "echo 21 | sh -c 'read l; echo \$((l * 2))' > /dev/null"
+    ms_spawn=$(time_script_ms bench_coproc_spawn.tmp)
+
+    echo "coproc W sh -c 'while read l; do echo \$((l * 2)); done'" > bench_coproc.tmp
+    for ((i = 0; i < items; i++)); do
+        echo 'echo 21 > /dev/fd/$W_WRITE' >> bench_coproc.tmp
+        echo 'read -u $W_READ reply' >> bench_coproc.tmp
+    done
+    echo "exit" >> bench_coproc.tmp
+    ms_coproc=$(time_script_ms bench_coproc.tmp)
+
+    echo "  process per item: ${ms_spawn}ms for $items items ($(( ms_spawn * 1000 / items ))us each)"
+    echo "  coproc:           ${ms_coproc}ms for $items items ($(( ms_coproc * 1000 / items ))us each)"
+}
+
+# Benchmark 12: CPU placement
+# A 3-stage pipeline left to the scheduler, placed with "affinity auto", and squeezed onto CPU 0
+bench_affinity() {
+    local gb=1 ms
+    for mode in off auto 0; do
+        echo "affinity $mode head -c $((gb * 1024 * 1024 * 1024)) /dev/zero | tr '\\0' a | wc -c" > bench_affinity.tmp
+        echo "exit" >> bench_affinity.tmp
+        ms=$(time_script_ms bench_affinity.tmp)
+        [ "$ms" -eq 0 ] && ms=1
+        printf "  affinity %-4s %6dms (%d MB/s)\n" "$mode" "$ms" $(( gb * 1024 * 1000 / ms ))
+    done
+}
+
+# Benchmark 13: Trace overhead
+# 20000 built-in command lines with tracing never enabled, switched off, and recording
+bench_trace() {
+    local ms
+    for mode in never off on; do
+        : > bench_trace.tmp
+        [ "$mode" = off ] && echo "trace off" >> bench_trace.tmp
+        [ "$mode" = on ] && echo "trace on" >> bench_trace.tmp
+        for ((i = 0; i < 20000; i++)); do
+            echo 'true $HOME x y' >> bench_trace.tmp
+        done
+        echo "exit" >> bench_trace.tmp
+        ms=$(time_script_ms bench_trace.tmp)
+        printf "  trace %-5s %6dms\n" "$mode" "$ms"
+    done
+}
+
+echo "=== Shell Benchmark Suite ==="
+echo
+
+echo -e "${YELLOW}=== Command Substitution ===${NC}"
+run_benchmark "cmdsubst throughput" bench_cmdsubst_throughput
+run_benchmark "cmdsubst latency" bench_cmdsubst_latency
+
+echo -e "${YELLOW}=== Process Creation ===${NC}"
+run_benchmark "tail exec" bench_tail_exec
+run_benchmark "builtin forks" bench_builtin_forks
+
+echo -e "${YELLOW}=== Redirection ===${NC}"
+run_benchmark "multios" bench_multios
+
+echo -e "${YELLOW}=== Pipelines ===${NC}"
+run_benchmark "pipe size" bench_pipe_size
+run_benchmark "pipestat" bench_pipestat
+run_benchmark "parallel stage" bench_parallel_stage
+run_benchmark "merge" bench_merge
+run_benchmark "affinity" bench_affinity
+
+echo -e "${YELLOW}=== Job Control ===${NC}"
+run_benchmark "parallel builtin" bench_parallel_builtin
+run_benchmark "coproc" bench_coproc
+
+echo -e "${YELLOW}=== Instrumentation ===${NC}"
+run_benchmark "trace" bench_trace
@@ -60,8 +60,8 @@ export VAR1=hello
 export VAR2=world
 set LOCAL1=test
 echo $VAR1_$VAR2
-echo $(VAR1)_$(VAR2)
-echo prefix_$(LOCAL1)_suffix
+echo ${VAR1}_${VAR2}
+echo prefix_${LOCAL1}_suffix
 echo \$VAR1 should not expand
 echo $UNDEFINED should be empty: end
 exit
@@ -89,10 +89,10 @@ test_complex_redirection() {
     timeout 10 $SHELL_EXEC << 'EOF' > comprehensive_redir.txt 2>&1
 export OUTFILE=test_complex.out
 export APPENDFILE=test_complex.app
-echo "first line" > $(OUTFILE)
-echo "append line" >> $(APPENDFILE)
-cat $(OUTFILE) $(APPENDFILE)
-rm -f $(OUTFILE) $(APPENDFILE)
+echo "first line" > ${OUTFILE}
+echo "append line" >> ${APPENDFILE}
+cat ${OUTFILE} ${APPENDFILE}
+rm -f ${OUTFILE} ${APPENDFILE}
 exit
 EOF
     
@@ -122,9 +122,9 @@ export VAR3=test3
 set LOCAL1=local1
 set LOCAL2=local2
 for i in 1 2 3 4 5; do
-    echo "Iteration $i: $(VAR1) $(VAR2) $(LOCAL1)"
+    echo "Iteration $i: ${VAR1} ${VAR2} ${LOCAL1}"
 done 2>/dev/null || echo "For loop not supported, testing basic expansion"
-echo $(VAR1)$(VAR2)$(VAR3)$(LOCAL1)$(LOCAL2)
+echo ${VAR1}${VAR2}${VAR3}${LOCAL1}${LOCAL2}
 exit
 EOF
     
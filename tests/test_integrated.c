@@ -389,7 +389,7 @@ void test_env_variable_expansion(void) {
     fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
     fprintf(script, "export TESTVAR=hello_world\n");
     fprintf(script, "echo $TESTVAR\n");
-    fprintf(script, "echo prefix_$(TESTVAR)_suffix\n");
+    fprintf(script, "echo prefix_${TESTVAR}_suffix\n");
     fprintf(script, "exit\n");
     fprintf(script, "EOF\n");
     fclose(script);
@@ -402,7 +402,7 @@ void test_env_variable_expansion(void) {
     char *output = read_file_content("env_var_output.txt");
     ASSERT_TRUE(output != NULL, "Could not read env variable test output");
     ASSERT_TRUE(strstr(output, "hello_world") != NULL, "Variable expansion failed");
-    ASSERT_TRUE(strstr(output, "prefix_hello_world_suffix") != NULL, "Parentheses variable expansion failed");
+    ASSERT_TRUE(strstr(output, "prefix_hello_world_suffix") != NULL, "Braced variable expansion failed");
     
     free(output);
     unlink("env_var_test.sh");
@@ -418,7 +418,7 @@ void test_local_variable_expansion(void) {
     fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
     fprintf(script, "set LOCALVAR local_value\n");
     fprintf(script, "echo $LOCALVAR\n");
-    fprintf(script, "echo test_$(LOCALVAR)_end\n");
+    fprintf(script, "echo test_${LOCALVAR}_end\n");
     fprintf(script, "exit\n");
     fprintf(script, "EOF\n");
     fclose(script);
@@ -431,7 +431,7 @@ void test_local_variable_expansion(void) {
     char *output = read_file_content("local_var_output.txt");
     ASSERT_TRUE(output != NULL, "Could not read local variable test output");
     ASSERT_TRUE(strstr(output, "local_value") != NULL, "Local variable expansion failed");
-    ASSERT_TRUE(strstr(output, "test_local_value_end") != NULL, "Local variable parentheses expansion failed");
+    ASSERT_TRUE(strstr(output, "test_local_value_end") != NULL, "Local variable braced expansion failed");
     
     free(output);
     unlink("local_var_test.sh");
@@ -474,8 +474,8 @@ void test_variable_in_redirection(void) {
     fprintf(script, "#!/bin/bash\n");
     fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
     fprintf(script, "export OUTFILE=var_test_output.txt\n");
-    fprintf(script, "echo 'variable redirection test' > $(OUTFILE)\n");
-    fprintf(script, "cat $(OUTFILE)\n");
+    fprintf(script, "echo 'variable redirection test' > ${OUTFILE}\n");
+    fprintf(script, "cat ${OUTFILE}\n");
     fprintf(script, "exit\n");
     fprintf(script, "EOF\n");
     fclose(script);
@@ -537,7 +537,7 @@ void test_undefined_variable(void) {
     fprintf(script, "#!/bin/bash\n");
     fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
     fprintf(script, "echo before_$UNDEFINED_VAR after\n");
-    fprintf(script, "echo test_$(UNDEFINED_VAR) end\n");
+    fprintf(script, "echo test_${UNDEFINED_VAR} end\n");
     fprintf(script, "exit\n");
     fprintf(script, "EOF\n");
     fclose(script);
@@ -559,6 +559,1123 @@ void test_undefined_variable(void) {
     TEST_PASS();
 }
 
+void test_command_substitution(void) {
+    TEST_START("Command substitution");
+    
+    FILE *script = fopen("cmdsubst_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "echo dir=$(pwd)\n");
+    fprintf(script, "echo count=$(echo a b c | wc -w)\n");
+    fprintf(script, "echo tick=`echo backtick`\n");
+    fprintf(script, "echo \"[$(printf 'x\\n\\n')]\"\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("cmdsubst_test.sh", 0755);
+    int result = system("./cmdsubst_test.sh > cmdsubst_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Command substitution test failed");
+    
+    char cwd[1024];
+    char expected[1100];
+    ASSERT_TRUE(getcwd(cwd, sizeof(cwd)) != NULL, "getcwd failed");
+    snprintf(expected, sizeof(expected), "dir=%s\n", cwd);
+    
+    char *output = read_file_content("cmdsubst_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read command substitution output");
+    ASSERT_TRUE(strstr(output, expected) != NULL, "Built-in substitution failed");
+    ASSERT_TRUE(strstr(output, "count=3") != NULL, "Pipeline substitution failed");
+    ASSERT_TRUE(strstr(output, "tick=backtick") != NULL, "Backtick substitution failed");
+    ASSERT_TRUE(strstr(output, "[x]") != NULL, "Trailing newlines were not trimmed");
+    
+    free(output);
+    unlink("cmdsubst_test.sh");
+    unlink("cmdsubst_output.txt");
+    TEST_PASS();
+}
+
+void test_process_substitution(void) {
+    TEST_START("Process substitution");
+    
+    FILE *script = fopen("procsubst_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "paste <(echo left) <(echo right)\n");
+    fprintf(script, "echo shout > >(tr a-z A-Z)\n");
+    fprintf(script, "wc -l < <(seq 7)\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("procsubst_test.sh", 0755);
+    int result = system("./procsubst_test.sh > procsubst_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Process substitution test failed");
+    
+    char *output = read_file_content("procsubst_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read process substitution output");
+    ASSERT_TRUE(strstr(output, "left\tright") != NULL, "Input process substitution failed");
+    ASSERT_TRUE(strstr(output, "SHOUT") != NULL, "Output process substitution failed");
+    ASSERT_TRUE(strstr(output, "7") != NULL, "Redirection from process substitution failed");
+    
+    free(output);
+    unlink("procsubst_test.sh");
+    unlink("procsubst_output.txt");
+    TEST_PASS();
+}
+
+void test_here_documents(void) {
+    TEST_START("Here-documents and here-strings");
+    
+    FILE *script = fopen("heredoc_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "export WHO=world\n");
+    fprintf(script, "cat <<END\n");
+    fprintf(script, "hello $WHO\n");
+    fprintf(script, "END\n");
+    fprintf(script, "cat <<'END'\n");
+    fprintf(script, "literal $WHO\n");
+    fprintf(script, "END\n");
+    fprintf(script, "tr a-z A-Z <<< \"here $WHO\"\n");
+    fprintf(script, "seq 20000 > heredoc_big.txt\n");
+    fprintf(script, "cat <<END | wc -c\n");
+    fprintf(script, "$(cat heredoc_big.txt)\n");
+    fprintf(script, "END\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("heredoc_test.sh", 0755);
+    int result = system("./heredoc_test.sh > heredoc_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Here-document test failed");
+    
+    char *output = read_file_content("heredoc_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read here-document output");
+    ASSERT_TRUE(strstr(output, "hello world") != NULL, "Here-document expansion failed");
+    ASSERT_TRUE(strstr(output, "literal $WHO") != NULL, "Quoted delimiter should disable expansion");
+    ASSERT_TRUE(strstr(output, "HERE WORLD") != NULL, "Here-string failed");
+    ASSERT_TRUE(strstr(output, "108894") != NULL, "Large here-document (memfd) was truncated");
+    
+    free(output);
+    unlink("heredoc_test.sh");
+    unlink("heredoc_output.txt");
+    unlink("heredoc_big.txt");
+    TEST_PASS();
+}
+
+void test_command_lists(void) {
+    TEST_START("Command lists (; && ||) and $?");
+    
+    FILE *script = fopen("list_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "false && echo skipped_and; echo ran_after_semicolon\n");
+    fprintf(script, "false || echo ran_or\n");
+    fprintf(script, "true || echo skipped_or && echo ran_chain\n");
+    fprintf(script, "ls /nonexistent_dir_for_test; echo status=$?\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("list_test.sh", 0755);
+    int result = system("./list_test.sh > list_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Command list test failed");
+    
+    char *output = read_file_content("list_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read command list output");
+    ASSERT_TRUE(strstr(output, "ran_after_semicolon") != NULL, "';' did not run the next pipeline");
+    ASSERT_TRUE(strstr(output, "skipped_and") == NULL, "'&&' ran after failure");
+    ASSERT_TRUE(strstr(output, "ran_or") != NULL, "'||' did not run after failure");
+    ASSERT_TRUE(strstr(output, "skipped_or") == NULL, "'||' ran after success");
+    ASSERT_TRUE(strstr(output, "ran_chain") != NULL, "'&&' after skipped '||' did not run");
+    ASSERT_TRUE(strstr(output, "status=2") != NULL, "$? not maintained");
+    
+    free(output);
+    unlink("list_test.sh");
+    unlink("list_output.txt");
+    TEST_PASS();
+}
+
+void test_grouping(void) {
+    TEST_START("Subshell ( ) and brace { } groups");
+    
+    FILE *script = fopen("group_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "{ echo brace_a; echo brace_b; } > group_brace.txt\n");
+    fprintf(script, "wc -l < group_brace.txt\n");
+    fprintf(script, "(cd /usr)\n");
+    fprintf(script, "/bin/pwd | sed s/^/after_/\n");
+    fprintf(script, "(echo x; echo y; echo z) | wc -l\n");
+    fprintf(script, "(exit 3); echo status=$?\n");
+    fprintf(script, "{ echo piped; } | tr a-z A-Z\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fprintf(script, "rm -f group_brace.txt\n");
+    fclose(script);
+    
+    chmod("group_test.sh", 0755);
+    int result = system("./group_test.sh > group_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Grouping test failed");
+    
+    char *output = read_file_content("group_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read grouping output");
+    ASSERT_TRUE(strstr(output, "2") != NULL, "Brace group redirection did not cover the whole list");
+    ASSERT_TRUE(strstr(output, "after_/") != NULL, "pwd after subshell produced no output");
+    ASSERT_TRUE(strstr(output, "after_/usr") == NULL, "cd inside ( ) leaked into the shell");
+    ASSERT_TRUE(strstr(output, "3") != NULL, "Subshell output not piped as one stream");
+    ASSERT_TRUE(strstr(output, "status=3") != NULL, "Subshell exit status not propagated");
+    ASSERT_TRUE(strstr(output, "PIPED") != NULL, "Brace group in a pipeline failed");
+    
+    free(output);
+    unlink("group_test.sh");
+    unlink("group_output.txt");
+    TEST_PASS();
+}
+
+void test_exec_and_script_modes(void) {
+    TEST_START("exec built-in, -c and script modes");
+    
+    FILE *script = fopen("exec_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "printf '# comment\\necho script_line\\n\\nexec > exec_log.txt\\necho logged_line\\n' > exec_script.mysh\n");
+    fprintf(script, "./mysh exec_script.mysh\n");
+    fprintf(script, "cat exec_log.txt\n");
+    fprintf(script, "./mysh -c 'ls /nonexistent_dir_for_test'; echo c_status=$?\n");
+    // The tail command replaces mysh, so its parent is this script rather than mysh
+    fprintf(script, "./mysh -c 'cut -d\" \" -f4 /proc/self/stat' > exec_ppid.txt\n");
+    fprintf(script, "[ \"$(cat exec_ppid.txt)\" = \"$$\" ] && echo tail_exec_ok\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "exec no_such_program_xyz\n");
+    fprintf(script, "echo still_alive\n");
+    fprintf(script, "exec echo replaced_shell\n");
+    fprintf(script, "echo not_reached\n");
+    fprintf(script, "EOF\n");
+    fprintf(script, "rm -f exec_script.mysh exec_log.txt exec_ppid.txt\n");
+    fclose(script);
+    
+    chmod("exec_test.sh", 0755);
+    int result = system("./exec_test.sh > exec_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "exec test failed");
+    
+    char *output = read_file_content("exec_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read exec output");
+    ASSERT_TRUE(strstr(output, "script_line") != NULL, "Script file was not run");
+    ASSERT_TRUE(strstr(output, "logged_line") != NULL, "exec >file did not redirect the shell");
+    ASSERT_TRUE(strstr(output, "c_status=2") != NULL, "-c did not return the command's status");
+    ASSERT_TRUE(strstr(output, "tail_exec_ok") != NULL, "Last command of -c was forked instead of exec'd");
+    ASSERT_TRUE(strstr(output, "still_alive") != NULL, "Failed exec ended the shell");
+    ASSERT_TRUE(strstr(output, "replaced_shell") != NULL, "exec did not run the command");
+    ASSERT_TRUE(strstr(output, "not_reached") == NULL, "Shell kept running after exec");
+    
+    free(output);
+    unlink("exec_test.sh");
+    unlink("exec_output.txt");
+    TEST_PASS();
+}
+
+void test_script_failing_command(void) {
+    TEST_START("Failing commands in a script don't make it rerun lines");
+    
+    FILE *script = fopen("script_fail_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "printf 'echo one\\nno_such_command_xyz\\necho two\\ncat < /nonexistent_file_xyz\\necho three\\n' > script_fail.mysh\n");
+    fprintf(script, "timeout 10 ./mysh script_fail.mysh\n");
+    fprintf(script, "rm -f script_fail.mysh\n");
+    fclose(script);
+    
+    chmod("script_fail_test.sh", 0755);
+    int result = system("./script_fail_test.sh > script_fail_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Script failure test failed");
+    
+    char *output = read_file_content("script_fail_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read script output");
+    char *two = strstr(output, "two\n");
+    char *three = strstr(output, "three\n");
+    ASSERT_TRUE(strstr(output, "one\n") != NULL && two != NULL && three != NULL, "Script lines missing");
+    ASSERT_TRUE(strstr(two + 1, "two\n") == NULL && strstr(three + 1, "three\n") == NULL,
+                "Script lines after a failing command ran twice");
+    
+    free(output);
+    unlink("script_fail_test.sh");
+    unlink("script_fail_output.txt");
+    TEST_PASS();
+}
+
+void test_multiline_command_string(void) {
+    TEST_START("Newlines separate commands in a -c string");
+    
+    FILE *script = fopen("multiline_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh -c $'echo first\\necho second'\n");
+    fprintf(script, "timeout 10 ./mysh -c $'cat <<END; echo after\\nbody line\\nEND\\necho last'\n");
+    fclose(script);
+    
+    chmod("multiline_test.sh", 0755);
+    int result = system("./multiline_test.sh > multiline_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Multi-line -c test failed");
+    
+    char *output = read_file_content("multiline_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read multi-line output");
+    ASSERT_TRUE(strstr(output, "first\nsecond\n") != NULL, "Newline did not end the first command");
+    ASSERT_TRUE(strstr(output, "body line\nafter\nlast\n") != NULL, "Here-document in -c string not read from its lines");
+    
+    free(output);
+    unlink("multiline_test.sh");
+    unlink("multiline_output.txt");
+    TEST_PASS();
+}
+
+void test_utility_builtins(void) {
+    TEST_START("echo, printf, test, true/false, sleep and kill built-ins");
+    
+    FILE *script = fopen("utility_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "printf '%%s-%%03d\\n' pad 7 > utility_out.txt\n");
+    fprintf(script, "echo -n appended >> utility_out.txt\n");
+    fprintf(script, "cat utility_out.txt; echo\n");
+    fprintf(script, "echo lower | tr a-z A-Z\n");
+    fprintf(script, "[ -f utility_out.txt ] && test 2 -gt 1 && echo test_true\n");
+    fprintf(script, "[ x = y ] || false || echo test_false\n");
+    fprintf(script, "[ 1 -eq one ]; echo test_error=$?\n");
+    fprintf(script, "sleep 0.1; echo slept\n");
+    fprintf(script, "sleep 20 &\n");
+    fprintf(script, "kill %%%%; echo kill_status=$?\n");
+    fprintf(script, "kill %%99; echo missing_job=$?\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("utility_test.sh", 0755);
+    int result = system("./utility_test.sh > utility_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Utility built-in test failed");
+    
+    char *output = read_file_content("utility_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read utility built-in output");
+    ASSERT_TRUE(strstr(output, "pad-007\nappended") != NULL, "printf/echo redirections not honored");
+    ASSERT_TRUE(strstr(output, "LOWER") != NULL, "echo did not write into the pipeline");
+    ASSERT_TRUE(strstr(output, "test_true") != NULL, "test/[ gave a wrong true result");
+    ASSERT_TRUE(strstr(output, "test_false") != NULL, "test/[ or false gave a wrong false result");
+    ASSERT_TRUE(strstr(output, "test_error=2") != NULL, "Malformed test did not return 2");
+    ASSERT_TRUE(strstr(output, "slept") != NULL, "sleep built-in failed");
+    ASSERT_TRUE(strstr(output, "kill_status=0") != NULL, "kill %% did not signal the job");
+    ASSERT_TRUE(strstr(output, "missing_job=1") != NULL, "kill of an unknown job did not fail");
+    
+    free(output);
+    unlink("utility_test.sh");
+    unlink("utility_output.txt");
+    unlink("utility_out.txt");
+    TEST_PASS();
+}
+
+void test_multiple_output_redirections(void) {
+    TEST_START("Multiple output redirections (multios)");
+    
+    FILE *script = fopen("multios_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "seq 1 50000 > multios_a.txt > multios_b.txt | wc -l\n");
+    fprintf(script, "cmp multios_a.txt multios_b.txt && echo same_contents\n");
+    fprintf(script, "echo appended >> multios_a.txt > multios_c.txt\n");
+    fprintf(script, "tail -1 multios_a.txt | sed s/^/a_/\n");
+    fprintf(script, "sed s/^/c_/ multios_c.txt\n");
+    fprintf(script, "{ echo grouped; } > multios_b.txt > multios_c.txt\n");
+    fprintf(script, "cat multios_b.txt multios_c.txt | wc -l\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fprintf(script, "rm -f multios_a.txt multios_b.txt multios_c.txt\n");
+    fclose(script);
+    
+    chmod("multios_test.sh", 0755);
+    int result = system("./multios_test.sh > multios_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Multios test failed");
+    
+    char *output = read_file_content("multios_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read multios output");
+    ASSERT_TRUE(strstr(output, "50000") != NULL, "Pipe did not receive the output alongside the files");
+    ASSERT_TRUE(strstr(output, "same_contents") != NULL, "Output files differ");
+    ASSERT_TRUE(strstr(output, "a_appended") != NULL, ">> target did not receive output");
+    ASSERT_TRUE(strstr(output, "c_appended") != NULL, "> target did not receive output");
+    ASSERT_TRUE(strstr(output, "2") != NULL, "Brace group output not sent to every target");
+    
+    free(output);
+    unlink("multios_test.sh");
+    unlink("multios_output.txt");
+    TEST_PASS();
+}
+
+void test_pipe_size(void) {
+    TEST_START("Pipe capacity (pipesize / PIPE_SIZE)");
+    
+    FILE *script = fopen("pipesize_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 20 ./mysh << 'EOF'\n");
+    fprintf(script, "pipesize 1M seq 1 200000 | cat | wc -l\n");
+    fprintf(script, "set PIPE_SIZE auto\n");
+    fprintf(script, "head -c 50000000 /dev/zero | cat | wc -c\n");
+    fprintf(script, "pipesize max echo max_ok | cat\n");
+    fprintf(script, "pipesize lots echo still_runs | cat\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("pipesize_test.sh", 0755);
+    int result = system("./pipesize_test.sh > pipesize_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Pipe size test failed");
+    
+    char *output = read_file_content("pipesize_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read pipe size output");
+    ASSERT_TRUE(strstr(output, "200000") != NULL, "Pipeline with a fixed pipe size lost data");
+    ASSERT_TRUE(strstr(output, "50000000") != NULL, "Pipeline with adaptive pipe size lost data");
+    ASSERT_TRUE(strstr(output, "max_ok") != NULL, "pipesize max failed");
+    ASSERT_TRUE(strstr(output, "invalid size") != NULL, "Invalid pipe size not reported");
+    ASSERT_TRUE(strstr(output, "still_runs") != NULL, "Invalid pipe size stopped the pipeline");
+    
+    free(output);
+    unlink("pipesize_test.sh");
+    unlink("pipesize_output.txt");
+    TEST_PASS();
+}
+
+void test_pipestat(void) {
+    TEST_START("Per-stage pipeline metrics (pipestat)");
+    
+    FILE *script = fopen("pipestat_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 20 ./mysh << 'EOF'\n");
+    fprintf(script, "pipestat seq 1 100000 | cat | wc -l\n");
+    fprintf(script, "pipestat -d seq 1 100000 | cat | wc -l\n");
+    fprintf(script, "set PIPESTAT 1\n");
+    fprintf(script, "seq 1 50000 | sed s/^/x/ > /dev/null &\n");
+    fprintf(script, "sleep 1\n");
+    fprintf(script, "jobs\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("pipestat_test.sh", 0755);
+    int result = system("./pipestat_test.sh > pipestat_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "pipestat test failed");
+    
+    char *output = read_file_content("pipestat_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read pipestat output");
+    char *sampled = strstr(output, "out-fill");
+    char *count = strstr(output, "100000");
+    ASSERT_TRUE(sampled != NULL, "Sampled pipestat report missing");
+    ASSERT_TRUE(count != NULL && count < sampled, "Pipeline under pipestat lost data");
+    // The sampler reports bytes, throughput and blocked seconds too
+    char *row = strstr(sampled, "\n  1     seq");
+    char name[32], bytes[32], rate[32], read_wait[32], write_wait[32];
+    int stage = 0;
+    ASSERT_TRUE(row != NULL && sscanf(row, " %d %31s %31s %31s %31s %31s", &stage, name, bytes, rate, read_wait,
+                                      write_wait) == 6 && bytes[0] != '-' && write_wait[strlen(write_wait) - 1] == 's',
+                "Sampled pipestat report lacks bytes or blocked time");
+    char *detailed = strstr(sampled, "100000");
+    ASSERT_TRUE(detailed != NULL, "Pipeline under pipestat -d lost data");
+    char *header = strstr(detailed, "write-wait");
+    ASSERT_TRUE(header != NULL && strncmp(header, "write-wait\n", 11) == 0, "pipestat -d report missing");
+    // seq 1 100000 writes 588895 bytes, moved unchanged by cat
+    ASSERT_TRUE(strstr(detailed, "575.1K") != NULL, "pipestat -d byte count wrong");
+    ASSERT_TRUE(strstr(detailed, "out-fill") != NULL, "jobs does not show pipestat for a background job");
+    
+    free(output);
+    unlink("pipestat_test.sh");
+    unlink("pipestat_output.txt");
+    TEST_PASS();
+}
+
+void test_parallel_stage(void) {
+    TEST_START("Parallel pipeline stage (|[N])");
+    
+    FILE *script = fopen("parallel_stage_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 20 ./mysh << 'EOF'\n");
+    fprintf(script, "seq 1 100000 |[4] sed s/^/rr_/ | sort -u | wc -l\n");
+    fprintf(script, "seq 1 100000 |[3:ordered] sed s/^/ord_/ | tail -1\n");
+    fprintf(script, "seq 1 3 |[2:ordered] sed s/^/line_/ | tr '\\n' ' ' | sed s/$/_end/\n");
+    fprintf(script, "echo x |[0] cat\n");
+    fprintf(script, "echo ok | [ -n x ] && echo test_still_works\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("parallel_stage_test.sh", 0755);
+    int result = system("./parallel_stage_test.sh > parallel_stage_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Parallel stage test failed");
+    
+    char *output = read_file_content("parallel_stage_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read parallel stage output");
+    ASSERT_TRUE(strstr(output, "100000") != NULL, "Round-robin stage lost or duplicated lines");
+    ASSERT_TRUE(strstr(output, "ord_100000") != NULL, "Ordered stage did not end with the last line");
+    ASSERT_TRUE(strstr(output, "line_1 line_2 line_3 _end") != NULL, "Ordered stage reordered lines");
+    ASSERT_TRUE(strstr(output, "with N from 1") != NULL, "Invalid copy count not reported");
+    ASSERT_TRUE(strstr(output, "test_still_works") != NULL, "| [ was taken for a parallel stage");
+    
+    free(output);
+    unlink("parallel_stage_test.sh");
+    unlink("parallel_stage_output.txt");
+    TEST_PASS();
+}
+
+void test_merge(void) {
+    TEST_START("Fan-in of concurrent producers (merge)");
+    
+    FILE *script = fopen("merge_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 20 ./mysh << 'EOF'\n");
+    fprintf(script, "merge 'seq 1 50000 | sed s/^/a/' 'seq 1 50000 | sed s/^/b/' | grep -c '^[ab][0-9]*$'\n");
+    fprintf(script, "merge -t 'echo one' 'printf partial' | sort | tr '\\n' ' ' | sed s/$/_end/\n");
+    fprintf(script, "merge 'sleep 0.5; echo slow_done' 'echo fast_done' | tr '\\n' ' ' | sed s/$/_order/\n");
+    fprintf(script, "merge 'exit 3' 'true'\n");
+    fprintf(script, "echo status $?\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("merge_test.sh", 0755);
+    int result = system("./merge_test.sh > merge_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "merge test failed");
+    
+    char *output = read_file_content("merge_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read merge output");
+    ASSERT_TRUE(strstr(output, "100000") != NULL, "merge lost lines or split them");
+    ASSERT_TRUE(strstr(output, "[1] one [2] partial _end") != NULL, "merge -t tags or final line wrong");
+    ASSERT_TRUE(strstr(output, "fast_done slow_done _order") != NULL, "merge did not run producers concurrently");
+    ASSERT_TRUE(strstr(output, "status 3") != NULL, "merge did not report a failing producer");
+    
+    free(output);
+    unlink("merge_test.sh");
+    unlink("merge_output.txt");
+    TEST_PASS();
+}
+
+void test_parallel_builtin(void) {
+    TEST_START("Bounded concurrent execution (parallel)");
+    
+    FILE *script = fopen("parallel_builtin_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 20 ./mysh << 'EOF'\n");
+    fprintf(script, "parallel -j 2 echo item ::: a b c | sort | tr '\\n' ' ' | sed s/$/_end/\n");
+    fprintf(script, "seq 1 4 | parallel -j2 echo n={}_x | sort | tr '\\n' ' ' | sed s/$/_end/\n");
+    fprintf(script, "seq 1 200 | parallel -j 8 sh -c 'echo $1-a; echo $1-b' _ | paste - - | awk '{ split($1, a, \"-\"); split($2, b, \"-\"); if (a[1] != b[1]) bad++ } END { print \"split\", bad + 0, NR }'\n");
+    fprintf(script, "parallel -j 4 /bin/sleep ::: 1 1 1 1 && echo slept_in_parallel\n");
+    fprintf(script, "parallel -j 2 sh -c 'exit $1' _ ::: 0 1 2 0\n");
+    fprintf(script, "echo failed $?\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("parallel_builtin_test.sh", 0755);
+    time_t start = time(NULL);
+    int result = system("./parallel_builtin_test.sh > parallel_builtin_output.txt 2>&1");
+    time_t elapsed = time(NULL) - start;
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "parallel test failed");
+    
+    char *output = read_file_content("parallel_builtin_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read parallel output");
+    ASSERT_TRUE(strstr(output, "item a item b item c _end") != NULL, "parallel ::: arguments wrong");
+    ASSERT_TRUE(strstr(output, "n=1_x n=2_x n=3_x n=4_x _end") != NULL, "parallel stdin arguments or {} wrong");
+    ASSERT_TRUE(strstr(output, "split 0 200") != NULL, "parallel interleaved output of different copies");
+    ASSERT_TRUE(strstr(output, "slept_in_parallel") != NULL, "parallel sleep failed");
+    ASSERT_TRUE(elapsed < 4, "parallel -j 4 did not run copies concurrently");
+    ASSERT_TRUE(strstr(output, "failed 2") != NULL, "parallel exit status is not the failure count");
+    
+    free(output);
+    unlink("parallel_builtin_test.sh");
+    unlink("parallel_builtin_output.txt");
+    TEST_PASS();
+}
+
+void test_job_slots(void) {
+    TEST_START("Background job slots and queue (JOB_SLOTS)");
+    
+    FILE *script = fopen("job_slots_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 20 ./mysh << 'EOF'\n");
+    fprintf(script, "set JOB_SLOTS 1\n");
+    fprintf(script, "sh -c 'sleep 0.5; echo first_done' &\n");
+    fprintf(script, "sh -c 'echo second_ran' &\n");
+    fprintf(script, "jobs\n");
+    fprintf(script, "sh -c 'echo makeflags=$MAKEFLAGS'\n");
+    fprintf(script, "sh -c 'echo removed_$((40 + 2))' &\n");
+    fprintf(script, "kill %%4\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("job_slots_test.sh", 0755);
+    int result = system("./job_slots_test.sh > job_slots_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Job slots test failed");
+    
+    char *output = read_file_content("job_slots_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read job slots output");
+    ASSERT_TRUE(strstr(output, "[2] queued") != NULL, "Job over the limit was not queued");
+    ASSERT_TRUE(strstr(output, "Queued") != NULL, "jobs does not list queued jobs");
+    ASSERT_TRUE(strstr(output, "--jobserver-auth=") != NULL, "MAKEFLAGS jobserver not exported");
+    ASSERT_TRUE(strstr(output, "Removed from queue") != NULL, "kill did not remove a queued job");
+    ASSERT_TRUE(strstr(output, "removed_42") == NULL, "Removed job still ran");
+    // The queued job runs only after the first frees its slot, even though input ended
+    char *first = strstr(output, "first_done");
+    char *second = strstr(output, "second_ran");
+    ASSERT_TRUE(first != NULL && second != NULL && first < second, "Queued job did not wait for a slot");
+    
+    free(output);
+    unlink("job_slots_test.sh");
+    unlink("job_slots_output.txt");
+    TEST_PASS();
+}
+
+void test_wait_builtin(void) {
+    TEST_START("wait, wait %N, wait PID and wait -n");
+    
+    FILE *script = fopen("wait_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "sh -c 'sleep 0.4; exit 3' &\n");
+    fprintf(script, "sh -c 'sleep 0.1; exit 5' &\n");
+    fprintf(script, "wait -n\n");
+    fprintf(script, "echo first=$?\n");
+    fprintf(script, "wait %%1\n");
+    fprintf(script, "echo job=$?\n");
+    fprintf(script, "sh -c 'exit 7' | sh -c 'sleep 0.1; exit 9' &\n");
+    fprintf(script, "wait $!\n");
+    fprintf(script, "echo pid=$?\n");
+    fprintf(script, "wait %%99\n");
+    fprintf(script, "echo missing=$?\n");
+    fprintf(script, "sh -c 'sleep 0.2; echo slow_done' &\n");
+    fprintf(script, "wait\n");
+    fprintf(script, "echo all=$?\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("wait_test.sh", 0755);
+    int result = system("./wait_test.sh > wait_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "wait test failed");
+    
+    char *output = read_file_content("wait_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read wait output");
+    ASSERT_TRUE(strstr(output, "first=5") != NULL, "wait -n did not return the first job's status");
+    ASSERT_TRUE(strstr(output, "job=3") != NULL, "wait %N did not return the job's status");
+    ASSERT_TRUE(strstr(output, "pid=9") != NULL, "wait $! did not return the last command's status");
+    ASSERT_TRUE(strstr(output, "missing=127") != NULL, "wait on an unknown job should return 127");
+    char *done = strstr(output, "slow_done");
+    char *all = strstr(output, "all=0");
+    ASSERT_TRUE(done != NULL && all != NULL && done < all, "wait returned before the jobs finished");
+    
+    free(output);
+    unlink("wait_test.sh");
+    unlink("wait_output.txt");
+    TEST_PASS();
+}
+
+void test_coproc(void) {
+    TEST_START("coproc with read -u and job table tracking");
+    
+    FILE *script = fopen("coproc_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "coproc DBL sh -c 'while read n; do echo $((n * 2)); done'\n");
+    fprintf(script, "echo 21 > /dev/fd/$DBL_WRITE\n");
+    fprintf(script, "read -u $DBL_READ first\n");
+    fprintf(script, "echo 50 > /dev/fd/$DBL_WRITE\n");
+    fprintf(script, "read -u $DBL_READ second\n");
+    fprintf(script, "echo answers=$first,$second\n");
+    fprintf(script, "jobs\n");
+    fprintf(script, "coproc UP { read -r a b; echo \"got:$b:$a\"; }\n");
+    fprintf(script, "echo one two three > /dev/fd/$UP_WRITE\n");
+    fprintf(script, "read -u $UP_READ reply\n");
+    fprintf(script, "echo reply=$reply\n");
+    fprintf(script, "kill %%1\n");
+    fprintf(script, "wait $DBL_PID\n");
+    fprintf(script, "echo coproc_status=$?\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("coproc_test.sh", 0755);
+    int result = system("./coproc_test.sh > coproc_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "coproc test failed");
+    
+    char *output = read_file_content("coproc_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read coproc output");
+    ASSERT_TRUE(strstr(output, "answers=42,100") != NULL, "One coproc did not answer both requests");
+    ASSERT_TRUE(strstr(output, "(bg) coproc DBL") != NULL, "coproc not listed by jobs");
+    ASSERT_TRUE(strstr(output, "reply=got:two three:one") != NULL, "read did not split fields or group coproc failed");
+    ASSERT_TRUE(strstr(output, "coproc_status=143") != NULL, "Killed coproc was not reaped with its status");
+    
+    free(output);
+    unlink("coproc_test.sh");
+    unlink("coproc_output.txt");
+    TEST_PASS();
+}
+
+void test_cpu_affinity(void) {
+    TEST_START("CPU affinity for jobs and pipeline stages");
+    
+    FILE *script = fopen("affinity_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "affinity 0 grep Cpus_allowed_list /proc/self/status\n");
+    fprintf(script, "affinity auto grep -c Cpus_allowed_list /proc/self/status | sed s/^/auto_stages=/\n");
+    fprintf(script, "set CPU_AFFINITY 0:0\n");
+    fprintf(script, "grep Cpus_allowed_list /proc/self/status | sed s/Cpus/staged/\n");
+    fprintf(script, "affinity 1-x /bin/echo still_ran\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("affinity_test.sh", 0755);
+    int result = system("./affinity_test.sh > affinity_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Affinity test failed");
+    
+    char *output = read_file_content("affinity_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read affinity output");
+    ASSERT_TRUE(strstr(output, "Cpus_allowed_list:\t0\n") != NULL, "Job was not pinned to CPU 0");
+    ASSERT_TRUE(strstr(output, "auto_stages=1") != NULL, "auto placement broke the pipeline");
+    ASSERT_TRUE(strstr(output, "staged_allowed_list:\t0\n") != NULL, "CPU_AFFINITY stage lists not applied");
+    ASSERT_TRUE(strstr(output, "expected auto or CPU lists") != NULL, "Invalid CPU list not reported");
+    ASSERT_TRUE(strstr(output, "still_ran") != NULL, "Invalid CPU list should not stop the command");
+    
+    free(output);
+    unlink("affinity_test.sh");
+    unlink("affinity_output.txt");
+    TEST_PASS();
+}
+
+void test_pressure_governor(void) {
+    TEST_START("Pressure governor throttles background jobs");
+    
+    FILE *script = fopen("governor_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "sh -c 'sleep 0.5; echo bg_done' &\n");
+    // Zero thresholds: any reading counts as pressure
+    fprintf(script, "set GOVERNOR cpu=0,memory=0,load=0,interval=0.1\n");
+    fprintf(script, "sleep 0.4\n");
+    fprintf(script, "jobs\n");
+    fprintf(script, "set GOVERNOR off\n");
+    fprintf(script, "wait\n");
+    fprintf(script, "set GOVERNOR cpu=bogus\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("governor_test.sh", 0755);
+    int result = system("./governor_test.sh > governor_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Governor test failed");
+    
+    char *output = read_file_content("governor_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read governor output");
+    ASSERT_TRUE(strstr(output, "Throttled") != NULL, "Background job was not throttled under pressure");
+    ASSERT_TRUE(strstr(output, "bg_done") != NULL, "Throttled job was not resumed");
+    ASSERT_TRUE(strstr(output, "throttled 1 time,") != NULL, "Throttled time was not logged");
+    ASSERT_TRUE(strstr(output, "GOVERNOR: cpu=bogus") != NULL, "Invalid GOVERNOR setting not reported");
+    
+    free(output);
+    unlink("governor_test.sh");
+    unlink("governor_output.txt");
+    TEST_PASS();
+}
+
+void test_background_priority(void) {
+    TEST_START("BG_PRIORITY renices background jobs and fg restores them");
+    
+    FILE *script = fopen("bg_priority_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "sh -c 'sleep 0.8; echo moved_nice=$(nice)' &\n");
+    fprintf(script, "set BG_PRIORITY on\n");
+    fprintf(script, "sh -c 'echo bg_nice=$(nice) bg_io=$(ionice 2>/dev/null || echo idle)' &\n");
+    // Let job 1 get past exec so the stop lands before bg
+    fprintf(script, "sleep 0.3\n");
+    fprintf(script, "kill -STOP %%1\n");
+    fprintf(script, "sleep 0.2\n");
+    fprintf(script, "bg 1\n");
+    fprintf(script, "wait\n");
+    fprintf(script, "sh -c 'sleep 0.3; echo fg_nice=$(nice)' &\n");
+    fprintf(script, "fg 3\n");
+    fprintf(script, "set BG_PRIORITY nice=zero\n");
+    fprintf(script, "exit\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("bg_priority_test.sh", 0755);
+    int result = system("./bg_priority_test.sh > bg_priority_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Background priority test failed");
+    
+    char *output = read_file_content("bg_priority_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read background priority output");
+    ASSERT_TRUE(strstr(output, "bg_nice=10 bg_io=idle") != NULL, "& job was not reniced to idle I/O");
+    ASSERT_TRUE(strstr(output, "moved_nice=10") != NULL, "bg did not renice a stopped job");
+    // Raising the nice value back needs CAP_SYS_NICE; without it fg says so
+    ASSERT_TRUE(strstr(output, "fg_nice=0") != NULL || strstr(output, "without CAP_SYS_NICE") != NULL,
+                "fg did not restore priority");
+    ASSERT_TRUE(strstr(output, "BG_PRIORITY: nice=zero") != NULL, "Invalid BG_PRIORITY not reported");
+    
+    free(output);
+    unlink("bg_priority_test.sh");
+    unlink("bg_priority_output.txt");
+    TEST_PASS();
+}
+
+void test_job_timeout(void) {
+    TEST_START("timeout prefix and JOB_TIMEOUT end jobs with SIGTERM, then SIGKILL");
+    
+    FILE *script = fopen("job_timeout_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "timeout 0.3 sleep 5\n");
+    fprintf(script, "echo fg_status=$?\n");
+    fprintf(script, "timeout 2 echo quick\n");
+    fprintf(script, "echo quick_status=$?\n");
+    fprintf(script, "set JOB_TIMEOUT 0.3\n");
+    fprintf(script, "set TIMEOUT_GRACE 0.2\n");
+    // Ignores SIGTERM, so only the SIGKILL after the grace period ends it
+    fprintf(script, "sh -c 'trap \"\" TERM; sleep 5' | cat\n");
+    fprintf(script, "echo stubborn_status=$?\n");
+    fprintf(script, "set JOB_TIMEOUT off\n");
+    fprintf(script, "timeout 0.3 sleep 5 &\n");
+    fprintf(script, "wait %%4\n");
+    fprintf(script, "echo bg_status=$?\n");
+    fprintf(script, "jobs\n");
+    fprintf(script, "timeout soon sleep 1\n");
+    fprintf(script, "exit 0\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("job_timeout_test.sh", 0755);
+    int result = system("./job_timeout_test.sh > job_timeout_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Job timeout test failed");
+    
+    char *output = read_file_content("job_timeout_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read job timeout output");
+    ASSERT_TRUE(strstr(output, "fg_status=124") != NULL, "Foreground job did not time out with 124");
+    ASSERT_TRUE(strstr(output, "quick_status=0") != NULL, "Job that finished in time was not left alone");
+    ASSERT_TRUE(strstr(output, "stubborn_status=124") != NULL, "JOB_TIMEOUT did not SIGKILL a job ignoring SIGTERM");
+    ASSERT_TRUE(strstr(output, "bg_status=124") != NULL, "wait did not see the background job time out");
+    ASSERT_TRUE(strstr(output, "Timed out after 0.3s") != NULL, "Timeout was not reported");
+    ASSERT_TRUE(strstr(output, "Timed out            (bg)") != NULL, "jobs does not show the timed out state");
+    ASSERT_TRUE(strstr(output, "timeout: soon") != NULL, "Invalid duration not reported");
+    
+    free(output);
+    unlink("job_timeout_test.sh");
+    unlink("job_timeout_output.txt");
+    TEST_PASS();
+}
+
+void test_job_output_capture(void) {
+    TEST_START("JOB_CAPTURE keeps background output in per-job rings for joblog");
+    
+    FILE *script = fopen("job_capture_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "set JOB_CAPTURE 4K\n");
+    fprintf(script, "sh -c 'echo captured_out; echo captured_err >&2' &\n");
+    fprintf(script, "seq 1 20000 &\n");
+    fprintf(script, "sleep 0.5\n");
+    fprintf(script, "echo marker\n");
+    fprintf(script, "joblog %%1\n");
+    fprintf(script, "joblog %%2 | tail -1\n");
+    fprintf(script, "sh -c 'echo first; sleep 0.3; echo second' &\n");
+    fprintf(script, "joblog -f %%4\n");  // %3 is the joblog | tail pipeline
+    fprintf(script, "echo follow_status=$?\n");
+    fprintf(script, "joblog %%9\n");
+    fprintf(script, "set JOB_CAPTURE 1\n");
+    fprintf(script, "seq 1 20000 &\n");
+    fprintf(script, "sleep 0.5\n");
+    fprintf(script, "joblog | head -1 | sed s/^/default_ring_/\n");
+    fprintf(script, "set JOB_CAPTURE 100\n");
+    fprintf(script, "echo uncaptured &\n");
+    fprintf(script, "sleep 0.3\n");
+    fprintf(script, "exit 0\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("job_capture_test.sh", 0755);
+    int result = system("./job_capture_test.sh > job_capture_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Job capture test failed");
+    
+    char *output = read_file_content("job_capture_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read job capture output");
+    // Nothing a captured job writes reaches the terminal before joblog shows it
+    char *marker = strstr(output, "marker");
+    ASSERT_TRUE(marker != NULL, "Marker missing");
+    char *out = strstr(output, "captured_out");
+    char *err = strstr(output, "captured_err");
+    ASSERT_TRUE(out != NULL && out > marker, "joblog did not show the captured stdout");
+    ASSERT_TRUE(err != NULL && err > marker, "joblog did not show the captured stderr");
+    ASSERT_TRUE(strstr(output, "earlier bytes were overwritten") != NULL, "Ring did not report dropped bytes");
+    ASSERT_TRUE(strstr(output, "\n20000\n") != NULL, "Ring did not keep the newest output");
+    ASSERT_TRUE(strstr(output, "first\nsecond\n") != NULL && strstr(output, "follow_status=0") != NULL,
+                "joblog -f did not follow the job to the end");
+    ASSERT_TRUE(strstr(output, "joblog: %9: no such job") != NULL, "Unknown job not reported");
+    ASSERT_TRUE(strstr(output, "default_ring_1\n") != NULL, "JOB_CAPTURE=1 did not get the default ring");
+    ASSERT_TRUE(strstr(output, "JOB_CAPTURE: 100: expected") != NULL && strstr(output, "uncaptured") != NULL,
+                "A too small ring was not rejected");
+    
+    free(output);
+    unlink("job_capture_test.sh");
+    unlink("job_capture_output.txt");
+    TEST_PASS();
+}
+
+void test_time_keyword(void) {
+    TEST_START("time reports per-process rusage and jobs -l lists it");
+    
+    FILE *script = fopen("time_keyword_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "time sleep 0.3 | cat\n");
+    fprintf(script, "echo status=$?\n");
+    fprintf(script, "time\n");
+    fprintf(script, "echo bare_time=$?\n");
+    fprintf(script, "timeout 5\n");
+    fprintf(script, "echo bare_timeout=$?\n");
+    fprintf(script, "sleep 1 &\n");
+    fprintf(script, "jobs -l\n");
+    fprintf(script, "wait\n");
+    fprintf(script, "exit 0\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("time_keyword_test.sh", 0755);
+    int result = system("./time_keyword_test.sh > time_keyword_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "time test failed");
+    
+    char *output = read_file_content("time_keyword_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read time output");
+    char *real = strstr(output, "real\t");
+    ASSERT_TRUE(real != NULL && strstr(output, "user\t") != NULL && strstr(output, "sys\t") != NULL,
+                "time did not print real, user and sys");
+    double seconds = atof(real + 5);
+    ASSERT_TRUE(seconds >= 0.3 && seconds < 5, "time reported the wrong real time");
+    ASSERT_TRUE(strstr(output, "maxrss") != NULL && strstr(output, "majflt") != NULL, "No per-process table");
+    ASSERT_TRUE(strstr(output, " sleep ") != NULL && strstr(output, " cat ") != NULL,
+                "time did not list each stage");
+    ASSERT_TRUE(strstr(output, "status=0") != NULL, "time changed the pipeline's status");
+    ASSERT_TRUE(strstr(output, "Missing command after 'time'") != NULL && strstr(output, "bare_time=2") != NULL,
+                "time with no command was not a usage error");
+    ASSERT_TRUE(strstr(output, "Missing command after 'timeout'") != NULL && strstr(output, "bare_timeout=2") != NULL,
+                "timeout with no command was not a usage error");
+    char *running = strstr(output, "(bg) sleep 1");
+    ASSERT_TRUE(running != NULL && strstr(running, "maxrss") != NULL, "jobs -l did not show usage columns");
+    
+    free(output);
+    unlink("time_keyword_test.sh");
+    unlink("time_keyword_output.txt");
+    TEST_PASS();
+}
+
+void test_trace_dump(void) {
+    TEST_START("trace records command phases and dumps Chrome trace JSON");
+    
+    FILE *script = fopen("trace_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "trace on 256\n");
+    fprintf(script, "ls / | wc -l\n");
+    fprintf(script, "trace off\n");
+    fprintf(script, "echo untraced_line\n");
+    fprintf(script, "trace dump trace_test.json\n");
+    fprintf(script, "trace\n");
+    fprintf(script, "trace bogus\n");
+    fprintf(script, "exit 0\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("trace_test.sh", 0755);
+    int result = system("./trace_test.sh > trace_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Trace test failed");
+    
+    char *output = read_file_content("trace_output.txt");
+    char *json = read_file_content("trace_test.json");
+    ASSERT_TRUE(output != NULL && json != NULL, "Could not read trace output");
+    ASSERT_TRUE(strstr(json, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") == json, "Not Chrome trace JSON");
+    ASSERT_TRUE(strstr(json, "\"name\":\"parse\"") != NULL && strstr(json, "\"name\":\"expand\"") != NULL,
+                "Parse and expansion not traced");
+    ASSERT_TRUE(strstr(json, "\"name\":\"fork\"") != NULL && strstr(json, "\"name\":\"wait\"") != NULL,
+                "Fork and wait not traced");
+    // Children record their own PATH lookup and exec into the shared ring
+    ASSERT_TRUE(strstr(json, "\"name\":\"path lookup\"") != NULL, "PATH lookup not traced");
+    ASSERT_TRUE(strstr(json, "\"name\":\"exec\"") != NULL && strstr(json, "\"ph\":\"i\"") != NULL,
+                "exec not traced");
+    ASSERT_TRUE(strstr(json, "\"detail\":\"ls / | wc -l\"") != NULL, "Command line not recorded");
+    ASSERT_TRUE(strstr(json, "untraced_line") == NULL, "Recorded after trace off");
+    ASSERT_TRUE(strstr(output, "trace: off,") != NULL, "trace did not report its state");
+    ASSERT_TRUE(strstr(output, "trace: usage:") != NULL, "Bad subcommand not reported");
+    
+    free(output);
+    free(json);
+    unlink("trace_test.sh");
+    unlink("trace_output.txt");
+    unlink("trace_test.json");
+    TEST_PASS();
+}
+
+void test_shellstat(void) {
+    TEST_START("shellstat counts forks, execs and jobs and keeps latency histograms");
+    
+    FILE *script = fopen("shellstat_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "shellstat -r\n");
+    fprintf(script, "/bin/true | cat\n");
+    fprintf(script, "no_such_command_xyz\n");
+    fprintf(script, "echo $HOME > /dev/null\n");
+    fprintf(script, "echo $(echo a) `echo b` > /dev/null\n");
+    fprintf(script, "shellstat\n");
+    fprintf(script, "shellstat -m\n");
+    fprintf(script, "exit 0\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("shellstat_test.sh", 0755);
+    int result = system("./shellstat_test.sh > shellstat_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "shellstat test failed");
+    
+    char *output = read_file_content("shellstat_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read shellstat output");
+    // Three children; the two that exec count in the shell's totals from their own process
+    ASSERT_TRUE(strstr(output, "forks            3\n") != NULL, "Forks not counted");
+    ASSERT_TRUE(strstr(output, "execs            2\n") != NULL, "Execs not counted");
+    ASSERT_TRUE(strstr(output, "exec_failures    1\n") != NULL, "Exec failure not counted");
+    ASSERT_TRUE(strstr(output, "jobs_created     2\n") != NULL && strstr(output, "jobs_reaped      2\n") != NULL,
+                "Jobs not counted");
+    // One parse per input line; substitutions re-parsed when they run don't count
+    ASSERT_TRUE(strstr(output, "parse time: 5 samples") != NULL, "Parse histogram missing or counts substitutions");
+    ASSERT_TRUE(strstr(output, "spawn time: 2 samples") != NULL, "Spawn histogram missing");
+    ASSERT_TRUE(strstr(output, "command-to-prompt time: 5 samples") != NULL, "Command histogram missing");
+    ASSERT_TRUE(strstr(output, "# TYPE mysh_forks_total counter\nmysh_forks_total 3\n") != NULL,
+                "Machine-readable counters missing");
+    ASSERT_TRUE(strstr(output, "mysh_parse_seconds_bucket{le=\"+Inf\"} 6\n") != NULL &&
+                strstr(output, "mysh_parse_seconds_count 6\n") != NULL, "Machine-readable histogram missing");
+    
+    free(output);
+    unlink("shellstat_test.sh");
+    unlink("shellstat_output.txt");
+    TEST_PASS();
+}
+
+void test_job_table_export(void) {
+    TEST_START("Shells export their job tables for mysh-top");
+    
+    FILE *script = fopen("jobshm_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "timeout 10 ./mysh << 'EOF'\n");
+    fprintf(script, "sleep 5 &\n");
+    fprintf(script, "sleep 4 | cat &\n");
+    fprintf(script, "kill -STOP $!\n");
+    fprintf(script, "sleep 0.5\n");
+    fprintf(script, "sh -c 'echo shell_pid=$PPID'\n");
+    fprintf(script, "./mysh-top -1\n");
+    fprintf(script, "kill -KILL %%1 %%2\n");
+    fprintf(script, "exit 0\n");
+    fprintf(script, "EOF\n");
+    fclose(script);
+    
+    chmod("jobshm_test.sh", 0755);
+    int result = system("./jobshm_test.sh > jobshm_output.txt 2>&1");
+    
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Job table export test failed");
+    
+    char *output = read_file_content("jobshm_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read mysh-top output");
+    char *pid_line = strstr(output, "shell_pid=");
+    int shell_pid = pid_line != NULL ? atoi(pid_line + 10) : 0;
+    ASSERT_TRUE(shell_pid > 0, "Could not learn the test shell's pid");
+    char *header = strstr(output, "SHELL    JOB   PGID");
+    ASSERT_TRUE(header != NULL, "mysh-top printed no table");
+    
+    // Other shells on the host may be listed too; only this shell's rows count
+    int found_first = 0, found_stopped = 0, found_top = 0;
+    for (char *row = strchr(header, '\n'); row != NULL && row[1] != '\0'; row = strchr(row, '\n')) {
+        row++;
+        char *end = strchr(row, '\n');
+        if (end == NULL) break;
+        *end = '\0';
+        int row_shell = 0, job_id = 0, pgid = 0;
+        if (sscanf(row, "%d %d %d", &row_shell, &job_id, &pgid) == 3 && row_shell == shell_pid) {
+            if (job_id == 1 && pgid > 0 && strstr(row, "Running    bg") != NULL && strstr(row, "sleep 5") != NULL)
+                found_first = 1;
+            if (strstr(row, "Stopped    bg") != NULL && strstr(row, "sleep 4 | cat") != NULL) found_stopped = 1;
+            if (strstr(row, "./mysh-top -1") != NULL) found_top = 1;
+        }
+        *end = '\n';
+    }
+    ASSERT_TRUE(found_first, "Job 1 not listed as running with its process group");
+    ASSERT_TRUE(found_stopped, "Stopped job not shown as stopped");
+    ASSERT_TRUE(found_top, "Foreground job not listed");
+    // The segment goes away with the shell
+    char path[64];
+    snprintf(path, sizeof(path), "/dev/shm/mysh-%d", shell_pid);
+    ASSERT_TRUE(access(path, F_OK) != 0, "Segment left behind after exit");
+    free(output);
+    
+    // A shell idle at a prompt (on a terminal, via script(1)) publishes stops and continues
+    script = fopen("jobshm_test.sh", "w");
+    fprintf(script, "#!/bin/bash\n");
+    fprintf(script, "rm -f jobshm_pty_in; mkfifo jobshm_pty_in\n");
+    fprintf(script, "timeout 15 script -qfec ./mysh /dev/null < jobshm_pty_in > /dev/null 2>&1 &\n");
+    fprintf(script, "exec 3> jobshm_pty_in\n");
+    fprintf(script, "echo '/bin/sleep 29 &' >&3\n");
+    fprintf(script, "sleep 1\n");
+    fprintf(script, "pid=$(pgrep -x -f '/bin/sleep 29')\n");
+    fprintf(script, "kill -STOP $pid; sleep 0.5\n");
+    fprintf(script, "./mysh-top -1 | grep 'sleep 29' | sed s/^/after_stop:/\n");
+    fprintf(script, "kill -CONT $pid; sleep 0.5\n");
+    fprintf(script, "./mysh-top -1 | grep 'sleep 29' | sed s/^/after_cont:/\n");
+    fprintf(script, "kill -KILL $pid\n");
+    fprintf(script, "echo exit >&3; exec 3>&-\n");
+    fprintf(script, "wait\n");
+    fprintf(script, "rm -f jobshm_pty_in\n");
+    fclose(script);
+    
+    result = system("./jobshm_test.sh > jobshm_output.txt 2>&1");
+    ASSERT_TRUE(WEXITSTATUS(result) == 0, "Idle prompt export test failed");
+    output = read_file_content("jobshm_output.txt");
+    ASSERT_TRUE(output != NULL, "Could not read mysh-top output");
+    char *stopped = strstr(output, "after_stop:");
+    char *resumed = strstr(output, "after_cont:");
+    ASSERT_TRUE(stopped != NULL && strstr(stopped, "Stopped") != NULL && strstr(stopped, "Stopped") < resumed,
+                "Stop not published while the shell waits at its prompt");
+    ASSERT_TRUE(resumed != NULL && strstr(resumed, "Running") != NULL,
+                "Continue not published while the shell waits at its prompt");
+    
+    free(output);
+    unlink("jobshm_test.sh");
+    unlink("jobshm_output.txt");
+    TEST_PASS();
+}
+
 void run_all_integration_tests(void) {
     printf("=== Running Integration Tests ===\n");
     printf("Note: These tests require the shell executable './mysh' to be present\n\n");
@@ -590,6 +1707,33 @@ void run_all_integration_tests(void) {
     test_variable_in_redirection();
     test_escaped_variable();
     test_undefined_variable();
+    test_command_substitution();
+    test_process_substitution();
+    test_here_documents();
+    test_command_lists();
+    test_grouping();
+    test_exec_and_script_modes();
+    test_script_failing_command();
+    test_multiline_command_string();
+    test_utility_builtins();
+    test_multiple_output_redirections();
+    test_pipe_size();
+    test_pipestat();
+    test_parallel_stage();
+    test_merge();
+    test_parallel_builtin();
+    test_job_slots();
+    test_wait_builtin();
+    test_coproc();
+    test_cpu_affinity();
+    test_pressure_governor();
+    test_background_priority();
+    test_job_timeout();
+    test_job_output_capture();
+    test_time_keyword();
+    test_trace_dump();
+    test_shellstat();
+    test_job_table_export();
     
     printf("\n=== Integration Test Results ===\n");
     printf("Passed: %d\n", test_result.passed);
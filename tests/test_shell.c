@@ -374,12 +374,12 @@ char* mock_expand_variable(const char *input) {
     
     for (const char *src = input; *src; src++) {
         if (*src == '$') {
-            if (*(src + 1) == '(') {
-                // Handle $(VAR) format
-                src += 2; // skip $( 
+            if (*(src + 1) == '{') {
+                // Handle ${VAR} format
+                src += 2; // skip ${ 
                 const char *var_start = src;
-                while (*src && *src != ')') src++;
-                if (*src == ')') {
+                while (*src && *src != '}') src++;
+                if (*src == '}') {
                     char var_name[256];
                     int len = src - var_start;
                     strncpy(var_name, var_start, len);
@@ -393,7 +393,7 @@ char* mock_expand_variable(const char *input) {
                 } else {
                     // Malformed, copy literal
                     *dest++ = '$';
-                    *dest++ = '(';
+                    *dest++ = '{';
                     strcpy(dest, var_start);
                     dest += strlen(var_start);
                 }
@@ -508,8 +508,8 @@ void test_variable_expansion(void) {
     assert(strstr(result, "/home/user") != NULL);
     free(result);
     
-    // Test parentheses variable expansion
-    result = mock_expand_variable("prefix_$(USER)_suffix");
+    // Test braced variable expansion
+    result = mock_expand_variable("prefix_${USER}_suffix");
     assert(strstr(result, "prefix_testuser_suffix") != NULL);
     free(result);
     